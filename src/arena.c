@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * arena.c - bump allocation of memory that is all freed at once
+ */
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* memory from arena_alloc() is aligned for the types that rows hold;
+ * strings are packed with no gaps between them */
+#define ALIGNMENT sizeof(union { long long l; double d; void *p; })
+
+typedef struct block {
+    struct block *next;		/* the block filled before this one */
+    size_t size;		/* bytes in data */
+    size_t used;		/* bytes handed out */
+    union {
+        long long l;
+        double d;
+        void *p;
+    } data[1];			/* start of the memory handed out */
+} Block;
+
+struct arena {
+    Block *blocks;		/* the block being filled, then older ones */
+};
+
+#define BLOCK_HEADER offsetof(Block, data)
+
+static Block *new_block(size_t size) {
+    Block *b;
+
+    if (! (b = (Block *)malloc(BLOCK_HEADER + size)))
+        return NULL;
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    return b;
+}
+
+Arena *arena_new(void) {
+    Arena *a;
+
+    if (! (a = (Arena *)malloc(sizeof(Arena))))
+        return NULL;
+    a->blocks = NULL;
+    return a;
+}
+
+/*
+ * returns n bytes starting at a multiple of align, which is a power of 2
+ */
+static void *take(Arena *a, size_t n, size_t align) {
+    Block *b = a->blocks;
+    size_t at = 0;
+    void *p;
+
+    if (b)
+        at = (b->used + align - 1) & ~(align - 1);
+    if (! b || at > b->size || b->size - at < n) {
+        /* a large request gets a block of its own, behind the current
+         * one, so that the room left in the current one is not lost */
+        if (n > ARENA_BLOCK / 4 && b) {
+            if (! (b = new_block(n)))
+                return NULL;
+            b->next = a->blocks->next;
+            a->blocks->next = b;
+        } else {
+            if (! (b = new_block((n > ARENA_BLOCK) ? n : ARENA_BLOCK)))
+                return NULL;
+            b->next = a->blocks;
+            a->blocks = b;
+        }
+        at = 0;
+    }
+    p = (char *)b->data + at;
+    b->used = at + n;
+    return p;
+}
+
+void *arena_alloc(Arena *a, size_t n) {
+    return take(a, n, ALIGNMENT);
+}
+
+char *arena_strdup(Arena *a, const char *s) {
+    size_t n = strlen(s) + 1;
+    char *p;
+
+    if ((p = (char *)take(a, n, 1)))
+        memcpy(p, s, n);
+    return p;
+}
+
+void arena_free(Arena *a) {
+    Block *b, *next;
+
+    if (! a)
+        return;
+    for (b = a->blocks; b; b = next) {
+        next = b->next;
+        free(b);
+    }
+    free(a);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * arena.h - bump allocation of memory that is all freed at once
+ *
+ * an arena hands out memory from large blocks, one after another, and
+ * never frees any of it on its own; arena_free() releases the lot.  It
+ * holds the rows of a set of results (see rtab.h), which are built a
+ * piece at a time and freed together once they have been sent.  An
+ * arena is not thread-safe
+ */
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+#define ARENA_BLOCK 65536		/* size of an ordinary block */
+
+typedef struct arena Arena;
+
+/*
+ * returns a new, empty arena, or NULL if there is insufficient memory
+ */
+Arena *arena_new(void);
+
+/*
+ * returns n bytes from the arena, aligned for integers, doubles and
+ * pointers
+ *
+ * returns NULL if there is insufficient memory
+ */
+void *arena_alloc(Arena *a, size_t n);
+
+/*
+ * returns a copy of s in the arena, or NULL if there is insufficient
+ * memory
+ */
+char *arena_strdup(Arena *a, const char *s);
+
+/*
+ * frees the arena and everything that was allocated from it
+ */
+void arena_free(Arena *a);
+
+#endif /* _ARENA_H_ */
@@ -32,10 +32,20 @@
 /*
  * Homework Cache
  *
- * single-threaded provider of the Homework Database using SRPC
+ * multi-threaded provider of the Homework Database using SRPC
  *
  * expects SQL statement in input buffer, sends back results of
  * query in output buffer
+ *
+ * requests are served by a pool of worker threads, each of which takes
+ * the next request from the HWDB service, runs it and sends the
+ * response; a sender does not issue its next request until it has the
+ * response to the previous one, so requests from the same sender are
+ * run in order whichever worker takes them
+ *
+ * queries on different tables run in parallel; within a table, queries
+ * share it and inserts take it exclusively (see table.c); a SNAPSHOT
+ * waits for the requests in progress, since the process is forked
  */
 
 #include "config.h"
@@ -44,42 +54,81 @@
 #include "rtab.h"
 #include "srpc/srpc.h"
 #include "mb.h"
+#include "cursor.h"
 #include "timestamp.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <errno.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <pthread.h>
 
-#define USAGE "./cache [-p port] [-l packets|stats] [-c config-file]"
+#define USAGE "./cache [-p port] [-l packets|stats] [-c config-file] [-o options-file] [-m buffer-size] [-H no|transparent|explicit] [-f buffer-file] [-w workers]"
 #define LOG_STATS 1
 #define LOG_PACKETS 2
 #define STATS_COUNT 10000
 #define ILLEGAL_QUERY_RESPONSE "1<|>Illegal query<|>0<|>0<|>\n"
+#define MAX_BULK (SOCK_RECV_BUF_LEN / 16)	/* more than fit in a request */
+#define DEFAULT_WORKERS 4
+#define MAX_WORKERS 64
 
 char *progname;
-int must_exit = 0;
-int sig_received = 0;
+volatile sig_atomic_t must_exit = 0;
+volatile sig_atomic_t sig_received = 0;
 extern int log_allocation;
 
-static char buf[SOCK_RECV_BUF_LEN];
-static char resp[SOCK_RECV_BUF_LEN];
+/*
+ * each worker has its own request and response buffers
+ */
+typedef struct worker {
+    pthread_t thr;
+    char buf[SOCK_RECV_BUF_LEN];
+    char resp[SOCK_RECV_BUF_LEN];
+    char *queries[MAX_BULK];
+    Rtab *bulkresults[MAX_BULK];
+} Worker;
+
+static RpcService rps;
+static unsigned short snap;
+static int logging = LOG_STATS;
+static int isreadonly = 0;
+static int nworkers = DEFAULT_WORKERS;
+static Worker *workers = NULL;
+
+/* held shared while a request runs, exclusively for a snapshot */
+static pthread_rwlock_t gate;
+
+static pthread_mutex_t lock;		/* protects count and nstopped */
+static pthread_cond_t stopped;		/* signalled when a worker stops */
+static int count = 0;			/* queries since the last stats */
+static int nstopped = 0;
 
+/*
+ * the workers stop once rpc_shutdown() wakes them, and serve() returns;
+ * finish() then saves the memory buffer once the requests in progress
+ * are done, which cannot safely be done here
+ */
 static void signal_handler(int signum) {
     sig_received = signum;
-    must_exit++;
+    must_exit = 1;
     rpc_shutdown();
-    fflush(stdout);
-    exit(1);
 }
 
+/*
+ * runs the statements in the configuration file; on a warm restart from
+ * a memory buffer file, those that create or fill the stream tables kept
+ * in the file are skipped (see hwdb_exec_config())
+ */
 static void loadfile(char *file, int log, int isreadonly) {
     FILE *fd;
     int len;
     Rtab *results;
     char stsmsg[RTAB_MSG_MAX_LENGTH];
+    char buf[SOCK_RECV_BUF_LEN], resp[SOCK_RECV_BUF_LEN];
 
     if (!(fd = fopen(file, "r"))) {
         fprintf(stderr, "Unable to open configuration file %s\n", file);
@@ -94,7 +143,7 @@ static void loadfile(char *file, int log, int isreadonly) {
         buf[len] = '\0';
         if (log)
             printf(">> %s\n", buf);
-        results = hwdb_exec_query(buf, isreadonly);
+        results = hwdb_exec_config(buf, isreadonly);
         if (! results)
             strcpy(resp, ILLEGAL_QUERY_RESPONSE);
         else
@@ -108,6 +157,128 @@ static void loadfile(char *file, int log, int isreadonly) {
     fclose(fd);
 }
 
+/*
+ * convert a size of the form <number>[K|M|G] to bytes
+ *
+ * returns 0 if the size is malformed, or too large for a long
+ */
+static long parse_size(char *str) {
+    char *p;
+    long n;
+    int shift = 0;
+
+    errno = 0;
+    n = strtol(str, &p, 10);
+    if (n <= 0 || errno == ERANGE)
+        return 0L;
+    switch (*p) {
+    case 'g': case 'G': shift += 10;	/* fall through */
+    case 'm': case 'M': shift += 10;	/* fall through */
+    case 'k': case 'K': shift += 10; p++; break;
+    case '\0': break;
+    default: return 0L;
+    }
+    if (n > (LONG_MAX >> shift))
+        return 0L;
+    return (*p == '\0') ? n << shift : 0L;
+}
+
+/*
+ * set huge page flags in mbc from one of no|transparent|explicit
+ *
+ * returns 1 if the mode is legal, 0 otherwise
+ */
+static int parse_hugepages(char *mode, MBConfig *mbc) {
+    mbc->flags &= ~(MB_HUGEPAGES_TRANSPARENT | MB_HUGEPAGES_EXPLICIT);
+    if (strcmp(mode, "no") == 0)
+        return 1;
+    if (strcmp(mode, "transparent") == 0) {
+        mbc->flags |= MB_HUGEPAGES_TRANSPARENT;
+        return 1;
+    }
+    if (strcmp(mode, "explicit") == 0) {
+        mbc->flags |= MB_HUGEPAGES_EXPLICIT;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * process an options file, consisting of lines of the form
+ *
+ * <key> <value>
+ *
+ * empty lines and lines starting with '#' are ignored; legal keys are
+ *
+ * buffer <size>[K|M|G]                - size of the memory buffer
+ * shards <n>                          - number of memory buffer shards
+ * hugepages no|transparent|explicit   - huge page usage for the buffer
+ * prefault yes|no                     - fault in the buffer at startup
+ * file <path>                         - file backing the buffer, so that
+ *                                       stream tables survive a restart
+ * workers <n>                         - number of threads serving queries
+ */
+static int loadoptions(char *file, MBConfig *mbc) {
+    FILE *fd;
+    char line[1024], key[128], value[896];
+    int lineno = 0, ok = 1;
+
+    if (!(fd = fopen(file, "r"))) {
+        fprintf(stderr, "Unable to open options file %s\n", file);
+        return 0;
+    }
+    while (fgets(line, sizeof(line), fd) != NULL) {
+        lineno++;
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%127s %895s", key, value) != 2) {
+            if (sscanf(line, "%127s", key) == 1) {
+                fprintf(stderr, "%s:%d: missing value for %s\n", file, lineno, key);
+                ok = 0;
+            }
+            continue;
+        }
+        if (strcmp(key, "buffer") == 0) {
+            if (!(mbc->size = parse_size(value))) {
+                fprintf(stderr, "%s:%d: illegal buffer size %s\n", file, lineno, value);
+                ok = 0;
+            }
+        } else if (strcmp(key, "shards") == 0) {
+            if ((mbc->nshards = atoi(value)) <= 0) {
+                fprintf(stderr, "%s:%d: illegal number of shards %s\n", file, lineno, value);
+                ok = 0;
+            }
+        } else if (strcmp(key, "hugepages") == 0) {
+            if (! parse_hugepages(value, mbc)) {
+                fprintf(stderr, "%s:%d: illegal hugepages mode %s\n", file, lineno, value);
+                ok = 0;
+            }
+        } else if (strcmp(key, "file") == 0) {
+            mbc->file = strdup(value);
+        } else if (strcmp(key, "workers") == 0) {
+            nworkers = atoi(value);
+            if (nworkers <= 0 || nworkers > MAX_WORKERS) {
+                fprintf(stderr, "%s:%d: illegal number of workers %s\n", file, lineno, value);
+                ok = 0;
+            }
+        } else if (strcmp(key, "prefault") == 0) {
+            if (strcmp(value, "yes") == 0)
+                mbc->flags |= MB_PREFAULT;
+            else if (strcmp(value, "no") == 0)
+                mbc->flags &= ~MB_PREFAULT;
+            else {
+                fprintf(stderr, "%s:%d: illegal prefault value %s\n", file, lineno, value);
+                ok = 0;
+            }
+        } else {
+            fprintf(stderr, "%s:%d: unknown option %s\n", file, lineno, key);
+            ok = 0;
+        }
+    }
+    fclose(fd);
+    return ok;
+}
+
 static void crtolf(char *buf) {
     while (*buf != '\0')
         if (*buf == '\r')
@@ -116,25 +287,306 @@ static void crtolf(char *buf) {
             buf++;
 }
 
-int main(int argc, char *argv[]) {
+/*
+ * initialize the gate, preferring a waiting snapshot over new requests
+ * where supported, so that a stream of queries cannot hold it off
+ */
+static void gate_init(void) {
+    pthread_rwlockattr_t attr;
+
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&attr,
+                                  PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif /* __GLIBC__ */
+    pthread_rwlock_init(&gate, &attr);
+    pthread_rwlockattr_destroy(&attr);
+}
+
+/*
+ * add n to the number of queries served, dumping the database stats
+ * every STATS_COUNT queries
+ */
+static void tally(int n) {
+    int dump = 0;
+
+    pthread_mutex_lock(&lock);
+    if ((count += n) >= STATS_COUNT) {
+        count = 0;
+        dump = (logging >= LOG_STATS);
+    }
+    pthread_mutex_unlock(&lock);
+    if (dump)
+        hwdb_dump();
+}
+
+static void serve(void);
+static int finish(void);
+
+/*
+ * fork a read-only copy of the database, serving queries on the
+ * snapshot port, and leave the response in resp; called holding the
+ * gate exclusively, so that no other request is in progress
+ *
+ * returns the length of the response; does not return in the copy
+ */
+static unsigned snapshot(char *resp) {
+    tstamp_t start, elapsed;
+    pid_t pid;
+
+    start = timestamp_now();
+    rpc_suspend();		/* suspend RPC processing */
+    pid = fork();
+    if (pid == -1) {
+        rpc_resume();
+        sprintf(resp, "1<|>Snapshot fork err<|>0<|>0<|>\n");
+    } else if (pid != 0) {	/* parent branch */
+        int status;
+        (void)wait(&status);
+        rpc_resume();
+        elapsed = (timestamp_now() - start) / 100000;
+        if (! status)
+            sprintf(resp, "0<|>Snapshot success, port=%hu, %lld.%lld ms<|>0<|>0<|>\n", snap, elapsed/10, elapsed%10);
+        else
+            sprintf(resp, "1<|>Snapshot fork err<|>0<|>0<|>\n");
+    } else {			/* child branch */
+        mb_detach();		/* the file is the parent's to save */
+        pid = fork();		/* zombie-free zone */
+        if (pid == -1)
+            exit(1);
+        else if (pid != 0)
+            exit(0);
+        if (! rpc_reinit(snap))
+            exit(1);
+        setsid();		/* new session */
+        isreadonly = 1;
+        /* only this thread survives the fork; start a new pool */
+        pthread_rwlock_unlock(&gate);
+        serve();
+        exit(finish());
+    }
+    return strlen(resp) + 1;
+}
+
+/*
+ * run a SQL, SQLB or BULK request, whose command has been split off into
+ * buf and whose body starts at p, leaving the response in w->resp
+ *
+ * returns the length of the response
+ */
+static unsigned execute(Worker *w, char *buf, char *p) {
+    char *q, *r, *resp = w->resp;
+    Rtab *results;
+    int i, j, ninserts, sofar, status;
+    int binary = (strcmp(buf, "SQLB") == 0);
+    unsigned len;
+
+    if (strcmp(buf, "SQL") == 0 || binary) {
+        q = p;
+        p = strchr(q, '\n');
+        if (p)
+            *p++ ='\0';
+        results = hwdb_exec_query(q, isreadonly);
+        if (logging >= LOG_PACKETS) {
+            rtab_print(results);
+        }
+        if (! results && ! binary) {
+            strcpy(resp, "1<|>Error<|>0<|>0<|>\n");
+            len = strlen(resp) + 1;
+        } else {
+            if (! results)
+                results = rtab_new_msg(RTAB_MSG_ERROR, NULL);
+            if (binary)
+                status = rtab_pack_binary(results, resp, SOCK_RECV_BUF_LEN, &i);
+            else
+                status = rtab_pack(results, resp, SOCK_RECV_BUF_LEN, &i);
+            if (! status)
+                printf("query results truncated\n");
+            len = i;
+        }
+        rtab_free(results);
+        tally(1);
+    } else {
+        q = p;
+        p = strchr(q, '\n');
+        *p++ = '\0';
+        ninserts = atoi(q);
+        if (ninserts > MAX_BULK) {
+            sprintf(resp, "1<|>Too many statements in BULK<|>0<|>0<|>\n");
+            return strlen(resp) + 1;
+        }
+        r = resp;
+        sofar = 0;
+        for (j = 0; j < ninserts; j++) {
+            w->queries[j] = p;
+            p = strchr(p, '\n');
+            *p++ = '\0';
+        }
+        hwdb_exec_bulk(ninserts, w->queries, isreadonly, w->bulkresults);
+        for (j = 0; j < ninserts; j++) {
+            results = w->bulkresults[j];
+            if (logging >= LOG_PACKETS) {
+                rtab_print(results);
+            }
+            if (! results) {
+                sofar += sprintf(r+sofar, "1<|>Error<|>0<|>0<|>\n");
+            } else {
+                (void) rtab_pack(results, r+sofar, SOCK_RECV_BUF_LEN, &i);
+                sofar += i;
+            }
+            rtab_free(results);
+        }
+        len = sofar;
+        tally(ninserts);
+    }
+    return len;
+}
+
+/*
+ * worker thread function
+ *
+ * legal queries are of the following form:
+ *
+ * SQL:<legal sql statement>\n
+ *
+ * BULK:<number>\n
+ * insert into .....\n  --+
+ * insert into .....\n    |
+ * ...                     > <number> of these
+ * ...                    |
+ * insert into .....\n  --+
+ *
+ * SQLB:<legal sql statement>\n
+ *
+ * SNAPSHOT:\n
+ *
+ * For SQL queries, the response will consist of a line of the form
+ *
+ * status<|>Status comment<|>ncols<|>nrows<|>\n
+ *
+ * if nrows > 0, subsequent lines in the response will consist of
+ * column descriptors, followed by column values for each row
+ *
+ * SQLB queries are run in the same way, but the response is packed in
+ * binary, a column at a time, as described in rtab.h
+ *
+ * for BULK inserts, the response will consist of <number> lines, each
+ * of the form
+ *
+ * status<|>Status comment<|>0<|>0<|>\n
+ *
+ * save that a BULK of more than MAX_BULK statements is refused with a
+ * single such line
+ *
+ * For SNAPSHOT commands, the response will consist of a line
+ *
+ * status<|>Status comment<|>0<|>0<|>\n
+ */
+static void *worker(void *args) {
+    Worker *w = (Worker *)args;
+    char *buf = w->buf, *resp = w->resp;
     RpcEndpoint sender;
     unsigned len;
-    RpcService rps;
-    unsigned short port, snap;
+    char *p;
+
+    cursor_requester(&sender);	/* cursors belong to their sender */
+    while (! must_exit) {
+        if ((len = rpc_query(rps, &sender, buf, SOCK_RECV_BUF_LEN)) == 0)
+            break;
+        buf[len] = '\0';
+        if (logging >= LOG_PACKETS) {
+            char tmp[SOCK_RECV_BUF_LEN];
+            strcpy(tmp, buf);
+            crtolf(tmp);
+            MSG("Received: %s", tmp);
+        }
+        p = strchr(buf, ':');
+        if (p == NULL) {
+            printf("Illegal query: %s\n", buf);
+            strcpy(resp, ILLEGAL_QUERY_RESPONSE);
+            len = strlen(resp) + 1;
+            rpc_response(rps, &sender, resp, len);
+            continue;
+        }
+        *p++ = '\0';
+        if (strcmp(buf, "SQL") == 0 || strcmp(buf, "SQLB") == 0 ||
+                strcmp(buf, "BULK") == 0) {
+            pthread_rwlock_rdlock(&gate);
+            len = execute(w, buf, p);
+            pthread_rwlock_unlock(&gate);
+        } else if (strcmp(buf, "SNAPSHOT") == 0) {
+            pthread_rwlock_wrlock(&gate);
+            len = snapshot(resp);
+            pthread_rwlock_unlock(&gate);
+        } else {
+            printf("Illegal query: %s:%s\n", buf, p);
+            strcpy(resp, ILLEGAL_QUERY_RESPONSE);
+            len = strlen(resp) + 1;
+        }
+        rpc_response(rps, &sender, resp, len);
+    }
+    pthread_mutex_lock(&lock);
+    nstopped++;
+    pthread_cond_signal(&stopped);
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+/*
+ * start nworkers threads serving requests, and wait until one of them
+ * stops
+ */
+static void serve(void) {
+    int i;
+
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&stopped, NULL);
+    count = 0;
+    nstopped = 0;
+    if (! (workers = (Worker *)malloc(nworkers * sizeof(Worker)))) {
+        fprintf(stderr, "Failure to allocate %d workers\n", nworkers);
+        return;
+    }
+    for (i = 0; i < nworkers; i++)
+        if (pthread_create(&(workers[i].thr), NULL, worker, &workers[i])) {
+            fprintf(stderr, "Failure to start worker %d\n", i);
+            break;
+        }
+    if (i == 0)
+        return;
+    pthread_mutex_lock(&lock);
+    while (! nstopped)
+        pthread_cond_wait(&stopped, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * we reach here if a signal is received or rpc_query yields 0; the
+ * requests in progress are allowed to complete before the memory
+ * buffer is saved
+ */
+static int finish(void) {
+    pthread_rwlock_wrlock(&gate);
+    if (must_exit) {
+        fprintf(stderr, "signal %d received\n", (int)sig_received);
+    } else {
+        fprintf(stderr, "rpc_query failure\n");
+    }
+    if (! mb_shutdown())
+        fprintf(stderr, "unable to save memory buffer file\n");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned short port;
     int i, j;
-    Rtab *results;
-    int log, count;
-    char *p, *q, *r;
-    int ninserts, sofar;
     char *cfile;
-    tstamp_t start, finish;
-    int isreadonly;
+    MBConfig mbc;
 
     port = HWDB_SERVER_PORT;
     snap = HWDB_SNAPSHOT_PORT;
-    log = LOG_STATS;
     cfile = NULL;
-    isreadonly = 0;
+    memset(&mbc, 0, sizeof(mbc));
     for (i = 1; i < argc; ) {
         if ((j = i + 1) == argc) {
             fprintf(stderr, "usage: %s\n", USAGE);
@@ -145,24 +597,48 @@ int main(int argc, char *argv[]) {
             snap = port + 1;
         } else if (strcmp(argv[i], "-l") == 0) {
             if (strcmp(argv[j], "packets") == 0)
-                log = LOG_PACKETS;
+                logging = LOG_PACKETS;
             else if (strcmp(argv[j], "stats") == 0)
-                log = LOG_STATS;
+                logging = LOG_STATS;
             else {
                 fprintf(stderr, "usage: %s\n", USAGE);
             }
         } else if (strcmp(argv[i], "-c") == 0) {
             cfile = argv[j];
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (! loadoptions(argv[j], &mbc))
+                exit(1);
+        } else if (strcmp(argv[i], "-m") == 0) {
+            if (!(mbc.size = parse_size(argv[j]))) {
+                fprintf(stderr, "Illegal buffer size: %s\n", argv[j]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-f") == 0) {
+            mbc.file = argv[j];
+        } else if (strcmp(argv[i], "-H") == 0) {
+            if (! parse_hugepages(argv[j], &mbc)) {
+                fprintf(stderr, "usage: %s\n", USAGE);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-w") == 0) {
+            nworkers = atoi(argv[j]);
+            if (nworkers <= 0 || nworkers > MAX_WORKERS) {
+                fprintf(stderr, "Illegal number of workers: %s\n", argv[j]);
+                exit(1);
+            }
         } else {
             fprintf(stderr, "Unknown flag: %s %s\n", argv[i], argv[j]);
         }
         i = j + 1;
     }
     printf("initializing database\n");
-    hwdb_init(1);
+    if (! hwdb_init(1, &mbc)) {
+        fprintf(stderr, "Failure to initialize database\n");
+        exit(-1);
+    }
     if (cfile) {
         printf("processing configuration file %s\n", cfile);
-        loadfile(cfile, log, isreadonly);
+        loadfile(cfile, logging, isreadonly);
     }
     printf("initializing rpc system\n");
     if (!rpc_init(port)) {
@@ -175,9 +651,8 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "Failure offering HWDB service\n");
         exit(-1);
     }
-    printf("starting to read queries from network\n");
+    printf("starting %d workers to read queries from network\n", nworkers);
     //log_allocation = 1;
-    count = 0;
 
     if (signal(SIGTERM, signal_handler) == SIG_IGN)
         signal(SIGTERM, SIG_IGN);
@@ -186,149 +661,7 @@ int main(int argc, char *argv[]) {
 */    if (signal(SIGHUP , signal_handler) == SIG_IGN)
         signal(SIGHUP , SIG_IGN);
 
-    /* legal queries are of the following form:
-     *
-     * SQL:<legal sql statement>\n
-     *
-     * BULK:<number>\n
-     * insert into .....\n  --+
-     * insert into .....\n    |
-     * ...                     > <number> of these
-     * ...                    |
-     * insert into .....\n  --+
-     *
-     * SNAPSHOT:\n
-     *
-     * For SQL queries, the response will consist of a line of the form
-     *
-     * status<|>Status comment<|>ncols<|>nrows<|>\n
-     *
-     * if nrows > 0, subsequent lines in the response will consist of
-     * column descriptors, followed by column values for each row
-     *
-     * for BULK inserts, the response will consist of <number> lines, each
-     * of the form
-     *
-     * status<|>Status comment<|>0<|>0<|>\n
-     *
-     * For SNAPSHOT commands, the response will consist of a line
-     *
-     * status<|>Status comment<|>0<|>0<|>\n
-     */
-    while (! must_exit) {
-        if ((len = rpc_query(rps, &sender, buf, SOCK_RECV_BUF_LEN)) == 0)
-            break;
-        buf[len] = '\0';
-        if (log >= LOG_PACKETS) {
-            static char tmp[SOCK_RECV_BUF_LEN];
-            strcpy(tmp, buf);
-            crtolf(tmp);
-            MSG("Received: %s", tmp);
-        }
-        p = strchr(buf, ':');
-        if (p == NULL) {
-            printf("Illegal query: %s\n", buf);
-            strcpy(resp, ILLEGAL_QUERY_RESPONSE);
-            len = strlen(resp) + 1;
-            rpc_response(rps, &sender, resp, len);
-            continue;
-        }
-        *p++ = '\0';
-        if (strcmp(buf, "SQL") == 0) {
-            count++;
-            q = p;
-            p = strchr(q, '\n');
-            if (p)
-                *p++ ='\0';
-            results = hwdb_exec_query(q, isreadonly);
-            if (log >= LOG_PACKETS) {
-                rtab_print(results);
-            }
-            if (! results) {
-                strcpy(resp, "1<|>Error<|>0<|>0<|>\n");
-                len = strlen(resp) + 1;
-            } else {
-                if (! rtab_pack(results, resp, SOCK_RECV_BUF_LEN, &i))
-                    printf("query results truncated\n");
-                len = i;
-            }
-            rtab_free(results);
-        } else if (strcmp(buf, "BULK") == 0) {
-            q = p;
-            p = strchr(q, '\n');
-            *p++ = '\0';
-            ninserts = atoi(q);
-            r = resp;
-            sofar = 0;
-            for (j = 0; j < ninserts; j++) {
-                q = p;
-                p = strchr(q, '\n');
-                *p++ = '\0';
-                count++;
-                results = hwdb_exec_query(q, isreadonly);
-                if (log >= LOG_PACKETS) {
-                    rtab_print(results);
-                }
-                if (! results) {
-                    sofar += sprintf(r+sofar, "1<|>Error<|>0<|>0<|>\n");
-                } else {
-                    (void) rtab_pack(results, r+sofar, SOCK_RECV_BUF_LEN, &i);
-                    sofar += i;
-                }
-                rtab_free(results);
-            }
-            len = sofar;
-        } else if (strcmp(buf, "SNAPSHOT") == 0) {
-            start = timestamp_now();
-            rpc_suspend();		/* suspend RPC processing */
-            pid_t pid = fork();
-            if (pid != 0) {
-                if (pid == -1) {
-                    rpc_resume();
-                    sprintf(resp, "1<|>Snapshot fork err<|>0<|>0<|>\n");
-                    len = strlen(resp) + 1;
-                } else if (pid != 0) {	/* parent branch */
-                    int status;
-                    (void)wait(&status);
-                    rpc_resume();
-                    finish = (timestamp_now() - start) / 100000;
-                    if (! status)
-                        sprintf(resp, "0<|>Snapshot success, port=%hu, %lld.%lld ms<|>0<|>0<|>\n", snap, finish/10, finish%10);
-                    else
-                        sprintf(resp, "1<|>Snapshot fork err<|>0<|>0<|>\n");
-                    len = strlen(resp) + 1;
-                }
-            } else {			/* child branch */
-                pid_t pid = fork();	/* zombie-free zone */
-                if (pid == -1)
-                    exit(1);
-                else if (pid != 0)
-                    exit(0);
-                if (! rpc_reinit(snap))
-                    exit(1);
-                setsid();		/* new session */
-                isreadonly = 1;
-                continue;		/* no response to send */
-            }
-        } else {
-            printf("Illegal query: %s:%s\n", buf, p);
-            strcpy(resp, ILLEGAL_QUERY_RESPONSE);
-            len = strlen(resp) + 1;
-        }
-        rpc_response(rps, &sender, resp, len);
-        if (count >= STATS_COUNT) {
-            count = 0;
-            if (log >= LOG_STATS)
-                mb_dump();
-        }
-    }
-    /*
-     * we reach here if a signal is received or rpc_query yields 0
-     */
-    if (must_exit) {
-        fprintf(stderr, "signal %d received\n", sig_received);
-    } else {
-        fprintf(stderr, "rpc_query failure\n");
-    }
-    return 0;
+    gate_init();
+    serve();
+    return finish();
 }
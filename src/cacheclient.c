@@ -57,6 +57,7 @@ static int pback = 0; /* if bf holds a pushed-back line */
 
 static int ifstream = 0;
 static FILE *f;
+static char *sqlcmd = "SQLB";	/* SQL if the server only answers in text */
 
 static void pushback(char *line) {
     pback = 1;
@@ -76,18 +77,27 @@ static char *fetchline(char *line) {
     return fgets(line, MAX_LINE, stdin);
 }
 
-static void processresults(char *buf, int len, int log) {
+/*
+ * prints the results in buf; returns the id of the cursor from which the
+ * rest of them are to be fetched, or 0 if they are complete
+ */
+static long processresults(char *buf, int len, int log) {
     Rtab *results;
-    char stsmsg[RTAB_MSG_MAX_LENGTH];
+    long id = 0;
 
     results = rtab_unpack(buf, len);
     if (! results)
-        printf("<< %s", buf);
-    else if (rtab_status(buf, stsmsg)) /* error reported */
-        printf("<< %s\n", stsmsg);
-    else if (log)
-        rtab_print(results);
+        printf("<< %s", (rtab_binary(buf, len)) ? "malformed results\n" : buf);
+    else if (results->mtype) /* error reported */
+        printf("<< %s\n", results->msg);
+    else {
+        if (log)
+            rtab_print(results);
+        if (sscanf(results->msg, RTAB_MSG_CURSOR, &id) != 1)
+            id = 0;
+    }
     rtab_free(results);
+    return id;
 }
 
 int main(int argc, char *argv[]) {
@@ -109,6 +119,7 @@ int main(int argc, char *argv[]) {
     char *inserts[MAX_INSERTS];
     int nreplies;
     char *service;
+    long id;
 
     host = HWDB_SERVER_ADDR;
     port = HWDB_SERVER_PORT;
@@ -194,7 +205,7 @@ int main(int argc, char *argv[]) {
             n = sofar + 1;
             nreplies = i;
         } else {
-            sprintf(query, "SQL:%s", inb);
+            sprintf(query, "%s:%s", sqlcmd, inb);
             n = strlen(query) + 1;	/* count '\0' */
             nreplies = 1;
         }
@@ -205,6 +216,16 @@ int main(int argc, char *argv[]) {
             fprintf(stderr, "rpc_call() failed\n");
             break;
         }
+        if (strncmp(query, "SQLB:", 5) == 0 && ! rtab_binary(resp, len)) {
+            /* an older server, which does not know SQLB; use SQL */
+            sqlcmd = "SQL";
+            sprintf(query, "%s:%s", sqlcmd, inb);
+            n = strlen(query) + 1;
+            if (! rpc_call(rpc, Q_Arg(query), n, resp, sizeof(resp), &len)) {
+                fprintf(stderr, "rpc_call() failed\n");
+                break;
+            }
+        }
         resp[len] = '\0';
         if (ifsnapshot)
             fprintf(stderr, "%s", resp);
@@ -221,7 +242,17 @@ int main(int argc, char *argv[]) {
                 processresults(inb, n, log);
             }
         } else {
-            processresults(resp, len, log);
+            id = processresults(resp, len, log);
+            while (id > 0) {	/* fetch the rest of the results */
+                sprintf(query, "%s:fetch %ld\n", sqlcmd, id);
+                if (! rpc_call(rpc, Q_Arg(query), strlen(query) + 1, resp,
+                               sizeof(resp), &len)) {
+                    fprintf(stderr, "rpc_call() failed\n");
+                    break;
+                }
+                resp[len] = '\0';
+                id = processresults(resp, len, log);
+            }
         }
     }
     gettimeofday(&stop, NULL);
@@ -50,8 +50,24 @@ struct cache_response_t {
 
     char** headers;
     char** data;
+
+    /* binary responses only; the strings above point into packed, and
+     * numbers are formatted into data when first asked for */
+    unsigned char* packed;
+    unsigned char* enc;
+    unsigned char** cols;
 };
 
+/* binary responses, to SQLB: queries; the layout is described in rtab.h */
+#define BINARY_MAGIC "HWB\001"
+#define BINARY_MAGIC_LEN 4
+#define ENC_INT 0
+#define ENC_REAL 1
+#define ENC_TSTAMP 2
+#define ENC_STR 3
+
+static int textonly = 0;   /* the cache does not know SQLB: */
+
 #define DBG 1
 static void dbmsg(char *msg, ...) {
     if (DBG) {
@@ -79,10 +95,101 @@ static char* fetch_str(char *p, char **str) {
         *str = '\0';
     return q;
 }
+static unsigned long get_u32(unsigned char *p) {
+    return (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+           ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static unsigned long long get_u64(unsigned char *p) {
+    return (unsigned long long)get_u32(p) |
+           ((unsigned long long)get_u32(p + 4) << 32);
+}
+
+/// Points *str at the string at *p, left in place, and moves *p past it
+static int get_str(unsigned char **p, unsigned char *end, char **str) {
+    unsigned long n;
+    if(end-*p < 4) { return 0; }
+    n = get_u32(*p);
+    if((unsigned long)(end-*p)-4 < n+1 || (*p)[4+n] != '\0') { return 0; }
+    *str = (char*)(*p+4);
+    *p += 4+n+1;
+    return 1;
+}
+
+static int is_binary(char* buf, int len) {
+    return len >= BINARY_MAGIC_LEN && memcmp(buf, BINARY_MAGIC, BINARY_MAGIC_LEN) == 0;
+}
+
+/// Decodes a binary response in place, with no copies of the values
+static CacheResponse newBinaryResponse(char* buf, int len) {
+    int c, r;
+    unsigned long ncols, nrows;
+    unsigned char *p, *end;
+    char *str;
+    CacheResponse ret;
+    ret = (CacheResponse)calloc(1, sizeof(struct cache_response_t));
+    if(ret==NULL) { return NULL; }
+
+    ret->packed = (unsigned char*)malloc(len);
+    if(ret->packed==NULL) { free(ret); return NULL; }
+    memcpy(ret->packed, buf, len);
+    p = ret->packed + BINARY_MAGIC_LEN;
+    end = ret->packed + len;
+
+    if(end-p < 1) { goto bad; }
+    ret->retcode = *p++;
+    if(!get_str(&p, end, &ret->message) || end-p < 8) { goto bad; }
+    ncols = get_u32(p);
+    nrows = get_u32(p+4);
+    p += 8;
+    if(ncols==0 || nrows==0) { return ret; }
+    // every value takes at least 5 bytes
+    if(ncols > (unsigned long)len || nrows > (unsigned long)len/(5*ncols)) { goto bad; }
+
+    ret->headers = (char**)malloc(sizeof(char*)*ncols);
+    ret->data = (char**)calloc(ncols*nrows, sizeof(char*));
+    ret->enc = (unsigned char*)malloc(ncols);
+    ret->cols = (unsigned char**)malloc(sizeof(unsigned char*)*ncols);
+    if(!ret->headers || !ret->data || !ret->enc || !ret->cols) { goto bad; }
+    for(c=0; c<ncols; c++) {
+        if(end-p < 1) { goto bad; }
+        ret->enc[c] = *p++;
+        if(ret->enc[c] > ENC_STR || !get_str(&p, end, &ret->headers[c])) { goto bad; }
+    }
+    for(c=0; c<ncols; c++) {
+        ret->cols[c] = p;
+        if(ret->enc[c] != ENC_STR) {
+            if((unsigned long)(end-p) < 8*nrows) { goto bad; }
+            p += 8*nrows;
+            continue;
+        }
+        for(r=0; r<nrows; r++) {
+            if(!get_str(&p, end, &str)) { goto bad; }
+            ret->data[r*ncols+c] = str;
+        }
+    }
+    ret->ncols = ncols;
+    ret->nrows = nrows;
+    return ret;
+
+bad:
+    dbmsg("malformed binary response");
+    free(ret->headers);
+    free(ret->data);
+    free(ret->enc);
+    free(ret->cols);
+    free(ret->packed);
+    free(ret);
+    return NULL;
+}
+
 CacheResponse newCacheResponse(char* buf, int len) {
     int i;
     CacheResponse ret;
-    ret = (CacheResponse)malloc(sizeof(struct cache_response_t));
+    if(is_binary(buf, len)) {
+        return newBinaryResponse(buf, len);
+    }
+    ret = (CacheResponse)calloc(1, sizeof(struct cache_response_t));
 
     char* tdat;
 
@@ -118,6 +225,18 @@ CacheResponse newCacheResponse(char* buf, int len) {
 int freeCacheResponse(CacheResponse r) {
     if(r==NULL) { return 1; }
     int i;
+    if(r->packed) {
+        // only the numbers formatted by cache_response_data are our own
+        for(i=0; i<r->ncols*r->nrows; i++) {
+            if(r->enc[i%r->ncols] != ENC_STR) { free(r->data[i]); }
+        }
+        free(r->headers);
+        free(r->data);
+        free(r->enc);
+        free(r->cols);
+        free(r->packed);
+        return 0;
+    }
     for(i=0; i<r->ncols; i++) {
         free(r->headers[i]);
     }
@@ -148,11 +267,67 @@ char* cache_response_header(CacheResponse r, int col) {
     }
     return NULL;
 }
+/// Returns the 8 bytes of a number in a binary response, NULL if it is text
+static unsigned char* binary_value(CacheResponse r, int row, int col) {
+    if(r->packed==NULL || r->enc[col]==ENC_STR) { return NULL; }
+    return r->cols[col] + 8*row;
+}
 char* cache_response_data(CacheResponse r, int row, int col) {
+    char buf[32];
+    unsigned char* v;
+    union { unsigned long long u; long long i; double d; } n;
     if(col<0 || col>=r->ncols) { return NULL; }
     if(row<0 || row>=r->nrows) { return NULL; }
+    if(r->data[row*r->ncols+col]==NULL && (v=binary_value(r, row, col))!=NULL) {
+        // formatted as the cache would have sent it as text
+        n.u = get_u64(v);
+        switch(r->enc[col]) {
+        case ENC_INT:
+            sprintf(buf, "%lld", n.i);
+            break;
+        case ENC_REAL:
+            sprintf(buf, "%.15g", n.d);
+            if(strtod(buf, NULL) != n.d) { sprintf(buf, "%.17g", n.d); }
+            break;
+        default:
+            sprintf(buf, "@%016llx@", n.u);
+            break;
+        }
+        r->data[row*r->ncols+col] = strdup(buf);
+    }
     return r->data[row*r->ncols+col];
 }
+long long cache_response_int(CacheResponse r, int row, int col) {
+    unsigned char* v;
+    char* s;
+    if(col<0 || col>=r->ncols) { return 0; }
+    if(row<0 || row>=r->nrows) { return 0; }
+    if((v=binary_value(r, row, col))!=NULL) {
+        if(r->enc[col]==ENC_REAL) { return (long long)cache_response_real(r, row, col); }
+        return (long long)get_u64(v);
+    }
+    s = r->data[row*r->ncols+col];
+    if(*s=='@') { return (long long)strtoull(s+1, NULL, 16); }
+    return strtoll(s, NULL, 10);
+}
+double cache_response_real(CacheResponse r, int row, int col) {
+    unsigned char* v;
+    union { unsigned long long u; double d; } n;
+    if(col<0 || col>=r->ncols) { return 0.0; }
+    if(row<0 || row>=r->nrows) { return 0.0; }
+    if((v=binary_value(r, row, col))!=NULL) {
+        n.u = get_u64(v);
+        if(r->enc[col]==ENC_REAL) { return n.d; }
+        return (r->enc[col]==ENC_INT) ? (double)(long long)n.u : (double)n.u;
+    }
+    if(*r->data[row*r->ncols+col]=='@') {
+        return (double)cache_response_tstamp(r, row, col);
+    }
+    return strtod(r->data[row*r->ncols+col], NULL);
+}
+unsigned long long cache_response_tstamp(CacheResponse r, int row, int col) {
+    return (unsigned long long)cache_response_int(r, row, col);
+}
 
 void print_cache_response(CacheResponse r, FILE* fd) {
     int i,j;
@@ -166,7 +341,7 @@ void print_cache_response(CacheResponse r, FILE* fd) {
 
     for(i=0;i<r->nrows;i++) {
         for(j=0; j<r->ncols; j++) {
-            fprintf(fd, "%s |", r->data[i*r->ncols+j]);
+            fprintf(fd, "%s |", cache_response_data(r, i, j));
         }
         fprintf(fd, "\n");
     }
@@ -354,9 +529,15 @@ CacheResponse raw_sql(char* query_text) {
     int rlen=4096;
     char rbuf[rlen];
 
-    Q_Decl(equery, alen+5);
-    snprintf(equery, alen+5, "SQL:%s", query_text);
+    Q_Decl(equery, alen+6);
+    snprintf(equery, alen+6, "%s:%s", textonly ? "SQL" : "SQLB", query_text);
     rc = rpc_call(rpc, Q_Arg(equery), strlen(equery)+1, rbuf, rlen, &len);
+    if(rc!=0 && !textonly && !is_binary(rbuf, len)) {
+        // an older cache, which does not know SQLB: ask again in text
+        textonly = 1;
+        snprintf(equery, alen+6, "SQL:%s", query_text);
+        rc = rpc_call(rpc, Q_Arg(equery), strlen(equery)+1, rbuf, rlen, &len);
+    }
     if(rc==0) {
         printf("raw query failed catastrophically\n");
         return NULL;
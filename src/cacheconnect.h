@@ -48,6 +48,9 @@ int cache_response_ncols(CacheResponse r);
 int cache_response_nrows(CacheResponse r);
 char* cache_response_headers(CacheResponse r, int col);
 char* cache_response_data(CacheResponse r, int row, int col);
+long long cache_response_int(CacheResponse r, int row, int col);
+double cache_response_real(CacheResponse r, int row, int col);
+unsigned long long cache_response_tstamp(CacheResponse r, int row, int col);
 void print_cache_response(CacheResponse r, FILE* fd);
 
 int connect_env(char** host, unsigned short* port, char** servicename);
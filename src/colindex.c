@@ -0,0 +1,529 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * colindex.c - secondary indexes over a column of a table
+ *
+ * a hash index chains the rows in buckets, appending each new row to the
+ * tail of its bucket, so that rows with the same value are found in the
+ * order in which they were added; stream tables evict their oldest rows,
+ * which are then at the head of their bucket
+ *
+ * an ordered index is a skip list sorted on the column value, ties being
+ * broken on the address of the node so that every entry has a unique
+ * position and can be found again for removal
+ */
+#include "colindex.h"
+
+#include "tuple.h"
+#include "util.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+/*
+ * initial number of buckets in a hash index (a power of 2); the bucket
+ * array is doubled whenever there are twice as many rows as buckets
+ */
+#define CIDX_BUCKETS 1024L
+
+/*
+ * maximum height of a skip list entry; each level has a quarter of the
+ * entries of the one below it
+ */
+#define CIDX_MAXLEVEL 24
+
+/* initial size of the array of rows returned by cidx_lookup() */
+#define CIDX_FOUND 16L
+
+typedef struct hentry {
+    struct hentry *next;	/* next entry in the bucket */
+    struct hentry *prev;	/* previous entry in the bucket */
+    unsigned long hash;		/* hash of the column value */
+    Node *node;			/* the row */
+} HEntry;
+
+typedef struct hbucket {
+    HEntry *head;		/* oldest entry in the bucket */
+    HEntry *tail;		/* newest entry in the bucket */
+} HBucket;
+
+typedef struct sentry {
+    Node *node;			/* the row */
+    int height;			/* number of forward links */
+    struct sentry *fwd[1];	/* forward links, one per level */
+} SEntry;
+
+struct colindex {
+    ColIndex *next;		/* next index on the same table */
+    char *name;			/* name of the index */
+    int col;			/* column indexed */
+    int *type;			/* type of the column */
+    int class;			/* TUPLE_ storage class of the column */
+    int kind;			/* SQL_INDEX_HASH or SQL_INDEX_ORDERED */
+    long count;			/* number of rows in the index */
+    int incomplete;		/* a row could not be added, so unusable */
+    HBucket *buckets;		/* hash: the buckets */
+    long nbuckets;		/* hash: number of buckets */
+    SEntry *head;		/* ordered: sentinel, CIDX_MAXLEVEL links */
+    int level;			/* ordered: height of tallest entry */
+    unsigned long long seed;	/* ordered: state for entry heights */
+};
+
+/*
+ * the column value of row n, in the form used by the filters
+ */
+static void node_value(ColIndex *x, Node *n, union filterval *v) {
+    unsigned char *t = n->tuple;
+
+    switch (x->class) {
+    case TUPLE_INT:
+        v->intv = tuple_int(t, x->col);
+        break;
+    case TUPLE_REAL:
+        v->realv = tuple_real(t, x->col);
+        break;
+    case TUPLE_TSTAMP:
+        v->tstampv = tuple_tstamp(t, x->col);
+        break;
+    default:
+        v->stringv = tuple_str(t, x->col);
+        break;
+    }
+}
+
+/*
+ * compares the column value of row n with v; reals are totally ordered,
+ * with NaNs after all numbers
+ */
+static int cmp_value(ColIndex *x, Node *n, union filterval *v) {
+    unsigned char *t = n->tuple;
+
+    switch (x->class) {
+    case TUPLE_INT: {
+        long long a = tuple_int(t, x->col);
+        return (a < v->intv) ? -1 : (a > v->intv);
+    }
+    case TUPLE_REAL: {
+        double a = tuple_real(t, x->col);
+        if (a < v->realv)
+            return -1;
+        if (a > v->realv)
+            return 1;
+        if (a == v->realv)
+            return 0;
+        return (a != a) - (v->realv != v->realv);	/* NaNs */
+    }
+    case TUPLE_TSTAMP: {
+        tstamp_t a = tuple_tstamp(t, x->col);
+        return (a < v->tstampv) ? -1 : (a > v->tstampv);
+    }
+    }
+    return strcmp(tuple_str(t, x->col), v->stringv);
+}
+
+static unsigned long hash_bits(unsigned long long k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return (unsigned long)k;
+}
+
+static unsigned long hash_value(ColIndex *x, union filterval *v) {
+    unsigned long long k;
+    unsigned char *p;
+    double d;
+
+    switch (x->class) {
+    case TUPLE_INT:
+        return hash_bits((unsigned long long)v->intv);
+    case TUPLE_REAL:
+        d = (v->realv == 0.0) ? 0.0 : v->realv;	/* -0.0 == 0.0 */
+        memcpy(&k, &d, sizeof(k));
+        return hash_bits(k);
+    case TUPLE_TSTAMP:
+        return hash_bits(v->tstampv);
+    }
+    k = 14695981039346656037ULL;	/* FNV-1a */
+    for (p = (unsigned char *)v->stringv; *p; p++)
+        k = (k ^ *p) * 1099511628211ULL;
+    return hash_bits(k);
+}
+
+/*
+ * appends the rows of a hash or skip list entry to a growing array
+ *
+ * returns 1 if successful, 0 if out of memory
+ */
+static int found_add(Node ***nodes, long *n, long *size, Node *node) {
+    if (*n == *size) {
+        long sz = (*size) ? 2 * (*size) : CIDX_FOUND;
+        Node **p = (Node **)realloc(*nodes, sz * sizeof(Node *));
+        if (! p)
+            return 0;
+        *nodes = p;
+        *size = sz;
+    }
+    (*nodes)[(*n)++] = node;
+    return 1;
+}
+
+/*
+ * hash indexes
+ */
+static void bucket_append(HBucket *b, HEntry *e) {
+    e->next = NULL;
+    e->prev = b->tail;
+    if (b->tail)
+        b->tail->next = e;
+    else
+        b->head = e;
+    b->tail = e;
+}
+
+/*
+ * doubles the number of buckets; entries are moved in order, so rows with
+ * the same value stay in the order in which they were added
+ */
+static void hash_grow(ColIndex *x) {
+    long i, nb = 2 * x->nbuckets;
+    HBucket *b = (HBucket *)calloc(nb, sizeof(HBucket));
+    HEntry *e, *next;
+
+    if (! b)			/* chains are just longer */
+        return;
+    for (i = 0; i < x->nbuckets; i++)
+        for (e = x->buckets[i].head; e; e = next) {
+            next = e->next;
+            bucket_append(&b[e->hash & (nb - 1)], e);
+        }
+    free(x->buckets);
+    x->buckets = b;
+    x->nbuckets = nb;
+}
+
+static int hash_add(ColIndex *x, Node *n) {
+    union filterval v;
+    HEntry *e;
+
+    if (x->count >= 2 * x->nbuckets)
+        hash_grow(x);
+    if (! (e = (HEntry *)malloc(sizeof(HEntry))))
+        return 0;
+    node_value(x, n, &v);
+    e->hash = hash_value(x, &v);
+    e->node = n;
+    bucket_append(&x->buckets[e->hash & (x->nbuckets - 1)], e);
+    return 1;
+}
+
+static int hash_remove(ColIndex *x, Node *n) {
+    union filterval v;
+    HBucket *b;
+    HEntry *e;
+
+    node_value(x, n, &v);
+    b = &x->buckets[hash_value(x, &v) & (x->nbuckets - 1)];
+    for (e = b->head; e; e = e->next)
+        if (e->node == n)
+            break;
+    if (! e)
+        return 0;
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        b->head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        b->tail = e->prev;
+    free(e);
+    return 1;
+}
+
+static long hash_lookup(ColIndex *x, union filterval *v, Node ***nodes) {
+    unsigned long h = hash_value(x, v);
+    long n = 0, size = 0;
+    HEntry *e;
+
+    *nodes = NULL;
+    for (e = x->buckets[h & (x->nbuckets - 1)].head; e; e = e->next)
+        if (e->hash == h && cmp_value(x, e->node, v) == 0)
+            if (! found_add(nodes, &n, &size, e->node)) {
+                free(*nodes);
+                return -1;
+            }
+    return n;
+}
+
+/*
+ * ordered indexes
+ */
+static int random_height(ColIndex *x) {
+    unsigned long long r;
+    int h = 1;
+
+    x->seed = x->seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    r = x->seed >> 16;
+    while (h < CIDX_MAXLEVEL && ! (r & 3)) {
+        h++;
+        r >>= 2;
+    }
+    return h;
+}
+
+/*
+ * returns true if entry e sorts before row n, whose column value is v
+ */
+static int entry_before(ColIndex *x, SEntry *e, Node *n, union filterval *v) {
+    int c = cmp_value(x, e->node, v);
+    return (c < 0 || (c == 0 && (unsigned long)e->node < (unsigned long)n));
+}
+
+/*
+ * fills in update[] with the last entry at each level that sorts before n
+ */
+static void skip_search(ColIndex *x, Node *n, SEntry *update[]) {
+    SEntry *p = x->head;
+    union filterval v;
+    int i;
+
+    node_value(x, n, &v);
+    for (i = x->level - 1; i >= 0; i--) {
+        while (p->fwd[i] && entry_before(x, p->fwd[i], n, &v))
+            p = p->fwd[i];
+        update[i] = p;
+    }
+}
+
+static int skip_add(ColIndex *x, Node *n) {
+    SEntry *update[CIDX_MAXLEVEL], *e;
+    int i, h;
+
+    skip_search(x, n, update);
+    h = random_height(x);
+    e = (SEntry *)malloc(sizeof(SEntry) + (h - 1) * sizeof(SEntry *));
+    if (! e)
+        return 0;
+    for (i = x->level; i < h; i++)
+        update[i] = x->head;
+    if (h > x->level)
+        x->level = h;
+    e->node = n;
+    e->height = h;
+    for (i = 0; i < h; i++) {
+        e->fwd[i] = update[i]->fwd[i];
+        update[i]->fwd[i] = e;
+    }
+    return 1;
+}
+
+static int skip_remove(ColIndex *x, Node *n) {
+    SEntry *update[CIDX_MAXLEVEL], *e;
+    int i;
+
+    skip_search(x, n, update);
+    e = update[0]->fwd[0];
+    if (! e || e->node != n)
+        return 0;
+    for (i = 0; i < e->height; i++)
+        update[i]->fwd[i] = e->fwd[i];
+    free(e);
+    while (x->level > 1 && ! x->head->fwd[x->level - 1])
+        x->level--;
+    return 1;
+}
+
+/*
+ * returns the first entry whose value is not less than v (greater than v,
+ * if strict)
+ */
+static SEntry *skip_find(ColIndex *x, union filterval *v, int strict) {
+    SEntry *p = x->head;
+    int i, c;
+
+    for (i = x->level - 1; i >= 0; i--)
+        while (p->fwd[i] && ((c = cmp_value(x, p->fwd[i]->node, v)) < 0 ||
+                             (strict && c == 0)))
+            p = p->fwd[i];
+    return p->fwd[0];
+}
+
+static long skip_lookup(ColIndex *x, int op, union filterval *v, Node ***nodes) {
+    long n = 0, size = 0;
+    SEntry *e;
+    int c;
+
+    *nodes = NULL;
+    switch (op) {
+    case SQL_FILTER_GREATER:
+        e = skip_find(x, v, 1);
+        break;
+    case SQL_FILTER_EQUAL:
+    case SQL_FILTER_GREATEREQ:
+        e = skip_find(x, v, 0);
+        break;
+    default:
+        e = x->head->fwd[0];
+        break;
+    }
+    for (; e; e = e->fwd[0]) {
+        c = cmp_value(x, e->node, v);
+        if ((op == SQL_FILTER_EQUAL && c != 0) ||
+                (op == SQL_FILTER_LESS && c >= 0) ||
+                (op == SQL_FILTER_LESSEQ && c > 0))
+            break;
+        if (! found_add(nodes, &n, &size, e->node)) {
+            free(*nodes);
+            return -1;
+        }
+    }
+    return n;
+}
+
+ColIndex *cidx_new(char *name, int col, int *type, int kind) {
+    ColIndex *x;
+
+    if (! (x = (ColIndex *)calloc(1, sizeof(ColIndex))))
+        return NULL;
+    x->name = strdup(name);
+    x->col = col;
+    x->type = type;
+    x->class = tuple_class(type);
+    x->kind = kind;
+    if (kind == SQL_INDEX_HASH) {
+        x->nbuckets = CIDX_BUCKETS;
+        x->buckets = (HBucket *)calloc(x->nbuckets, sizeof(HBucket));
+    } else {
+        x->level = 1;
+        x->seed = (unsigned long long)(unsigned long)x;
+        x->head = (SEntry *)calloc(1, sizeof(SEntry) +
+                                   (CIDX_MAXLEVEL - 1) * sizeof(SEntry *));
+    }
+    if (! x->name || (! x->buckets && ! x->head)) {
+        cidx_free(x);
+        return NULL;
+    }
+    return x;
+}
+
+void cidx_free(ColIndex *x) {
+    long i;
+
+    if (x->buckets) {
+        HEntry *e, *next;
+        for (i = 0; i < x->nbuckets; i++)
+            for (e = x->buckets[i].head; e; e = next) {
+                next = e->next;
+                free(e);
+            }
+        free(x->buckets);
+    }
+    if (x->head) {
+        SEntry *e, *next;
+        for (e = x->head->fwd[0]; e; e = next) {
+            next = e->fwd[0];
+            free(e);
+        }
+        free(x->head);
+    }
+    free(x->name);
+    free(x);
+}
+
+char *cidx_name(ColIndex *x) {
+    return x->name;
+}
+
+int cidx_column(ColIndex *x) {
+    return x->col;
+}
+
+int cidx_kind(ColIndex *x) {
+    return x->kind;
+}
+
+ColIndex *cidx_next(ColIndex *x) {
+    return x->next;
+}
+
+void cidx_set_next(ColIndex *x, ColIndex *next) {
+    x->next = next;
+}
+
+int cidx_supports(ColIndex *x, int op) {
+    if (x->incomplete)
+        return 0;
+    switch (op) {
+    case SQL_FILTER_EQUAL:
+        return 1;
+    case SQL_FILTER_GREATER:
+    case SQL_FILTER_LESS:
+    case SQL_FILTER_LESSEQ:
+    case SQL_FILTER_GREATEREQ:
+        /* strings are never ordered by the filters */
+        return (x->kind == SQL_INDEX_ORDERED && x->class != TUPLE_STR);
+    }
+    return 0;
+}
+
+int cidx_add(ColIndex *x, Node *n) {
+    int stat;
+
+    if (x->kind == SQL_INDEX_HASH)
+        stat = hash_add(x, n);
+    else
+        stat = skip_add(x, n);
+    if (stat)
+        x->count++;
+    else
+        x->incomplete = 1;
+    return stat;
+}
+
+void cidx_remove(ColIndex *x, Node *n) {
+    int stat;
+
+    if (x->kind == SQL_INDEX_HASH)
+        stat = hash_remove(x, n);
+    else
+        stat = skip_remove(x, n);
+    if (stat)
+        x->count--;
+}
+
+long cidx_lookup(ColIndex *x, int op, union filterval *value, Node ***nodes) {
+    if (x->kind == SQL_INDEX_HASH)
+        return hash_lookup(x, value, nodes);
+    return skip_lookup(x, op, value, nodes);
+}
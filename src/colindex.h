@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * colindex.h - secondary indexes over a column of a table
+ *
+ * a hash index answers equality filters; an ordered index, a skip list
+ * sorted on the column, also answers range filters on numeric and
+ * timestamp columns
+ *
+ * an index holds one entry per row of the table; it is maintained by the
+ * code that links rows into and out of the table, and must only be used
+ * with the table locked
+ */
+#ifndef _COLINDEX_H_
+#define _COLINDEX_H_
+
+#include "node.h"
+#include "sqlstmts.h"
+
+typedef struct colindex ColIndex;
+
+/*
+ * creates an empty index, of kind SQL_INDEX_HASH or SQL_INDEX_ORDERED,
+ * over column col, of the given type
+ *
+ * returns NULL if there is insufficient memory
+ */
+ColIndex *cidx_new(char *name, int col, int *type, int kind);
+
+void cidx_free(ColIndex *x);
+
+char *cidx_name(ColIndex *x);
+int cidx_column(ColIndex *x);
+int cidx_kind(ColIndex *x);
+
+/*
+ * the next index over the same table; indexes are chained off the table
+ */
+ColIndex *cidx_next(ColIndex *x);
+void cidx_set_next(ColIndex *x, ColIndex *next);
+
+/*
+ * returns 1 if the index can answer a filter with operator op
+ * (SQL_FILTER_EQUAL, ...), 0 otherwise
+ */
+int cidx_supports(ColIndex *x, int op);
+
+/*
+ * adds n to the index; returns 1 if successful, 0 if out of memory, in
+ * which case the index no longer supports any filter
+ */
+int cidx_add(ColIndex *x, Node *n);
+
+/*
+ * removes n from the index; n's tuple must be unchanged since it was added
+ */
+void cidx_remove(ColIndex *x, Node *n);
+
+/*
+ * finds the rows whose column satisfies "column op value"; the value is
+ * interpreted according to the type of the column, as the filters do
+ *
+ * returns the number of rows found, with a malloc'ed array of them in
+ * *nodes, or -1 if out of memory; rows found by a hash index are in the
+ * order in which they were added, by an ordered index in column order
+ */
+long cidx_lookup(ColIndex *x, int op, union filterval *value, Node ***nodes);
+
+#endif /* _COLINDEX_H_ */
@@ -0,0 +1,440 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * cursor.c - results of a select handed out a chunk at a time
+ */
+#include "cursor.h"
+
+#include "config.h"
+#include "plan.h"
+#include "sink.h"
+#include "nodecrawler.h"
+#include "timestamp.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <pthread.h>
+
+typedef struct cursor {
+    long id;			/* 0 until the cursor is first kept */
+    unsigned long used;		/* when last kept, to find the oldest */
+    Rtab *results;		/* column names and types; all the rows
+				   if computed, of which those before next
+				   have been returned */
+    int next;
+    Table *table;		/* table scanned, NULL if computed */
+    Plan *plan;			/* filters and projection of the scan */
+    int nfilters;
+    sqlfilter **filters;	/* copies of the filters of the select */
+    tstamp_t from;		/* timestamp of the next row to scan */
+    tstamp_t last;		/* timestamp of the last row in the window */
+    long skip;			/* rows still to skip for the offset */
+    long left;			/* rows still to return, -1 if no limit */
+    int owned;			/* set if opened by a request over RPC */
+    RpcEndpoint owner;		/* and the endpoint that sent it */
+} Cursor;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static Cursor *cursors[CURSOR_MAX];	/* open cursors, NULL if free */
+static long lastid = 0;
+static unsigned long ticks = 0;
+
+/* endpoint of the request that a thread is running, see cursor.h */
+static pthread_key_t requester;
+static pthread_once_t requester_once = PTHREAD_ONCE_INIT;
+
+static void requester_key(void) {
+    (void) pthread_key_create(&requester, NULL);
+}
+
+void cursor_requester(RpcEndpoint *ep) {
+    (void) pthread_once(&requester_once, requester_key);
+    (void) pthread_setspecific(requester, ep);
+}
+
+static RpcEndpoint *current_requester(void) {
+    (void) pthread_once(&requester_once, requester_key);
+    return (RpcEndpoint *)pthread_getspecific(requester);
+}
+
+/*
+ * returns 1 if the cursor belongs to the endpoint ep, NULL if the request
+ * did not come over RPC
+ */
+static int owned_by(Cursor *c, RpcEndpoint *ep) {
+    if (! c->owned)
+        return (ep == NULL);
+    return (ep && memcmp(&(c->owner), ep, sizeof(RpcEndpoint)) == 0);
+}
+
+static void free_cursor(Cursor *c) {
+    Rtab *r = c->results;
+    int i;
+
+    if (r)
+        rtab_free(r);
+    plan_free(c->plan);
+    for (i = 0; i < c->nfilters; i++)
+        if (c->filters[i]) {
+            free(c->filters[i]->varname);
+            if (c->filters[i]->IS_STR)
+                free(c->filters[i]->value.stringv);
+            free(c->filters[i]);
+        }
+    free(c->filters);
+    free(c);
+}
+
+/*
+ * copies the filters of the select, which the plan of the scan refers to
+ * across fetches
+ */
+static int copy_filters(Cursor *c, sqlselect *select) {
+    sqlfilter *f;
+    int i;
+
+    if (select->nfilters == 0)
+        return 1;
+    c->filters = (sqlfilter **)calloc(select->nfilters, sizeof(sqlfilter *));
+    if (! c->filters)
+        return 0;
+    c->nfilters = select->nfilters;
+    for (i = 0; i < c->nfilters; i++) {
+        if (! (f = (sqlfilter *)malloc(sizeof(sqlfilter))))
+            return 0;
+        *f = *(select->filters[i]);
+        c->filters[i] = f;
+        f->varname = strdup(f->varname);
+        if (f->IS_STR)
+            f->value.stringv = strdup(f->value.stringv);
+        if (! f->varname || (f->IS_STR && ! f->value.stringv))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * puts a cursor with more rows to return among the open cursors, closing
+ * the least recently used if there is no room
+ */
+static void keep(Cursor *c) {
+    RpcEndpoint *ep;
+    Cursor *old = NULL;
+    int i, k = 0;
+
+    if (! c->id && (ep = current_requester())) {
+        memcpy(&(c->owner), ep, sizeof(RpcEndpoint));
+        c->owned = 1;
+    }
+    pthread_mutex_lock(&lock);
+    if (! c->id)
+        c->id = ++lastid;
+    c->used = ++ticks;
+    for (i = 0; i < CURSOR_MAX && cursors[i]; i++)
+        if (cursors[i]->used < cursors[k]->used)
+            k = i;
+    if (i < CURSOR_MAX)
+        k = i;
+    else
+        old = cursors[k];
+    cursors[k] = c;
+    pthread_mutex_unlock(&lock);
+    if (old) {
+        debugf("Cursor: closing cursor %ld to make room\n", old->id);
+        free_cursor(old);
+    }
+}
+
+/*
+ * takes the open cursor with the id from among the open cursors, if it
+ * belongs to the endpoint of the request
+ *
+ * returns NULL if there is none
+ */
+static Cursor *take(long id) {
+    RpcEndpoint *ep = current_requester();
+    Cursor *c = NULL;
+    int i;
+
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < CURSOR_MAX; i++)
+        if (cursors[i] && cursors[i]->id == id) {
+            if (owned_by(cursors[i], ep)) {
+                c = cursors[i];
+                cursors[i] = NULL;
+            }
+            break;
+        }
+    pthread_mutex_unlock(&lock);
+    return c;
+}
+
+/*
+ * returns empty results with the columns of header
+ */
+static Rtab *new_chunk(Rtab *header) {
+    Rtab *chunk;
+    int c;
+
+    if (! (chunk = rtab_new()))
+        return NULL;
+    if (header->ncols > 0) {
+        chunk->colnames = (char **)malloc(header->ncols * sizeof(char *));
+        chunk->coltypes = (int **)malloc(header->ncols * sizeof(int *));
+        if (! chunk->colnames || ! chunk->coltypes) {
+            rtab_free(chunk);
+            return NULL;
+        }
+    }
+    for (c = 0; c < header->ncols; c++) {
+        if (! (chunk->colnames[c] = strdup(header->colnames[c]))) {
+            rtab_free(chunk);
+            return NULL;
+        }
+        chunk->coltypes[c] = header->coltypes[c];
+        chunk->ncols++;
+    }
+    return chunk;
+}
+
+/*
+ * fills chunk from the scan of the window, resuming after the last row
+ * returned
+ *
+ * returns 1 if there may be more rows, 0 if not, -1 if there is
+ * insufficient memory
+ */
+static int scan_chunk(Cursor *c, Rtab *chunk) {
+    SinkChunk ch;
+    Sink *sk;
+
+    ch.skip = c->skip;
+    ch.want = CURSOR_CHUNK_ROWS;
+    if (c->left >= 0 && c->left < ch.want)
+        ch.want = c->left;
+    ch.room = SOCK_RECV_BUF_LEN - rtab_packed_header(chunk) - 1;
+    ch.last = 0;
+    if (! (sk = sink_new_chunk(c->plan, chunk, &ch)))
+        return -1;
+    table_rdlock(c->table);
+    nodecrawler_scan_range(c->table, c->from, c->last, c->plan, sk);
+    table_unlock(c->table);
+    sink_finish(sk);
+    c->skip = ch.skip;
+    if (chunk->nrows > 0)
+        c->from = ch.last + 1;
+    if (c->left > 0)
+        c->left -= chunk->nrows;
+    return (ch.full && c->left != 0);
+}
+
+/*
+ * copies as many of the computed rows as fit into chunk
+ *
+ * returns 1 if there are more rows, 0 if not, -1 if there is
+ * insufficient memory
+ */
+static int take_rows(Cursor *c, Rtab *chunk) {
+    Rtab *r = c->results;
+    int room = SOCK_RECV_BUF_LEN - rtab_packed_header(chunk) - 1;
+    int k, len;
+
+    for (k = c->next; k < r->nrows && k - c->next < CURSOR_CHUNK_ROWS; k++) {
+        len = rtab_packed_row(r, r->rows[k]);
+        if (k > c->next && len > room)
+            break;
+        room -= len;
+    }
+    if (k > c->next) {
+        if (! (chunk->rows = (Rrow **)malloc((k - c->next) * sizeof(Rrow *))))
+            return -1;
+        for (; c->next < k; c->next++) {
+            if (! (chunk->rows[chunk->nrows] =
+                   rtab_copy_row(chunk, r->rows[c->next])))
+                return -1;
+            chunk->nrows++;
+        }
+    }
+    return (c->next < r->nrows);
+}
+
+/*
+ * returns the next chunk of the rows of a cursor, which is kept if there
+ * may be more, and closed if not
+ *
+ * returns NULL, closing the cursor, if there is insufficient memory
+ */
+static Rtab *next_chunk(Cursor *c) {
+    Rtab *chunk;
+    int more = -1;
+
+    if ((chunk = new_chunk(c->results)))
+        more = (c->table) ? scan_chunk(c, chunk) : take_rows(c, chunk);
+    if (more < 0) {
+        rtab_free(chunk);
+        free_cursor(c);
+        return NULL;
+    }
+    if (more) {
+        keep(c);
+        sprintf(chunk->msg, RTAB_MSG_CURSOR, c->id);
+    } else
+        free_cursor(c);
+    return chunk;
+}
+
+/*
+ * if *p starts with the keyword, moves *p past it and the white space
+ * after it, and returns 1
+ */
+static int keyword(char **p, char *word) {
+    int n = strlen(word);
+
+    if (strncasecmp(*p, word, n) != 0 || ((*p)[n] && ! isspace((int)(*p)[n])))
+        return 0;
+    for (*p += n; isspace((int)**p); (*p)++)
+        ;
+    return 1;
+}
+
+/*
+ * reads the id of a cursor, which must be all that is left of p apart
+ * from white space and a ;
+ */
+static int read_id(char *p, long *id) {
+    char *q;
+
+    *id = strtol(p, &q, 10);
+    if (q == p || *id <= 0)
+        return 0;
+    while (isspace((int)*q) || *q == ';')
+        q++;
+    return (*q == '\0');
+}
+
+int cursor_command(char *query, Rtab **results) {
+    char *p = query;
+    Cursor *c;
+    long id;
+    int fetch;
+
+    while (isspace((int)*p))
+        p++;
+    if (keyword(&p, "fetch"))
+        fetch = 1;
+    else if (keyword(&p, "close"))
+        fetch = 0;
+    else
+        return 0;
+    if (! read_id(p, &id)) {
+        errorf("CURSOR: expected FETCH id or CLOSE id\n");
+        *results = rtab_new_msg(RTAB_MSG_ERROR, NULL);
+    } else if (! (c = take(id))) {
+        errorf("CURSOR: no open cursor %ld\n", id);
+        *results = rtab_new_msg(RTAB_MSG_ERROR, NULL);
+    } else if (! fetch) {
+        free_cursor(c);
+        *results = rtab_new_msg(RTAB_MSG_SUCCESS, NULL);
+    } else if (! (*results = next_chunk(c)))
+        *results = rtab_new_msg(RTAB_MSG_ERROR, NULL);
+    return 1;
+}
+
+/*
+ * rows are stamped in strictly increasing order within a shard of the
+ * memory buffer, so a timestamp marks a place in the scan of a stream
+ * table that lives there; the rows of any other select are computed in
+ * full, since they have to be ordered, folded into aggregates, joined,
+ * or found by key
+ */
+int cursor_streams(Table *tn, sqlselect *select) {
+    return (select->ntables == 1 && select->njoins == 0 &&
+            select->groupby_ncols == 0 && ! select->isCountStar &&
+            ! select->containsMinMaxAvgSum && ! select->orderby &&
+            ! table_persistent(tn) && ! table_retained(tn));
+}
+
+Rtab *cursor_open(Table *tn, sqlselect *select) {
+    Nodecrawler *nc;
+    Cursor *c;
+
+    if (! (c = (Cursor *)calloc(1, sizeof(Cursor))))
+        return NULL;
+    c->table = tn;
+    c->skip = select->offset;
+    c->left = select->limit;
+    if (! copy_filters(c, select) || ! (c->results = rtab_new())) {
+        free_cursor(c);
+        return NULL;
+    }
+    table_rdlock(tn);
+    table_store_select_cols(tn, select, c->results);
+    table_extract_relevant_types(tn, c->results);
+    c->plan = plan_compile(tn, c->nfilters, c->filters, select->filtertype,
+                           c->results);
+    nc = nodecrawler_new_from_window(tn, select->windows[0]);
+    if (nc->empty) {
+        c->from = 1;
+        c->last = 0;
+    } else {
+        c->from = nc->first->tstamp;
+        c->last = nc->last->tstamp;
+    }
+    nodecrawler_free(nc);
+    table_unlock(tn);
+    if (! c->plan) {
+        free_cursor(c);
+        return NULL;
+    }
+    return next_chunk(c);
+}
+
+Rtab *cursor_results(Rtab *results) {
+    Cursor *c;
+    int r, n;
+
+    if (! results || results->nrows <= 0)
+        return results;
+    n = rtab_packed_header(results);
+    for (r = 0; r < results->nrows && n < SOCK_RECV_BUF_LEN; r++)
+        n += rtab_packed_row(results, results->rows[r]);
+    if (n < SOCK_RECV_BUF_LEN)
+        return results;
+    if (! (c = (Cursor *)calloc(1, sizeof(Cursor))))
+        return results;			/* as much as fits is returned */
+    c->results = results;
+    return next_chunk(c);
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * cursor.h - results of a select handed out a chunk at a time
+ *
+ * a response holds at most SOCK_RECV_BUF_LEN bytes.  When the rows of a
+ * select do not fit, a cursor is opened on them, and the response holds
+ * the first chunk of rows, with RTAB_MSG_CURSOR as its status message;
+ * FETCH id returns the next chunk, in the same way, until the last
+ * chunk, which has the usual status message and closes the cursor.
+ * CLOSE id closes a cursor that is no longer wanted.
+ *
+ * a plain select from a stream table in the memory buffer is run a chunk
+ * at a time: each FETCH resumes the scan of the window, as it was when
+ * the select was run, after the last row returned, so the rows are never
+ * all built at once.  Rows that are evicted from the buffer before they
+ * have been fetched are not returned.  The rows of any other select are
+ * computed in full when it is run, then handed out a chunk at a time.
+ *
+ * at most CURSOR_MAX cursors are open at once; the least recently used
+ * is closed to make room for another
+ *
+ * a cursor belongs to the endpoint whose select opened it, as set for
+ * the thread by cursor_requester(); FETCH and CLOSE from any other
+ * endpoint are refused as if the cursor were not open
+ */
+#ifndef _CURSOR_H_
+#define _CURSOR_H_
+
+#include "table.h"
+#include "rtab.h"
+#include "sqlstmts.h"
+
+#define CURSOR_MAX 64
+#define CURSOR_CHUNK_ROWS 4096		/* most rows in a chunk */
+
+/*
+ * sets the endpoint of the requests that the calling thread runs until
+ * it is set again, NULL if they do not come over RPC; ep must outlive
+ * them
+ */
+void cursor_requester(RpcEndpoint *ep);
+
+/*
+ * runs query if it is FETCH id or CLOSE id, leaving the response in
+ * *results
+ *
+ * returns 0 if query is neither
+ */
+int cursor_command(char *query, Rtab **results);
+
+/*
+ * returns 1 if the select, which has been checked against the table, can
+ * be run a chunk at a time by cursor_open()
+ */
+int cursor_streams(Table *tn, sqlselect *select);
+
+/*
+ * returns the first chunk of the rows of the select, opening a cursor on
+ * the rest, if any
+ *
+ * returns NULL if there is insufficient memory
+ */
+Rtab *cursor_open(Table *tn, sqlselect *select);
+
+/*
+ * returns results, if they fit in a response, or else the first chunk of
+ * them, opening a cursor on the rest, which takes results over
+ */
+Rtab *cursor_results(Rtab *results);
+
+#endif /* _CURSOR_H_ */
@@ -42,13 +42,44 @@
 #include <pthread.h>
 #include <stdlib.h>
 
+/*
+ * an event, its data, the name of its topic and the text of any string
+ * columns are allocated as one block, which is shared, read-only, by all
+ * of the automata that the event is published to
+ */
 struct event {
     int refCount, ncols;
-    char *data;
     char *topic;
     DataStackEntry *theData;
 };
 
+/*
+ * converts the text of a value of the given type into d; a string is
+ * left in situ, to be duplicated by whoever keeps it
+ */
+static void set_value(DataStackEntry *d, int type, char *p) {
+    d->type = type;
+    d->flags = 0;		      /* no flags set */
+    switch(type) {
+    case dBOOLEAN:
+        d->value.bool_v = atoi(p);
+        break;
+    case dINTEGER:
+        d->value.int_v = atoll(p);
+        break;
+    case dDOUBLE:
+        d->value.dbl_v = atof(p);
+        break;
+    case dSTRING:
+        d->value.str_v = p;
+        d->flags |= DUPLICATE;  /* strings will have to be duplicated */
+        break;
+    case dTSTAMP:
+        d->value.tstamp_v = string_to_timestamp(p);
+        break;
+    }
+}
+
 /*
  * `sd' is expected in the following format:
  *
@@ -73,57 +104,78 @@ static void unpack(char *sd, int n, SchemaCell *schema, DataStackEntry *d) {
             *q = '\0';
             q += 3;
         }
-        d[i].type = schema[i].type;
-        d[i].flags = 0;		      /* no flags set */
-        switch(schema[i].type) {
-        case dBOOLEAN:
-            d[i].value.bool_v = atoi(p);
-            break;
-        case dINTEGER:
-            d[i].value.int_v = atoll(p);
-            break;
-        case dDOUBLE:
-            d[i].value.dbl_v = atof(p);
-            break;
-        case dSTRING:
-            d[i].value.str_v = p;
-            d[i].flags |= DUPLICATE;  /* strings will have to be duplicated */
-            break;
-        case dTSTAMP:
-            d[i].value.tstamp_v = string_to_timestamp(p);
-            break;
-        }
+        set_value(&d[i], schema[i].type, p);
     }
 }
 
+/*
+ * allocates an event with ncols columns and extra bytes for their text,
+ * which is returned in *text
+ */
+static Event *ev_alloc(char *name, int ncols, size_t extra, char **text) {
+    size_t len = strlen(name) + 1;
+    Event *t;
+
+    t = (Event *)malloc(sizeof(Event) + ncols * sizeof(DataStackEntry) +
+                        len + extra);
+    if (t) {
+        t->ncols = ncols;
+        t->theData = (DataStackEntry *)(t + 1);
+        t->topic = (char *)(t->theData + ncols);
+        memcpy(t->topic, name, len);
+        *text = t->topic + len;
+    }
+    return t;
+}
+
 Event *ev_create(char *name, char *eventData, unsigned long nAUs) {
-    int ncols;
-    SchemaCell *schema;
-    DataStackEntry *d;
+    int ncols = 0;
+    SchemaCell *schema = NULL;
+    char *data;
+    Event *t;
 
-    Event *t = (Event *)malloc(sizeof(Event));
+    (void) top_schema(name, &ncols, &schema);
+    t = ev_alloc(name, ncols, strlen(eventData) + 1, &data);
     if (t) {
-        t->data = strdup(eventData);
-        if (t->data) {
-            t->topic = strdup(name);
-            if (t->topic) {
-                t->refCount = nAUs;
-                (void) top_schema(name, &ncols, &schema);
-                d = (DataStackEntry *)malloc(ncols * sizeof(DataStackEntry));
-                if (d) {
-                    //printf("%p %d - created\n", t, t->refCount); fflush(stdout);
-                    unpack(t->data, ncols, schema, d);
-                    t->ncols = ncols;
-                    t->theData = d;
-                    return t;
-                }
-                free((void *)(t->topic));
-            }
-            free((void *)(t->data));
+        //printf("%p %d - created\n", t, t->refCount); fflush(stdout);
+        strcpy(data, eventData);
+        t->refCount = nAUs;
+        unpack(data, ncols, schema, t->theData);
+    }
+    return t;
+}
+
+Event *ev_create_row(char *name, int ncols, SchemaCell *schema,
+                     tstamp_t ts, char *vals[], unsigned long nAUs) {
+    size_t extra = 0, len;
+    DataStackEntry *d;
+    char *p;
+    Event *t;
+    int i;
+
+    for (i = 1; i < ncols; i++)
+        if (schema[i].type == dSTRING)
+            extra += strlen(vals[i - 1]) + 1;
+    if (! (t = ev_alloc(name, ncols, extra, &p)))
+        return NULL;
+    t->refCount = nAUs;
+    d = t->theData;
+    if (ncols > 0) {
+        d[0].type = dTSTAMP;
+        d[0].flags = 0;
+        d[0].value.tstamp_v = ts;
+    }
+    for (i = 1; i < ncols; i++) {
+        if (schema[i].type != dSTRING) {
+            set_value(&d[i], schema[i].type, vals[i - 1]);
+            continue;
         }
-        free((void *)t);
+        len = strlen(vals[i - 1]) + 1;
+        memcpy(p, vals[i - 1], len);
+        set_value(&d[i], dSTRING, p);
+        p += len;
     }
-    return NULL;
+    return t;
 }
 
 static pthread_mutex_t ev_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -145,18 +197,11 @@ void ev_release(Event *event) {
     //printf("%p %d\n", event, event->refCount); fflush(stdout);
     if (event->refCount == 0) {
         //printf("%p - freeing\n", event);
-        free((void *)event->data);
-        free((void *)event->topic);
-        free((void *)event->theData);
         free((void *)event);
     }
     pthread_mutex_unlock(&ev_mutex);
 }
 
-char *ev_data(Event *event) {
-    return event->data;
-}
-
 char *ev_topic(Event *event) {
     return event->topic;
 }
@@ -32,13 +32,22 @@
  */
 
 #include "dataStackEntry.h"
+#include "timestamp.h"
 
 typedef struct event Event;
 
+struct schemaCell;
+
 Event *ev_create(char *name, char *eventData, unsigned long nAUs);
+/*
+ * creates the event for a row inserted into the topic of a table, whose
+ * schema has ncols cells: the timestamp of the row, then one for each of
+ * vals; the values are converted straight into the data of the event
+ */
+Event *ev_create_row(char *name, int ncols, struct schemaCell *schema,
+                     tstamp_t ts, char *vals[], unsigned long nAUs);
 Event *ev_reference(Event *event);
 void  ev_release(Event *event);
-char  *ev_data(Event *event);
 char  *ev_topic(Event *event);
 int   ev_theData(Event *event, DataStackEntry **dse);
 void  ev_dump(Event *event);
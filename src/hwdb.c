@@ -43,6 +43,8 @@
 #include "rtab.h"
 #include "sqlstmts.h"
 #include "parser.h"
+#include "pstmt.h"
+#include "cursor.h"
 #include "indextable.h"
 #include "table.h"
 #include "adts/hashmap.h"
@@ -52,6 +54,7 @@
 #include "automaton.h"
 #include "topic.h"
 #include "node.h"
+#include "tuple.h"
 #include "logdefs.h"
 
 #include <stdlib.h>
@@ -72,17 +75,20 @@ static TSUQueue *cleanQ;
 static pthread_t pubthr[NUM_THREADS];
 #endif /* HWDB_PUBLISH_IN_BACKGROUND */
 
-/* Used by sql parser */
-sqlstmt stmt;
-
 /*
  * forward declarations for functions in this file
  */
-Rtab *hwdb_exec_stmt(int isreadonly);
+Rtab *hwdb_exec_stmt(sqlstmt *st, int isreadonly);
+Rtab *hwdb_run_stmt(sqlstmt *st, int isreadonly);
+static tstamp_t insert_row(Table *tn, sqlinsert *insert);
+Rtab *hwdb_execute(sqlexecute *exec, int isreadonly);
 Rtab *hwdb_select(sqlselect *select);
 Rtab *hwdb_table_meta(char *tablename);
 int hwdb_create(sqlcreate *create);
+int hwdb_create_index(sqlindex *index);
 tstamp_t hwdb_insert(sqlinsert *insert);
+int hwdb_insert_batch(char *tablename, int nrows, sqlinsert rows[],
+                      tstamp_t ts[]);
 Rtab *hwdb_showtables(void);
 int hwdb_register(sqlregister *regist);
 int hwdb_unregister(sqlunregister *unregist);
@@ -94,14 +100,51 @@ int hwdb_send_event(Automaton *au, char *buf, int ifdisconnect);
 void *do_publish(void *args);
 #endif /* HWDB_PUBLISH_IN_BACKGROUND */
 
-int hwdb_init(int usesRPC) {
+/*
+ * callback from mb_restore_tables() for each stream table that survived
+ * a restart
+ */
+static void restore_table(char *name, Table *tn) {
+    if (itab_restore_table(itab, name, tn))
+        tn->restored = 1;
+}
+
+/* set while hwdb_exec_config() runs, before any worker is started */
+static int configuring = 0;
+
+/*
+ * returns 1 if st is replayed from the configuration file, and creates,
+ * or inserts into, a stream table restored from the memory buffer file
+ */
+static int restored_target(sqlstmt *st) {
+    Table *tn;
+    char *name;
+
+    if (! configuring)
+        return 0;
+    if (st->type == SQL_TYPE_CREATE)
+        name = st->sql.create.tablename;
+    else if (st->type == SQL_TYPE_INSERT)
+        name = st->sql.insert.tablename;
+    else
+        return 0;
+    return ((tn = itab_table_lookup(itab, name)) && tn->restored);
+}
+
+int hwdb_init(int usesRPC, MBConfig *mbc) {
+    int n;
 
     progname = "cache";
     ifUsesRpc = usesRPC;
-    mb_init();
+    if (! mb_init(mbc))
+        return 0;
     itab = itab_new();
     top_init();			/* initialize the topic system */
+    pstmt_init();		/* initialize the statement cache */
     au_init();			/* initialize the automaton system */
+    n = mb_restore_tables(restore_table);	/* tables kept from last run */
+    if (n)
+        debugf("%d stream tables restored from memory buffer file\n", n);
 #ifdef HWDB_PUBLISH_IN_BACKGROUND
     int i;
     workQ = tsuq_create();
@@ -129,62 +172,153 @@ static void do_cleanup(void) {
 }
 #endif /* HWDB_PUBLISH_IN_BACKGROUND */
 
+/*
+ * returns the results of query if it is one of the commands that are not
+ * parsed as SQL, and NULL if not
+ */
+static Rtab *command(char *query) {
+    Rtab *results;
+    int ok;
+
+    if (pstmt_command(query, &ok))	/* PREPARE or DEALLOCATE */
+        return rtab_new_msg((ok) ? RTAB_MSG_SUCCESS : RTAB_MSG_ERROR, NULL);
+    if (cursor_command(query, &results))	/* FETCH or CLOSE */
+        return results;
+    return NULL;
+}
+
+/*
+ * runs a statement held from the cache, then releases it
+ */
+static Rtab *run_cached(PStmt *ps, int isreadonly) {
+    Rtab *results;
+
+    results = hwdb_run_stmt(ps->stmt, isreadonly);
+    pstmt_release(ps);
+    return results;
+}
+
+/*
+ * runs st, just parsed from query, adding it to the cache if it is a
+ * select, and freeing it if not
+ */
+static Rtab *run_parsed(char *query, sqlstmt *st, int isreadonly) {
+    PStmt *ps;
+
+#ifdef VDEBUG
+    sql_print(st);
+#endif /* VDEBUG */
+    if (! (ps = pstmt_cache(query, st)))
+        return hwdb_exec_stmt(st, isreadonly);
+    return run_cached(ps, isreadonly);
+}
+
 Rtab *hwdb_exec_query(char *query, int isreadonly) {
-    void *result;
+    sqlstmt *st;
+    Rtab *results;
+    PStmt *ps;
 #ifdef HWDB_PUBLISH_IN_BACKGROUND
     do_cleanup();
 #endif /* HWDB_PUBLISH_IN_BACKGROUND */
-    result = sql_parse(query);
-#ifdef VDEBUG
-    sql_print();
-#endif /* VDEBUG */
-    if (! result)
+    if ((results = command(query)))
+        return results;
+    /* a select is parsed once, then run from the cache */
+    if ((ps = pstmt_cached(query)))
+        return run_cached(ps, isreadonly);
+    if (! (st = sql_parse(query)))
         return  rtab_new_msg(RTAB_MSG_ERROR, NULL);
+    return run_parsed(query, st, isreadonly);
+}
 
-    return hwdb_exec_stmt(isreadonly);
+/*
+ * runs a statement of the configuration file; on a warm restart, the
+ * CREATEs of the stream tables restored from the memory buffer file, and
+ * the INSERTs into them, are skipped, as their rows are already there;
+ * all other statements, including those for persistent tables and
+ * indexes, which are not kept, are run as usual
+ */
+Rtab *hwdb_exec_config(char *query, int isreadonly) {
+    Rtab *results;
+
+    configuring = 1;
+    results = hwdb_exec_query(query, isreadonly);
+    configuring = 0;
+    return results;
 }
 
-Rtab *hwdb_exec_stmt(int isreadonly) {
+/*
+ * runs a statement returned by sql_parse(), then frees it
+ */
+Rtab *hwdb_exec_stmt(sqlstmt *st, int isreadonly) {
+    Rtab *results;
+
+    if (pstmt_nparams(st) > 0) {
+        errorf("HWDB: placeholders are only allowed in prepared statements\n");
+        results = rtab_new_msg(RTAB_MSG_PARSING_FAILED, NULL);
+    } else
+        results = hwdb_run_stmt(st, isreadonly);
+    sql_free_stmt(st);
+    return results;
+}
+
+/*
+ * returns the response to an insert that returned ts, 0 if it failed
+ */
+static Rtab *inserted(tstamp_t ts) {
+    char buf[20];
+    char *s;
+
+    if (! ts)
+        return rtab_new_msg(RTAB_MSG_INSERT_FAILED, NULL);
+    if (! (s = timestamp_to_string(ts)))
+        return rtab_new_msg(RTAB_MSG_SUCCESS, NULL);
+    strcpy(buf, s);
+    free(s);
+    return rtab_new_msg(RTAB_MSG_SUCCESS, buf);
+}
+
+Rtab *hwdb_run_stmt(sqlstmt *st, int isreadonly) {
     Rtab *results = NULL;
 
-    switch (stmt.type) {
+    if (restored_target(st)) {
+        debugf("HWDB: table restored, statement skipped\n");
+        return rtab_new_msg(RTAB_MSG_SUCCESS, NULL);
+    }
+    switch (st->type) {
     case SQL_TABLE_META:
-        results = hwdb_table_meta(stmt.sql.meta.table);
+        results = hwdb_table_meta(st->sql.meta.table);
         break;
     case SQL_TYPE_SELECT:
-        results = hwdb_select(&stmt.sql.select);
+        results = hwdb_select(&st->sql.select);
         if (!results)
             results = rtab_new_msg(RTAB_MSG_SELECT_FAILED, NULL);
         break;
     case SQL_TYPE_CREATE:
-        if (isreadonly || !hwdb_create(&stmt.sql.create)) {
+        if (isreadonly || !hwdb_create(&st->sql.create)) {
             results = rtab_new_msg(RTAB_MSG_CREATE_FAILED, NULL);
         } else {
             results = rtab_new_msg(RTAB_MSG_SUCCESS, NULL);
         }
         break;
-    case SQL_TYPE_INSERT: {
-        tstamp_t ts;
-        if (isreadonly || !(ts = hwdb_insert(&stmt.sql.insert))) {
-            results = rtab_new_msg(RTAB_MSG_INSERT_FAILED, NULL);
+    case SQL_TYPE_INDEX:
+        if (isreadonly || !hwdb_create_index(&st->sql.index)) {
+            results = rtab_new_msg(RTAB_MSG_CREATE_FAILED, NULL);
         } else {
-            static char buf[20];
-            char *s = timestamp_to_string(ts);
-            strcpy(buf, s);
-            free(s);
-            results = rtab_new_msg(RTAB_MSG_SUCCESS, buf);
+            results = rtab_new_msg(RTAB_MSG_SUCCESS, NULL);
         }
         break;
-    }
+    case SQL_TYPE_INSERT:
+        results = inserted((isreadonly) ? 0 : hwdb_insert(&st->sql.insert));
+        break;
     case SQL_TYPE_DELETE:
-        if (isreadonly || !hwdb_delete(&stmt.sql.delete)) {
+        if (isreadonly || !hwdb_delete(&st->sql.delete)) {
             results = rtab_new_msg(RTAB_MSG_DELETE_FAILED, NULL);
         } else {
             results = rtab_new_msg(RTAB_MSG_SUCCESS, NULL);
         }
         break;
     case SQL_TYPE_UPDATE:
-        if (isreadonly || !hwdb_update(&stmt.sql.update)) {
+        if (isreadonly || !hwdb_update(&st->sql.update)) {
             results = rtab_new_msg(RTAB_MSG_UPDATE_FAILED, NULL);
         } else {
             results = rtab_new_msg(RTAB_MSG_SUCCESS, NULL);
@@ -195,38 +329,80 @@ Rtab *hwdb_exec_stmt(int isreadonly) {
         break;
     case SQL_TYPE_REGISTER: {
         int v;
-        if (isreadonly || !(v = hwdb_register(&stmt.sql.regist))) {
+        if (isreadonly || !(v = hwdb_register(&st->sql.regist))) {
             results = rtab_new_msg(RTAB_MSG_REGISTER_FAILED, NULL);
         } else {
-            static char buf[20];
+            char buf[20];
             sprintf(buf, "%d", v);
             results = rtab_new_msg(RTAB_MSG_SUCCESS, buf);
         }
         break;
     }
     case SQL_TYPE_UNREGISTER:
-        if (isreadonly ||  !hwdb_unregister(&stmt.sql.unregist)) {
+        if (isreadonly ||  !hwdb_unregister(&st->sql.unregist)) {
             results = rtab_new_msg(RTAB_MSG_UNREGISTER_FAILED, NULL);
         } else {
             results = rtab_new_msg(RTAB_MSG_SUCCESS, NULL);
         }
         break;
+    case SQL_TYPE_EXECUTE:
+        results = hwdb_execute(&st->sql.execute, isreadonly);
+        break;
     default:
         errorf("Error parsing query\n");
         results = rtab_new_msg(RTAB_MSG_PARSING_FAILED, NULL);
         break;
     }
-    reset_statement();
     return results;
 }
 
+/*
+ * runs a prepared statement, its placeholders bound to the values of exec
+ */
+Rtab *hwdb_execute(sqlexecute *exec, int isreadonly) {
+    Rtab *results;
+    PStmt *ps;
+    sqlstmt st;
+
+    debugf("HWDB: Executing prepared statement %s\n", exec->name);
+    if (! (ps = pstmt_lookup(exec->name))) {
+        errorf("HWDB: no prepared statement %s\n", exec->name);
+        return rtab_new_msg(RTAB_MSG_ERROR, NULL);
+    }
+    if (pstmt_bind(ps, exec, &st)) {
+        if (ps->table && ! isreadonly && ! restored_target(&st)) {
+            debugf("Executing INSERT into %s:\n", st.sql.insert.tablename);
+            results = inserted(insert_row(ps->table, &st.sql.insert));
+        } else
+            results = hwdb_run_stmt(&st, isreadonly);
+        pstmt_unbind(ps, &st);
+    } else
+        results = rtab_new_msg(RTAB_MSG_ERROR, NULL);
+    pstmt_release(ps);
+    return results;
+}
+
+/*
+ * when serving RPC, results that do not fit in a response are returned a
+ * chunk at a time through a cursor, see cursor.h
+ */
 Rtab *hwdb_select(sqlselect *select) {
     Rtab *results;
     char *tablename;
+    Table *tn;
 
     debugf("HWDB: Executing SELECT:\n");
 
-    /* Only 1 table supported for now */
+    /* Two tables are joined on a condition between them */
+    if (select->ntables > 1 || select->njoins > 0) {
+        if (select->ntables != 2) {
+            errorf("HWDB: only joins of two tables are supported\n");
+            return NULL;
+        }
+        results = itab_build_join_results(itab, select);
+        return (ifUsesRpc) ? cursor_results(results) : results;
+    }
+
     tablename = select->tables[0];
 
     /* Check table exists */
@@ -247,9 +423,13 @@ Rtab *hwdb_select(sqlselect *select) {
         return NULL;
     }
 
+    tn = itab_table_lookup(itab, tablename);
+    if (ifUsesRpc && cursor_streams(tn, select))
+        return cursor_open(tn, select);
+
     results = itab_build_results(itab, tablename, select);
 
-    return results;
+    return (ifUsesRpc) ? cursor_results(results) : results;
 }
 
 int hwdb_update(sqlupdate *update) {
@@ -285,18 +465,15 @@ int  hwdb_create(sqlcreate *create) {
 
     return itab_create_table(itab, create->tablename, create->ncols,
                              create->colname, create->coltype,
-                             create->tabletype, create->primary_column);
+                             create->tabletype, create->primary_column,
+                             create->retain, create->retain_limit);
 }
 
-static void gen_tuple_string(Table *t, int ncols, char **colvals, char *out) {
-    char *p = out;
-    char *ts = timestamp_to_string(t->newest->tstamp);
-    int i;
-    p += sprintf(p, "%s<|>", ts);
-    free(ts);
-    for (i = 0; i < ncols; i++) {
-        p += sprintf(p, "%s<|>", colvals[i]);
-    }
+int hwdb_create_index(sqlindex *index) {
+    debugf("Executing CREATE INDEX:\n");
+
+    return itab_create_index(itab, index->name, index->tablename,
+                             index->colname, index->kind);
 }
 
 Rtab *hwdb_table_meta(char *tablename) {
@@ -326,21 +503,62 @@ Rtab *hwdb_table_meta(char *tablename) {
     results->coltypes[2] = PRIMTYPE_VARCHAR;
     results->rows = (Rrow **)malloc(results->nrows * sizeof(Rrow *));
     for (i = 0; i < results->nrows; i++) {
-        row = (Rrow *)malloc(sizeof(Rrow));
+        row = rtab_new_row(results);
         results->rows[i] = row;
-        row->cols = (char **)malloc(3 * sizeof(char *));
-        row->cols[0] = strdup(tn->colname[i]);
-        row->cols[1] = strdup(primtype_name[*(tn->coltype[i])]);
-        row->cols[2] = (i == tn->primary_column) ? strdup("yes") : strdup("");
+        row->cols[0] = rtab_strdup(results, tn->colname[i]);
+        row->cols[1] = rtab_strdup(results, (char *)primtype_name[*(tn->coltype[i])]);
+        row->cols[2] = rtab_strdup(results, (i == tn->primary_column) ? "yes" : "");
     }
     return results;
 }
 
+/*
+ * inserts into tn, which the columns of insert have been checked to fit
+ */
+static tstamp_t insert_row(Table *tn, sqlinsert *insert) {
+    tstamp_t ts;
+    int held;
+
+    /* allocate space for tuple, copy values into tuple, thread new
+     * node to end of table; a persistent table checks the values
+     * against its primary key as it does so */
+    held = top_hold(tn->topic);
+    if ( table_persistent(tn) ) {
+        ts = heap_insert_tuple(insert->ncols, insert->colval, tn,
+                               insert->transform);
+    } else {
+        ts = mb_insert_tuple(insert->ncols, insert->colval, tn);
+    }
+    if (held) {
+        if (ts)
+            top_publish_row(tn->topic, ts, insert->colval);
+        top_release(tn->topic);
+    }
+    if (! ts)
+        return (tstamp_t)0;
+    /* Tuple sanity check */
+#ifdef DEBUG
+#ifdef VDEBUG
+    {
+        int i;
+        char b[TUPLE_TEXT_LEN];
+        debugvf("SANITY> tuple key: %s\n",insert->tablename);
+        for (i=0; i < insert->ncols; i++) {
+            debugvf("SANITY> colval[%d] = %s\n", i,
+                    tuple_text(tn->newest->tuple, i, tn->coltype[i], b));
+        }
+    }
+#endif /* VDEBUG */
+#endif /* DEBUG */
+
+    /* Notify all subscribers */
+    //hwdb_publish(insert->tablename);
+
+    return ts;
+}
+
 tstamp_t  hwdb_insert(sqlinsert *insert) {
     Table *tn;
-    char buf[2048];
-    Node *n;
-    tstamp_t ts;
 
     debugf("Executing INSERT:\n");
 
@@ -355,45 +573,190 @@ tstamp_t  hwdb_insert(sqlinsert *insert) {
         errorf("Insert not compatible with table\n");
         return (tstamp_t)0;
     }
+    return insert_row(tn, insert);
+}
 
-    /* Check values don't violate primary key constraint */
-    if ((n = itab_is_constrained(itab, insert->tablename,
-                                 insert->colval))) {
-        debugf("Transformation %d\n", insert->transform);
-        if (! insert->transform) {
-            errorf("Insert violates primary key\n");
-            return (tstamp_t)0;
-        }
+/*
+ * report usage of the memory buffer and of each table
+ */
+void hwdb_dump(void) {
+    mb_dump();
+    itab_dump(itab);
+}
+
+/*
+ * hwdb_insert_batch() - insert nrows rows into a single table
+ *
+ * the table is looked up once and each row is checked against its
+ * schema; rows into a stream table are then stored with one call to
+ * mb_insert_tuples() and published to subscribers as one batch, in
+ * timestamp order with the rows of other inserts, see top_hold()
+ *
+ * ts[i] is set to the timestamp of row i, or to 0 if it was rejected
+ *
+ * returns the number of rows inserted
+ */
+int hwdb_insert_batch(char *tablename, int nrows, sqlinsert rows[],
+                      tstamp_t ts[]) {
+    Table *tn;
+    char ***vals;
+    int *idx;
+    tstamp_t *okts;
+    int i, nok, held, n = 0;
+
+    debugf("Executing INSERT batch of %d rows:\n", nrows);
+
+    for (i = 0; i < nrows; i++)
+        ts[i] = (tstamp_t)0;
+    if (! (tn = itab_table_lookup(itab, tablename))) {
+        errorf("Insert table name does not exist\n");
+        return 0;
     }
 
-    /* allocate space for tuple, copy values into tuple, thread new
-     * node to end of table */
-    if ( table_persistent(tn) ) {
-        ts = heap_insert_tuple(insert->ncols, insert->colval, tn, n);
-    } else {
-        ts = mb_insert_tuple(insert->ncols, insert->colval, tn);
+    /* persistent tables must check each row against the primary key */
+    if (table_persistent(tn)) {
+        for (i = 0; i < nrows; i++)
+            if ((ts[i] = hwdb_insert(&rows[i])))
+                n++;
+        return n;
     }
-    gen_tuple_string(tn, insert->ncols, insert->colval, buf);
-    top_publish(insert->tablename, buf);
-    /* Tuple sanity check */
-#ifdef DEBUG
-#ifdef VDEBUG
-    {
-        int i;
-        union Tuple *p;
-        debugvf("SANITY> tuple key: %s\n",insert->tablename);
-        p = (union Tuple *)(tn->newest->tuple);
-        for (i=0; i < insert->ncols; i++) {
-            debugvf("SANITY> colval[%d] = %s\n", i, p->ptrs[i]);
+
+    vals = (char ***)malloc(nrows * sizeof(char **));
+    idx = (int *)malloc(nrows * sizeof(int));
+    okts = (tstamp_t *)malloc(nrows * sizeof(tstamp_t));
+    if (vals && idx && okts) {
+        for (i = 0, nok = 0; i < nrows; i++) {
+            if (! table_compatible(tn, rows[i].ncols, rows[i].coltype)) {
+                errorf("Insert not compatible with table\n");
+                continue;
+            }
+            vals[nok] = rows[i].colval;
+            idx[nok++] = i;
         }
+        held = (nok) ? top_hold(tn->topic) : 0;
+        if (nok && mb_insert_tuples(nok, tn->ncols, vals, tn, okts)) {
+            for (i = 0; i < nok; i++)
+                ts[idx[i]] = okts[i];
+            if (held)
+                top_publish_rows(tn->topic, nok, okts, vals);
+            n = nok;
+        }
+        if (held)
+            top_release(tn->topic);
+    } else {
+        errorf("Out of memory for insert batch\n");
     }
-#endif /* VDEBUG */
-#endif /* DEBUG */
+    free(vals);
+    free(idx);
+    free(okts);
+    return n;
+}
 
-    /* Notify all subscribers */
-    //hwdb_publish(insert->tablename);
+/*
+ * insert the rows collected by hwdb_exec_bulk(), record the result for
+ * each of them, and free them
+ */
+static void flush_batch(int nb, sqlinsert batch[], int which[], tstamp_t ts[],
+                        Rtab *results[]) {
+    char *s;
+    int i;
 
-    return ts;
+    if (! nb)
+        return;
+    (void) hwdb_insert_batch(batch[0].tablename, nb, batch, ts);
+    for (i = 0; i < nb; i++) {
+        if (ts[i]) {
+            s = timestamp_to_string(ts[i]);
+            results[which[i]] = rtab_new_msg(RTAB_MSG_SUCCESS, s);
+            free(s);
+        } else
+            results[which[i]] = rtab_new_msg(RTAB_MSG_INSERT_FAILED, NULL);
+        sql_free_insert(&batch[i]);
+    }
+}
+
+/*
+ * returns the insert that st adds to a batch: the insert itself, or a
+ * prepared insert bound into *bound
+ *
+ * returns NULL if it is neither
+ */
+static sqlinsert *bulk_insert(sqlstmt *st, sqlstmt *bound) {
+    PStmt *ps;
+    sqlinsert *insert = NULL;
+
+    if (st->type == SQL_TYPE_INSERT)
+        return &(st->sql.insert);
+    if (st->type != SQL_TYPE_EXECUTE ||
+            ! (ps = pstmt_lookup(st->sql.execute.name)))
+        return NULL;
+    if (ps->stmt->type == SQL_TYPE_INSERT &&
+            pstmt_bind(ps, &(st->sql.execute), bound))
+        insert = &(bound->sql.insert);
+    pstmt_release(ps);
+    return insert;
+}
+
+/*
+ * hwdb_exec_bulk() - execute the n queries of a BULK request, leaving
+ * the result of queries[i] in results[i]
+ *
+ * each query is run as by hwdb_exec_query(), except that runs of
+ * consecutive inserts into the same table, whether written out or
+ * prepared, are collected and applied with a single call to
+ * hwdb_insert_batch(); any other statement ends the run, so the queries
+ * take effect in order
+ */
+void hwdb_exec_bulk(int n, char *queries[], int isreadonly, Rtab *results[]) {
+    sqlinsert *batch, *insert;
+    sqlstmt *st, bound;
+    tstamp_t *ts;
+    PStmt *ps;
+    int *which;
+    int i, nb = 0;
+
+#ifdef HWDB_PUBLISH_IN_BACKGROUND
+    do_cleanup();
+#endif /* HWDB_PUBLISH_IN_BACKGROUND */
+    batch = (sqlinsert *)malloc(n * sizeof(sqlinsert));
+    ts = (tstamp_t *)malloc(n * sizeof(tstamp_t));
+    which = (int *)malloc(n * sizeof(int));
+    for (i = 0; i < n; i++) {
+        /* commands leave the rows alone, so need not end a run */
+        if ((results[i] = command(queries[i])))
+            continue;
+        if ((ps = pstmt_cached(queries[i]))) {
+            flush_batch(nb, batch, which, ts, results);
+            nb = 0;
+            results[i] = run_cached(ps, isreadonly);
+            continue;
+        }
+        if (! (st = sql_parse(queries[i]))) {
+            results[i] = rtab_new_msg(RTAB_MSG_ERROR, NULL);
+            continue;
+        }
+        if (! isreadonly && batch && ts && which
+                && pstmt_nparams(st) == 0
+                && (insert = bulk_insert(st, &bound))) {
+            if (nb && strcmp(batch[0].tablename, insert->tablename)) {
+                flush_batch(nb, batch, which, ts, results);
+                nb = 0;
+            }
+            batch[nb] = *insert;	/* take over the statement */
+            which[nb++] = i;
+            insert->tablename = NULL;
+            insert->ncols = 0;
+            sql_free_stmt(st);
+            continue;
+        }
+        flush_batch(nb, batch, which, ts, results);
+        nb = 0;
+        results[i] = run_parsed(queries[i], st, isreadonly);
+    }
+    flush_batch(nb, batch, which, ts, results);
+    free(batch);
+    free(ts);
+    free(which);
 }
 
 Rtab *hwdb_showtables(void) {
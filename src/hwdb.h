@@ -38,6 +38,7 @@
 #include "table.h"
 #include "automaton.h"
 #include "sqlstmts.h"
+#include "mb.h"
 
 #define SUBSCRIPTION 1
 #define REGISTRATION 2
@@ -51,11 +52,14 @@ typedef struct callBackInfo {
     } u;
 } CallBackInfo;
 
-int hwdb_init(int usesRPC);
+int hwdb_init(int usesRPC, MBConfig *mbc);
 Rtab *hwdb_exec_query(char *query, int isreadonly);
+Rtab *hwdb_exec_config(char *query, int isreadonly);
 int hwdb_send_event(Automaton *au, char *buf, int ifdisconnect);
 Table *hwdb_table_lookup(char *name);
 void hwdb_queue_cleanup(CallBackInfo *info);
 tstamp_t hwdb_insert(sqlinsert *insert);
+void hwdb_exec_bulk(int n, char *queries[], int isreadonly, Rtab *results[]);
+void hwdb_dump(void);
 
 #endif /* _HWDB_H_ */
@@ -43,8 +43,13 @@
 #include "pubsub.h"
 #include "topic.h"
 #include "ptable.h"
+#include "mb.h"
+#include "plan.h"
+#include "sink.h"
+#include "join.h"
 
 #include <pthread.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -67,7 +72,7 @@ Indextable *itab_new(void) {
     return itab;
 }
 
-static int create_topic(char *tn, int nc, char **cnames, int **ctypes) {
+static Topic *create_topic(char *tn, int nc, char **cnames, int **ctypes) {
     char buf[2048], *p;
     int i;
     p = buf;
@@ -79,7 +84,8 @@ static int create_topic(char *tn, int nc, char **cnames, int **ctypes) {
 }
 
 int itab_create_table(Indextable *itab, char *tablename, int ncols,
-                      char **colnames, int **coltypes, short tabletype, short primary_column) {
+                      char **colnames, int **coltypes, short tabletype, short primary_column,
+                      short retain, long long retain_limit) {
 
     Table *tn;
 
@@ -93,6 +99,16 @@ int itab_create_table(Indextable *itab, char *tablename, int ncols,
         return 0;
     }
 
+    if (retain != SQL_RETAIN_NONE && tabletype) {
+        errorf("retention policy defined for persistent table.\n");
+        return 0;
+    }
+
+    if (retain != SQL_RETAIN_NONE && retain_limit <= 0) {
+        errorf("retention limit must be positive.\n");
+        return 0;
+    }
+
     itab_lock(itab);
 
     debugvf("Itab: creating table\n");
@@ -102,13 +118,24 @@ int itab_create_table(Indextable *itab, char *tablename, int ncols,
 
         debugf("Adding new table to master table\n");
 
-        /* Create new table node */
-        tn = table_new(ncols, colnames, coltypes);
+        /* Create new table node; stream tables in a memory buffer
+         * file must live in its catalog, unless they have a retention
+         * policy, in which case their rows live on the heap */
+        if (! tabletype && retain == SQL_RETAIN_NONE && mb_has_catalog()) {
+            if (!(tn = mb_catalog_add(tablename, ncols, colnames, coltypes))) {
+                itab_unlock(itab);
+                return 0;
+            }
+        } else
+            tn = table_new(ncols, colnames, coltypes);
         table_tabletype(tn, tabletype, primary_column);
+        table_retention(tn, retain, retain_limit);
+        if (! tabletype && retain == SQL_RETAIN_NONE)
+            tn->shard = mb_next_shard();
 
         /* Add into hashtable */
         (void)hm_put(itab->ht, strdup(tablename), tn, &dummyVal);
-        (void)create_topic(tablename, ncols, colnames, coltypes);
+        tn->topic = create_topic(tablename, ncols, colnames, coltypes);
         if (tabletype)
             (void)ptab_create(tablename);
 
@@ -123,9 +150,61 @@ int itab_create_table(Indextable *itab, char *tablename, int ncols,
     return 1;
 }
 
+/*
+ * enter a stream table that survived a restart in the memory buffer file
+ * into the index, recreating its topic
+ */
+int itab_restore_table(Indextable *itab, char *tablename, Table *tn) {
+    void *dummyVal;
+
+    itab_lock(itab);
+    if (hm_get(itab->ht, tablename, &dummyVal)) {
+        errorf("Table exists. Doing nothing.\n");
+        itab_unlock(itab);
+        return 0;
+    }
+    debugf("Restoring table %s with %ld rows\n", tablename, tn->count);
+    (void)hm_put(itab->ht, strdup(tablename), tn, &dummyVal);
+    tn->topic = create_topic(tablename, tn->ncols, tn->colname, tn->coltype);
+    itab_unlock(itab);
+    return 1;
+}
+
+/*
+ * create a secondary index over a column of a table, of kind
+ * SQL_INDEX_HASH or SQL_INDEX_ORDERED
+ */
+int itab_create_index(Indextable *itab, char *indexname, char *tablename,
+                      char *colname, int kind) {
+    Table *tn;
+    int stat, col;
+
+    if (kind != SQL_INDEX_HASH && kind != SQL_INDEX_ORDERED) {
+        errorf("unknown index method; use hash or ordered.\n");
+        return 0;
+    }
+    itab_lock(itab);
+    stat = hm_get(itab->ht, tablename, (void **)&tn);
+    itab_unlock(itab);
+    if (! stat) {
+        errorf("Table does not exist. Doing nothing.\n");
+        return 0;
+    }
+    table_lock(tn);
+    if ((col = table_lookup_colindex(tn, colname)) == -1) {
+        errorf("No such column: %s\n", colname);
+        table_unlock(tn);
+        return 0;
+    }
+    stat = table_add_index(tn, indexname, col, kind);
+    table_unlock(tn);
+    return stat;
+}
+
 int itab_update_table(Indextable *itab, sqlupdate *update) {
     Table *tn;
     Nodecrawler *nc;
+    Plan *plan;
     int stat;
     debugvf("Itab: updating table\n");
     itab_lock(itab);
@@ -143,19 +222,19 @@ int itab_update_table(Indextable *itab, sqlupdate *update) {
         return 0;
     }
 
+    plan = plan_compile(tn, update->nfilters, update->filters,
+                        update->filtertype, NULL);
+    if (! plan) {
+        errorf("Unable to plan update.\n");
+        table_unlock(tn);
+        return 0;
+    }
     nc = nodecrawler_new(tn->oldest, tn->newest);
 
-    nodecrawler_apply_filter(nc, tn,
-                             update->nfilters, update->filters, update->filtertype);
+    nodecrawler_apply_filter(nc, plan);
+    plan_free(plan);
 
     nodecrawler_update_cols(nc, tn, update);
-
-    /* Reset dropped markers */
-    nodecrawler_reset_all_dropped(nc);
-    nodecrawler_free(nc);
-
-    nc = nodecrawler_new(tn->oldest, tn->newest);
-    nodecrawler_reset_all_dropped(nc);
     nodecrawler_free(nc);
 
     /* Unlock table */
@@ -167,6 +246,7 @@ int itab_update_table(Indextable *itab, sqlupdate *update) {
 int itab_delete_rows(Indextable *itab, sqldelete *delete) {
     Table *tn;
     Nodecrawler *nc;
+    Plan *plan;
     int stat;
     debugvf("Itab: deleting rows from table\n");
     itab_lock(itab);
@@ -183,18 +263,18 @@ int itab_delete_rows(Indextable *itab, sqldelete *delete) {
 
     /* Lock table */
     table_lock(tn);
+    plan = plan_compile(tn, delete->nfilters, delete->filters,
+                        delete->filtertype, NULL);
+    if (! plan) {
+        errorf("Unable to plan delete.\n");
+        table_unlock(tn);
+        return 0;
+    }
     nc = nodecrawler_new(tn->oldest, tn->newest);
 
-    nodecrawler_apply_filter(nc, tn, delete->nfilters, delete->filters,
-                             delete->filtertype);
+    nodecrawler_apply_filter(nc, plan);
+    plan_free(plan);
     nodecrawler_delete_rows(nc, tn, delete);
-
-    /* Reset dropped markers */
-    nodecrawler_reset_all_dropped(nc);
-    nodecrawler_free(nc);
-
-    nc = nodecrawler_new(tn->oldest, tn->newest);
-    nodecrawler_reset_all_dropped(nc);
     nodecrawler_free(nc);
 
     /* Unlock table */
@@ -206,7 +286,7 @@ int itab_delete_rows(Indextable *itab, sqldelete *delete) {
 
 int itab_is_compatible(Indextable *itab, char *tablename, int ncols, int **coltypes) {
     Table *tn;
-    int i, stat;
+    int stat;
 
     itab_lock(itab);
     stat = hm_get(itab->ht, tablename, (void **)&tn);
@@ -218,25 +298,12 @@ int itab_is_compatible(Indextable *itab, char *tablename, int ncols, int **colty
         return 0;
     }
 
-    /* Check number of columns */
-    table_lock(tn);
-    if (tn->ncols != ncols) {
-        errorf("Insert: Not the same number of columns\n");
-        table_unlock(tn);
-        return 0;
-    }
-
-    /* Check column types */
-    for (i=0; i < tn->ncols; i++) {
-        if (tn->coltype[i] != coltypes[i]) {
-            errorf("Insert: Incompatible column type column num: %d\n", i);
-            table_unlock(tn);
-            return 0;
-        }
-    }
+    /* Check number of columns and column types */
+    table_rdlock(tn);
+    stat = table_compatible(tn, ncols, coltypes);
     table_unlock(tn);
 
-    return 1;
+    return stat;
 
 }
 
@@ -249,38 +316,11 @@ Node *itab_is_constrained(Indextable *itab, char *tablename, char **colvals) {
 
     Table *tn;
 
-    Nodecrawler *nc;
-    int key;
-    Node *found = NULL;
-
     itab_lock(itab);
     (void)hm_get(itab->ht, tablename, (void **)&tn);
     itab_unlock(itab);
 
-    table_lock(tn);
-    if (table_persistent(tn)) {
-
-        key = table_key(tn);
-        /* If the key is the timestamp, ignore under the assumption
-         * that all timestamps are unique. In any case, the new re-
-         * cord has not been assigned a timestamp yet.
-         */
-        debugvf("Value at key index is %s\n", colvals[key]);
-
-        nc = nodecrawler_new(tn->oldest, tn->newest);
-        found = nodecrawler_find_value(nc, key, colvals[key]);
-        nodecrawler_free(nc);
-
-        if (found) {
-            /*errorf("Key %s already exists in %s\n", colvals[key],
-            	tablename);*/
-            table_unlock(tn);
-            return found;
-        }
-    }
-    table_unlock(tn);
-    debugvf("Table %s is not persistent\n", tablename);
-    return NULL;
+    return table_constrained(tn, colvals);
 }
 
 Table *itab_table_lookup(Indextable *itab, char *tablename) {
@@ -313,7 +353,7 @@ int itab_colnames_match(Indextable *itab, char *tablename, sqlselect *select) {
         return 0;
     }
 
-    table_lock(tn);
+    table_rdlock(tn);
     if (!table_colnames_match(tn, select)) {
         errorf("Column names in SELECT don't match with this table.\n");
         table_unlock(tn);
@@ -324,10 +364,38 @@ int itab_colnames_match(Indextable *itab, char *tablename, sqlselect *select) {
     return 1;
 }
 
+/*
+ * pushes the rows in the window of the table that pass the plan's filters
+ * into the sink; the table must be read locked, and is unlocked as soon
+ * as the scan no longer needs it
+ *
+ * If a filter is on an indexed column, the rows are found through the
+ * index instead.  Rows of a stream table in the memory buffer are not
+ * reused while pinned, so they can be scanned without holding up inserts.
+ */
+static void itab_scan(Table *tn, sqlwindow *win, Plan *plan, Sink *sk) {
+    Nodecrawler *nc;
+    int pin;
+
+    nc = nodecrawler_new_from_window(tn, win);
+    if (nodecrawler_scan_indexed(nc, plan, sk))
+        table_unlock(tn);
+    else if (nc->table && ! table_retained(tn) && (pin = mb_pin(tn)) >= 0) {
+        table_unlock(tn);
+        nodecrawler_scan_pinned(nc, plan, sk, pin);
+        mb_unpin(tn, pin);
+    } else {
+        nodecrawler_scan(nc, plan, sk);
+        table_unlock(tn);
+    }
+    nodecrawler_free(nc);
+}
+
 Rtab *itab_build_results(Indextable *itab, char *tablename, sqlselect *select) {
     Table *tn;
     Rtab *results;
-    Nodecrawler *nc;
+    Plan *plan;
+    Sink *sk;
     int stat;
 
     itab_lock(itab);
@@ -340,68 +408,122 @@ Rtab *itab_build_results(Indextable *itab, char *tablename, sqlselect *select) {
         return NULL;
     }
 
-    /* Lock table */
-    table_lock(tn);
+    /* Lock table, shared with other queries */
+    table_rdlock(tn);
 
     /* Build results */
     results = rtab_new();
     table_store_select_cols(tn, select, results);
     table_extract_relevant_types(tn, results);
 
-    /* Now add all relevant rows
-     *   -- apply_window
-     *   -- apply_filter
-     *   -- project columns
-     *
-     * Note that the basic idea here is to manipulate a list
-     * of tuples, running over it and dropping tuples that
-     * don't pass the window or filter rules.
-     *
-     * The tuples that remain in the list are all ok and then
-     * the columns are projected from these tuples.
+    /* Resolve the filter and result columns once */
+    plan = plan_compile(tn, select->nfilters, select->filters,
+                        select->filtertype, results);
+    if (! plan || ! (sk = sink_new(select, plan, results))) {
+        errorf("Unable to plan select.\n");
+        plan_free(plan);
+        rtab_free(results);
+        table_unlock(tn);
+        return NULL;
+    }
+
+    /* Now add all relevant rows, in a single pass
+     *   -- apply_window, to find the range of the table to scan
+     *   -- then, for each row in the range
+     *        -- apply the filters
+     *        -- push the row into the sink, which projects it
+     *           or counts it
      */
-    nc = nodecrawler_new(tn->oldest, tn->newest);
-    nodecrawler_apply_window(nc, select->windows[0]); /* NB only one window */
-    nodecrawler_apply_filter(nc, tn, select->nfilters, select->filters, select->filtertype);
-    nodecrawler_project_cols(nc, tn, results);
-
-    /* group by */
-    if (select->groupby_ncols > 0) {
-        rtab_groupby(results, select->groupby_ncols, select->groupby_cols,
-                     select->isCountStar, select->containsMinMaxAvgSum, select->colattrib);
-    } else {
-        debugf("Computing count, min, max, avg, sum?\n");
-        /* count, min, max, avg, sum */
-        if (select->isCountStar) {
-            rtab_countstar(results);
-        } else if (select->containsMinMaxAvgSum) {
-            rtab_processMinMaxAvgSum(results, select->colattrib);
-        }
+    itab_scan(tn, select->windows[0], plan, sk);
+    if (! sink_finish(sk)) {
+        errorf("Out of memory for select.\n");
+        plan_free(plan);
+        rtab_free(results);
+        return NULL;
     }
+    plan_free(plan);
 
     /* order by */
     rtab_orderby(results, select->orderby);
 
-    /* Reset dropped markers */
-    nodecrawler_reset_all_dropped(nc);
+    /* limit */
+    rtab_limit(results, select->offset, select->limit);
 
-    nodecrawler_free(nc);
+    return results;
+}
 
+Rtab *itab_build_join_results(Indextable *itab, sqlselect *select) {
+    Table *tables[2];
+    Rtab *results;
+    Join *j;
+    Sink *sk;
+    int i, b;
+
+    for (i = 0; i < 2; i++) {
+        itab_lock(itab);
+        if (! hm_get(itab->ht, select->tables[i], (void **)&tables[i]))
+            tables[i] = NULL;
+        itab_unlock(itab);
+        if (! tables[i]) {
+            errorf("itab: No such table: %s\n", select->tables[i]);
+            return NULL;
+        }
+    }
 
-    /* Unlock table */
-    table_unlock(tn);
+    results = rtab_new();
+    if (! (j = join_new(tables, select, results))) {
+        rtab_free(results);
+        return NULL;
+    }
+
+    /* Hash the rows of one table, then look up those of the other; each
+     * table is locked only while it is scanned */
+    b = join_build_side(j);
+    if (! (sk = join_build_sink(j, results))) {
+        errorf("Unable to plan select.\n");
+        join_free(j);
+        rtab_free(results);
+        return NULL;
+    }
+    table_rdlock(tables[b]);
+    itab_scan(tables[b], select->windows[b], join_plan(j, b), sk);
+    if (! sink_finish(sk)) {
+        errorf("Out of memory for join.\n");
+        join_free(j);
+        rtab_free(results);
+        return NULL;
+    }
+    if (! (sk = join_probe_sink(j, select, results))) {
+        errorf("Unable to plan select.\n");
+        join_free(j);
+        rtab_free(results);
+        return NULL;
+    }
+    table_rdlock(tables[1 - b]);
+    itab_scan(tables[1 - b], select->windows[1 - b], join_plan(j, 1 - b), sk);
+    if (! sink_finish(sk)) {
+        errorf("Out of memory for join.\n");
+        join_free(j);
+        rtab_free(results);
+        return NULL;
+    }
+    join_free(j);
+
+    /* order by */
+    rtab_orderby(results, select->orderby);
+
+    /* limit */
+    rtab_limit(results, select->offset, select->limit);
 
     return results;
 }
 
 Rtab *itab_showtables(Indextable *itab) {
     Rtab *results;
-    LinkedList *rowlist;
     char **tnames;
     Rrow *r;
     int j;
     long N;
-    long dummyLong;
 
     itab_lock(itab);
 
@@ -418,21 +540,40 @@ Rtab *itab_showtables(Indextable *itab) {
     results->colnames[0] = strdup("Tablename");
     results->coltypes = (int **)malloc(sizeof(int *));
     results->coltypes[0] = PRIMTYPE_VARCHAR;
-    rowlist = ll_create();
+    results->rows = (Rrow **)malloc(N * sizeof(Rrow *));
     for (j = 0; j < results->nrows; j++) {
-        r = malloc(sizeof(Rrow));
-        r->cols = malloc(sizeof(char *));
-        r->cols[0] = strdup(tnames[j]);
-        (void)ll_add(rowlist, r);
+        r = rtab_new_row(results);
+        r->cols[0] = rtab_strdup(results, tnames[j]);
+        results->rows[j] = r;
     }
-    results->rows = (Rrow **)ll_toArray(rowlist, &dummyLong);
-    ll_destroy(rowlist, NULL);
     free(tnames);
     itab_unlock(itab);
 
     return results;
 }
 
+/*
+ * report the number of rows and tuple bytes held by each table
+ */
+void itab_dump(Indextable *itab) {
+    char **tnames;
+    Table *tn;
+    long j, N;
+
+    itab_lock(itab);
+    tnames = hm_keyArray(itab->ht, &N);
+    for (j = 0; tnames && j < N; j++) {
+        if (! hm_get(itab->ht, tnames[j], (void **)&tn))
+            continue;
+        table_rdlock(tn);
+        printf("table %s: %ld rows, %ld tuple bytes\n",
+               tnames[j], tn->count, tn->nbytes);
+        table_unlock(tn);
+    }
+    free(tnames);
+    itab_unlock(itab);
+}
+
 void itab_lock(Indextable *itab) {
     debugf("Itab: Acquiring masterlock...\n");
     pthread_mutex_lock(itab->masterlock);
@@ -44,7 +44,13 @@ typedef struct indextable Indextable;
 Indextable *itab_new(void);
 
 int itab_create_table(Indextable *itab, char *tablename, int ncols,
-                      char **colnames, int **coltypes, short tabletype, short primary_column);
+                      char **colnames, int **coltypes, short tabletype, short primary_column,
+                      short retain, long long retain_limit);
+
+int itab_restore_table(Indextable *itab, char *tablename, Table *tn);
+
+int itab_create_index(Indextable *itab, char *indexname, char *tablename,
+                      char *colname, int kind);
 
 int itab_update_table(Indextable *itab, sqlupdate *update);
 int itab_delete_rows(Indextable *itab, sqldelete *delete);
@@ -60,8 +66,15 @@ int itab_colnames_match(Indextable *itab, char *tablename, sqlselect *select);
 
 Rtab *itab_build_results(Indextable *itab, char *tablename, sqlselect *select);
 
+/*
+ * equi-join of the two tables of the select, see join.h
+ */
+Rtab *itab_build_join_results(Indextable *itab, sqlselect *select);
+
 Rtab *itab_showtables(Indextable *itab);
 
+void itab_dump(Indextable *itab);
+
 void itab_lock(Indextable *itab);
 void itab_unlock(Indextable *itab);
 
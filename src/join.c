@@ -0,0 +1,502 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * join.c - equi-join of the windows of two tables
+ */
+#include "join.h"
+
+#include "tuple.h"
+#include "typetable.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#define JOIN_BUCKETS 64		/* fewest buckets in the hash table */
+
+typedef struct joincol {
+    int table;			/* index of its table in the select */
+    int col;			/* column of the table, -1 for the timestamp */
+    int kept;			/* index among the kept columns, build side */
+} JoinCol;
+
+typedef struct joinrow {
+    struct joinrow *next;	/* next in the bucket, or in scan order */
+    unsigned int hash;		/* hash of the key */
+    union TupleSlot key;	/* key, if of fixed width */
+    char *str;			/* key, if text */
+    char **cols;		/* columns kept for the results */
+} JoinRow;
+
+struct join {
+    Table *tables[2];		/* the tables, in select order */
+    char *names[2];		/* and their names */
+    int nfilters[2];		/* number of filters on each table */
+    sqlfilter **filters[2];	/* the filters, with unqualified names */
+    Plan *plans[2];		/* and compiled */
+    int keycol[2];		/* join column of each, -1 for the timestamp */
+    int keyclass;		/* TUPLE_ class of the join columns */
+    int ncols;			/* number of result columns */
+    JoinCol *cols;		/* the result columns */
+    int build;			/* the table whose rows are hashed */
+    int nkept;			/* number of columns kept from each build row */
+    int *kept;			/* column of the build table for each */
+    JoinRow *rows;		/* build rows, newest first, until hashed */
+    long nrows;			/* number of build rows */
+    JoinRow **buckets;		/* hash table of the build rows */
+    unsigned long size;		/* number of buckets, a power of 2 */
+};
+
+/*
+ * looks a column up in a table, including its timestamp
+ */
+static int join_column(Table *tn, char *name, int *col) {
+    if ((*col = table_lookup_colindex(tn, name)) != -1)
+        return 1;
+    return (strcmp(name, "timestamp") == 0);
+}
+
+/*
+ * resolves a column name, which may be qualified by the name of its
+ * table, to one of the tables and a column in it; bare is left pointing
+ * at the unqualified name
+ */
+static int join_resolve(Join *j, char *name, int *table, int *col, char **bare) {
+    char *p;
+    int i, c, found = 0;
+
+    if ((p = strchr(name, '.'))) {
+        for (i = 0; i < 2; i++) {
+            if (strlen(j->names[i]) == (size_t)(p - name) &&
+                    strncmp(name, j->names[i], p - name) == 0 &&
+                    join_column(j->tables[i], p + 1, col)) {
+                *table = i;
+                *bare = p + 1;
+                return 1;
+            }
+        }
+    }
+    for (i = 0; i < 2; i++) {
+        if (! join_column(j->tables[i], name, &c))
+            continue;
+        if (found++) {
+            errorf("Column %s is in both tables; qualify it with one.\n", name);
+            return 0;
+        }
+        *table = i;
+        *col = c;
+        *bare = name;
+    }
+    if (! found) {
+        errorf("No such column: %s\n", name);
+    }
+    return found;
+}
+
+static int join_class(Table *tn, int col) {
+    return (col == -1) ? TUPLE_TSTAMP : tuple_class(tn->coltype[col]);
+}
+
+/*
+ * number of rows in the window, at most
+ */
+static long join_estimate(Table *tn, sqlwindow *win) {
+    long n;
+
+    table_rdlock(tn);
+    n = tn->count;
+    table_unlock(tn);
+    if (win->type == SQL_WINTYPE_TPL && win->num >= 0 && win->num < n)
+        n = win->num;
+    return n;
+}
+
+/*
+ * stores the result columns, either those named in the select, or all
+ * the columns of both tables, qualified with the name of their table
+ */
+static int join_columns(Join *j, sqlselect *select, Rtab *results) {
+    char name[1024], *bare;
+    JoinCol *c;
+    int i, k, star;
+
+    star = (select->ncols == 1 && strcmp(select->cols[0], "*") == 0);
+    j->ncols = (star) ? j->tables[0]->ncols + j->tables[1]->ncols + 2
+               : select->ncols;
+    if (! (j->cols = (JoinCol *)calloc(j->ncols, sizeof(JoinCol))) ||
+            ! (results->colnames = (char **)calloc(j->ncols, sizeof(char *))) ||
+            ! (results->coltypes = (int **)calloc(j->ncols, sizeof(int *))))
+        return 0;
+    results->ncols = j->ncols;
+    for (i = 0, k = 0; i < j->ncols; i++) {
+        c = &(j->cols[i]);
+        if (star) {
+            c->table = (i > j->tables[0]->ncols);
+            c->col = (c->table) ? i - j->tables[0]->ncols - 2 : i - 1;
+            sprintf(name, "%.500s.%.500s", j->names[c->table], (c->col == -1) ?
+                    "timestamp" : j->tables[c->table]->colname[c->col]);
+            results->colnames[i] = strdup(name);
+        } else {
+            if (! join_resolve(j, select->cols[i], &(c->table), &(c->col), &bare))
+                return 0;
+            results->colnames[i] = strdup(select->cols[i]);
+        }
+        results->coltypes[i] = (c->col == -1) ? PRIMTYPE_TIMESTAMP :
+                               j->tables[c->table]->coltype[c->col];
+        if (c->table == j->build && ! select->isCountStar)
+            c->kept = k++;
+    }
+    if (k > 0 && ! (j->kept = (int *)malloc(k * sizeof(int))))
+        return 0;
+    for (i = 0; i < j->ncols; i++)
+        if (j->cols[i].table == j->build && ! select->isCountStar)
+            j->kept[j->cols[i].kept] = j->cols[i].col;
+    j->nkept = k;
+    return 1;
+}
+
+/*
+ * splits the filters between the tables, and compiles them
+ */
+static int join_filters(Join *j, sqlselect *select) {
+    sqlfilter *f;
+    char *bare;
+    int i, t, col;
+
+    for (t = 0; t < 2; t++) {
+        if (select->nfilters > 0 &&
+                ! (j->filters[t] = (sqlfilter **)calloc(select->nfilters,
+                                                        sizeof(sqlfilter *))))
+            return 0;
+    }
+    for (i = 0; i < select->nfilters; i++) {
+        if (! join_resolve(j, select->filters[i]->varname, &t, &col, &bare) ||
+                ! (f = (sqlfilter *)malloc(sizeof(sqlfilter))))
+            return 0;
+        *f = *(select->filters[i]);
+        f->varname = bare;
+        j->filters[t][j->nfilters[t]++] = f;
+    }
+    for (t = 0; t < 2; t++) {
+        if (! (j->plans[t] = plan_compile(j->tables[t], j->nfilters[t],
+                                          j->filters[t], SQL_FILTER_TYPE_AND,
+                                          NULL)))
+            return 0;
+    }
+    return 1;
+}
+
+Join *join_new(Table *tables[2], sqlselect *select, Rtab *results) {
+    Join *j;
+    char *bare;
+    int t1, t2, c1, c2;
+
+    if (select->ntables != 2) {
+        errorf("Only joins of two tables are supported.\n");
+        return NULL;
+    }
+    if (select->njoins != 1) {
+        errorf("A join needs one condition of the form a.x = b.y.\n");
+        return NULL;
+    }
+    if (select->containsMinMaxAvgSum || select->groupby_ncols > 0) {
+        errorf("Aggregates and group by are not supported in joins.\n");
+        return NULL;
+    }
+    if (select->nfilters > 1 && select->filtertype == SQL_FILTER_TYPE_OR) {
+        errorf("Only AND filters are supported in joins.\n");
+        return NULL;
+    }
+    if (! (j = (Join *)calloc(1, sizeof(Join))))
+        return NULL;
+    j->tables[0] = tables[0];
+    j->tables[1] = tables[1];
+    j->names[0] = select->tables[0];
+    j->names[1] = select->tables[1];
+    if (! join_resolve(j, select->joins[0]->left, &t1, &c1, &bare) ||
+            ! join_resolve(j, select->joins[0]->right, &t2, &c2, &bare))
+        goto fail;
+    if (t1 == t2) {
+        errorf("A join condition must compare columns of both tables.\n");
+        goto fail;
+    }
+    j->keycol[t1] = c1;
+    j->keycol[t2] = c2;
+    j->keyclass = join_class(tables[t1], c1);
+    if (j->keyclass != join_class(tables[t2], c2)) {
+        errorf("Columns %s and %s are of different types.\n",
+               select->joins[0]->left, select->joins[0]->right);
+        goto fail;
+    }
+    /* hash the smaller input */
+    j->build = (join_estimate(tables[0], select->windows[0]) <
+                join_estimate(tables[1], select->windows[1])) ? 0 : 1;
+    if (! join_filters(j, select) || ! join_columns(j, select, results))
+        goto fail;
+    return j;
+fail:
+    join_free(j);
+    return NULL;
+}
+
+void join_free(Join *j) {
+    JoinRow *r, *next;
+    unsigned long b;
+    int i, t;
+
+    for (b = 0; b < j->size; b++) {
+        r = j->buckets[b];
+        j->buckets[b] = NULL;
+        for (; r; r = next) {
+            next = r->next;
+            r->next = j->rows;
+            j->rows = r;
+        }
+    }
+    for (r = j->rows; r; r = next) {
+        next = r->next;
+        for (i = 0; i < j->nkept; i++)
+            free(r->cols[i]);
+        free(r->cols);
+        free(r->str);
+        free(r);
+    }
+    for (t = 0; t < 2; t++) {
+        for (i = 0; i < j->nfilters[t]; i++)
+            free(j->filters[t][i]);
+        free(j->filters[t]);
+        plan_free(j->plans[t]);
+    }
+    free(j->buckets);
+    free(j->kept);
+    free(j->cols);
+    free(j);
+}
+
+int join_build_side(Join *j) {
+    return j->build;
+}
+
+Plan *join_plan(Join *j, int i) {
+    return j->plans[i];
+}
+
+/*
+ * the text of a column, or of the timestamp, as plan_text() has it
+ */
+static char *join_text(Table *tn, Node *n, int col, char *buf) {
+    if (col != -1)
+        return tuple_text(n->tuple, col, tn->coltype[col], buf);
+    sprintf(buf, "@%016llx@", n->tstamp);
+    return buf;
+}
+
+static unsigned int join_key(Join *j, int t, Node *n, union TupleSlot *key,
+                             char **str) {
+    unsigned long long h = 14695981039346656037ULL;
+    unsigned char *p;
+
+    *str = NULL;
+    if (j->keycol[t] == -1)
+        key->tstampv = n->tstamp;
+    else if (j->keyclass == TUPLE_STR) {
+        *str = tuple_str(n->tuple, j->keycol[t]);
+        for (p = (unsigned char *)*str; *p; p++)
+            h = (h ^ *p) * 1099511628211ULL;
+        return (unsigned int)(h ^ (h >> 32));
+    } else
+        *key = tuple_slot(n->tuple, j->keycol[t]);
+    if (j->keyclass == TUPLE_REAL && key->realv == 0.0)
+        key->realv = 0.0;	/* -0.0 is equal to 0.0 */
+    h = (h ^ (unsigned long long)key->intv) * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 29;
+    return (unsigned int)(h ^ (h >> 32));
+}
+
+static int join_matches(Join *j, JoinRow *r, union TupleSlot *key, char *str) {
+    if (j->keyclass == TUPLE_STR)
+        return (strcmp(r->str, str) == 0);
+    if (j->keyclass == TUPLE_REAL)
+        return (r->key.realv == key->realv);
+    return (r->key.intv == key->intv);
+}
+
+static int build_push(Sink *sk, Node *n) {
+    Join *j = sk->join;
+    Table *tn = j->tables[j->build];
+    char buf[TUPLE_TEXT_LEN], *str;
+    JoinRow *r;
+    int i;
+
+    if (! (r = (JoinRow *)calloc(1, sizeof(JoinRow))))
+        goto fail;
+    if (j->nkept > 0 && ! (r->cols = (char **)calloc(j->nkept, sizeof(char *))))
+        goto fail;
+    r->hash = join_key(j, j->build, n, &(r->key), &str);
+    if (str && ! (r->str = strdup(str)))
+        goto fail;
+    for (i = 0; i < j->nkept; i++)
+        if (! (r->cols[i] = strdup(join_text(tn, n, j->kept[i], buf))))
+            goto fail;
+    r->next = j->rows;
+    j->rows = r;
+    j->nrows++;
+    return 1;
+fail:
+    if (r) {
+        for (i = 0; r->cols && i < j->nkept; i++)
+            free(r->cols[i]);
+        free(r->cols);
+        free(r->str);
+        free(r);
+    }
+    sk->failed = 1;		/* the join would miss the row */
+    return 0;
+}
+
+/*
+ * hashes the build rows; as the rows are pushed onto each bucket in turn,
+ * newest first, the rows with the same key end up in scan order
+ */
+static void build_finish(Sink *sk) {
+    Join *j = sk->join;
+    unsigned long size;
+    JoinRow *r, **b;
+
+    for (size = JOIN_BUCKETS; size < (unsigned long)j->nrows; size *= 2)
+        ;
+    if (! (j->buckets = (JoinRow **)calloc(size, sizeof(JoinRow *))))
+        return;
+    j->size = size;
+    while ((r = j->rows)) {
+        j->rows = r->next;
+        b = &(j->buckets[r->hash & (size - 1)]);
+        r->next = *b;
+        *b = r;
+    }
+}
+
+static int probe_push(Sink *sk, Node *n) {
+    Join *j = sk->join;
+    Table *tn = j->tables[1 - j->build];
+    char buf[TUPLE_TEXT_LEN], *str;
+    union TupleSlot key;
+    unsigned int hash;
+    JoinCol *c;
+    JoinRow *r;
+    Rrow *row;
+    int i;
+
+    if (! j->size)
+        return 0;
+    hash = join_key(j, 1 - j->build, n, &key, &str);
+    for (r = j->buckets[hash & (j->size - 1)]; r; r = r->next) {
+        if (r->hash != hash || ! join_matches(j, r, &key, str))
+            continue;
+        if (! sk->rows) {	/* count(*) */
+            sk->count++;
+            continue;
+        }
+        if (! (row = rtab_new_row(sk->results))) {
+            sk->failed = 1;
+            return 0;
+        }
+        for (i = 0; i < j->ncols; i++) {
+            c = &(j->cols[i]);
+            if (c->table == j->build)
+                row->cols[i] = rtab_strdup(sk->results, r->cols[c->kept]);
+            else
+                row->cols[i] = rtab_strdup(sk->results,
+                                           join_text(tn, n, c->col, buf));
+        }
+        if (! sink_keep(sk, row)) {
+            sk->failed = 1;
+            return 0;
+        }
+        if (sk->want >= 0 && ++sk->count >= sk->want)
+            return 0;
+    }
+    return 1;
+}
+
+static void probe_finish(Sink *sk) {
+    if (! sk->rows) {
+        if (sk->count > 0)
+            rtab_count(sk->results, sk->count);
+        return;
+    }
+    sink_rows_done(sk);
+}
+
+static Sink *join_sink(Join *j, Rtab *results) {
+    Sink *sk;
+
+    if (! (sk = (Sink *)calloc(1, sizeof(Sink))))
+        return NULL;
+    sk->results = results;
+    sk->want = -1;
+    sk->join = j;
+    return sk;
+}
+
+Sink *join_build_sink(Join *j, Rtab *results) {
+    Sink *sk;
+
+    if ((sk = join_sink(j, results))) {
+        sk->plan = j->plans[j->build];
+        sk->push = build_push;
+        sk->finish = build_finish;
+    }
+    return sk;
+}
+
+Sink *join_probe_sink(Join *j, sqlselect *select, Rtab *results) {
+    Sink *sk;
+
+    if (! (sk = join_sink(j, results)))
+        return NULL;
+    sk->plan = j->plans[1 - j->build];
+    sk->push = probe_push;
+    sk->finish = probe_finish;
+    if (select->isCountStar)
+        return sk;
+    if (! select->orderby && select->limit >= 0 &&
+            select->limit <= LONG_MAX - select->offset)
+        sk->want = select->limit + select->offset;
+    if (! sink_rows_new(sk)) {
+        free(sk);
+        return NULL;
+    }
+    return sk;
+}
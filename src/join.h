@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * join.h - equi-join of the windows of two tables
+ *
+ * the rows of the smaller input that pass its filters are hashed on the
+ * join column, with the columns that the results need from them; the
+ * rows of the other input are then pushed through the filters into a
+ * sink that looks each one up, and emits a result row for every match
+ *
+ * the two tables are scanned one after the other, each with its own lock
+ * held, never both; as the inputs are scanned by the same code as a
+ * single-table select, each can use its indexes, or be scanned pinned
+ */
+#ifndef _JOIN_H_
+#define _JOIN_H_
+
+#include "table.h"
+#include "plan.h"
+#include "sink.h"
+#include "rtab.h"
+#include "sqlstmts.h"
+
+typedef struct join Join;
+
+/*
+ * resolves the columns, filters and join condition of a select over two
+ * tables, and stores the result columns in results; column names may be
+ * qualified by the name of their table, as in "flows.dev", and must be
+ * qualified if both tables have them
+ *
+ * returns NULL, having logged why, if the select cannot be run as a join
+ */
+Join *join_new(Table *tables[2], sqlselect *select, Rtab *results);
+
+void join_free(Join *j);
+
+/*
+ * returns the index, in the select, of the table whose rows are hashed;
+ * the other one is probed
+ */
+int join_build_side(Join *j);
+
+/*
+ * returns the plan of the filters on table i of the select
+ */
+Plan *join_plan(Join *j, int i);
+
+/*
+ * returns a sink that hashes the rows of the build side
+ */
+Sink *join_build_sink(Join *j, Rtab *results);
+
+/*
+ * returns a sink that looks up the rows of the probe side, leaving the
+ * joined rows in results; must not be used until the build is finished
+ */
+Sink *join_probe_sink(Join *j, sqlselect *select, Rtab *results);
+
+#endif /* _JOIN_H_ */
@@ -32,15 +32,51 @@
 /*
  * mb.c - source file for circular buffer that underlies the Homework DB
  *
- * the buffer is allocated statically with size MB_SIZE
+ * the buffer is allocated with mmap at startup, with a size given by the
+ * caller (default MB_SIZE), and is split into a number of equally-sized
+ * shards (default MB_NSHARDS); each shard is an independent circular
+ * buffer with its own mutex, node free list and eviction cursors, so that
+ * inserts into tables that live in different shards do not contend
  *
- * tuples are allocated starting at the beginning of the buffer
+ * within a shard, tuples are allocated starting at the beginning of the
+ * shard
  *
- * nodes are allocated from the end of the buffer
+ * nodes are allocated from the end of the shard
  *
- * after the buffer is exhausted, treat tuple space as a circular buffer
- * and the system is constrained to the number of nodes that exhausted the
- * buffer
+ * after the shard is exhausted, treat its tuple space as a circular buffer
+ * and the shard is constrained to the number of nodes that exhausted it
+ *
+ * each stream table is bound to a single shard when it is created; all of
+ * its tuples are stored in, and evicted from, that shard
+ *
+ * optionally, the buffer can be backed by a file, so that the contents of
+ * stream tables survive a restart; the file starts with a header, followed
+ * by the shard descriptors and a catalog of the stream tables, followed by
+ * the buffer proper.  The file is mapped privately, so that SNAPSHOT
+ * children still see a copy-on-write image, and is written back when the
+ * cache shuts down in an orderly fashion.  On restart, if the file was
+ * cleanly written by a compatible build, it is mapped at the address it
+ * was written from, so that all of the pointers in it are still valid,
+ * and the tables in the catalog are handed back to the caller
+ *
+ * the rows of a stream table can be read without holding the table lock,
+ * so that a long query does not hold up inserts: a reader pins the
+ * current epoch of the table's shard (mb_pin()) while it is looking at
+ * rows in the buffer.  Eviction then happens in two steps.  The oldest
+ * node in the shard is first retired - unlinked from its table and
+ * stamped with a new epoch - and its node and tuple space are only
+ * reclaimed for reuse once every reader of the shard that pinned an
+ * earlier epoch has unpinned it.  An insert that needs that space before
+ * then does not wait for the reader: its row overflows onto the heap,
+ * and goes through the shard's age list like any other
+ *
+ * stream tables created with a retention policy (RETAIN n ROWS, n SECONDS
+ * or n MB) do not use the buffer at all; their rows are kept on the heap,
+ * like those of persistent tables, and the table's own oldest rows are
+ * dropped at insert time whenever the policy is exceeded.  Their history
+ * is therefore not lost when other tables in the buffer are busy, and
+ * their footprint is bounded by the policy rather than by the traffic in
+ * the rest of the buffer
  */
 
 #ifndef ALIGNMENT	/* override if you know better! */
@@ -48,7 +84,7 @@
 #endif /* ALIGNMENT */
 
 /*
- * max value for MB_SIZE_IN_ALIGHMENT_UNITS is 240000000
+ * default size of the buffer if the caller does not specify one
  */
 #ifndef MB_SIZE_IN_ALIGNMENT_UNITS
 #define MB_SIZE_IN_ALIGNMENT_UNITS 24000000
@@ -57,9 +93,39 @@
 /* default is 1,600,000,000 bytes for 32-bit, 3,200,000,000 for 64-bit */
 #define MB_SIZE (MB_SIZE_IN_ALIGNMENT_UNITS * ALIGNMENT)
 
+/*
+ * default number of independently locked shards the buffer is split into
+ */
+#ifndef MB_NSHARDS
+#define MB_NSHARDS 4
+#endif /* MB_NSHARDS */
+
+/*
+ * smallest shard we are prepared to manage; the first block of nodes
+ * alone takes a good fraction of this
+ */
+#define MB_MIN_SHARD_SIZE (64 * 1024)
+
+/* size of an explicit huge page, used to round the mapping */
+#define MB_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+/*
+ * identification of a memory buffer file
+ */
+#define MB_MAGIC 0x3152454646554248LL	/* "HBUFFER1" */
+#define MB_VERSION 4
+
+/*
+ * limits on the stream table catalog held in a memory buffer file
+ */
+#define MB_CATALOG_TABLES 256
+#define MB_CATALOG_NAMELEN 64
+#define MB_CATALOG_MAXCOLS 128
+#define MB_CATALOG_COLBYTES 2048
+
 /*
  * we stop allocating Node structures when this much space is all that is left
- * above the last allocated tuple on the first pass through the buffer
+ * above the last allocated tuple on the first pass through the shard
  */
 #define BUFFER_ZONE 512 * ALIGNMENT
 
@@ -68,6 +134,18 @@
  */
 #define ALIGNED_NODE_SIZE (((sizeof(Node) - 1) / ALIGNMENT + 1) * ALIGNMENT)
 
+/*
+ * maximum number of readers that can pin an epoch of a shard at the same
+ * time
+ */
+#define MB_MAXPINS 128
+
+/*
+ * number of nodes that eviction keeps retired ahead of reclaiming them,
+ * so that readers have usually moved on by the time the space is needed
+ */
+#define MB_RETIRE_AHEAD 256
+
 /*
  * minimum number of Nodes to allocate at a time
  */
@@ -98,21 +176,94 @@
 #include <pthread.h>
 #include <sys/time.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sched.h>
+#include "typetable.h"
+#include "util.h"
 
-static unsigned char mb[MB_SIZE];	/* the memory buffer */
-static unsigned char *oldestT = mb;	/* address of oldest tuple */
-static unsigned char *nextT = mb + ALIGNMENT;	/* byte for next tuple */
-static long nbytes = ALIGNMENT;		/* number of bytes used */
-static long lastIndex = MB_SIZE - ALIGNED_NODE_SIZE;	/* last index used for node alloc */
-static unsigned char *lastPtr = mb + MB_SIZE - ALIGNED_NODE_SIZE;	/* address of mb[lastIndex] */
-static int partitionFixed = 0;		/* set to 1 when buffer exhausted */
-static Node *freeN = NULL;		/* free list of nodes */
-static Node *firstN;			/* least recently allocated node */
-static Node *lastN;			/* most recently allocated node */
-static long nnodes = 1L;		/* number of nodes in use */
-static Table dTbl;			/* dummy table to hold dummy tuple */
-static long passes = 0L;		/* counter of passes through buffer */
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * per-shard state; everything in here, apart from the pins, is protected
+ * by the shard's mutex
+ */
+typedef struct mbshard {
+    unsigned char *base;	/* first byte of the shard */
+    long size;			/* number of bytes in the shard */
+    unsigned char *oldestT;	/* address of oldest tuple */
+    unsigned char *nextT;	/* byte for next tuple */
+    long nbytes;		/* number of bytes used */
+    long lastIndex;		/* last index used for node alloc */
+    unsigned char *lastPtr;	/* address of base[lastIndex] */
+    int partitionFixed;		/* set to 1 when shard exhausted */
+    Node *freeN;		/* free list of nodes */
+    Node *firstN;		/* least recently allocated node */
+    Node *liveN;		/* oldest node not yet retired */
+    long nretired;		/* nodes in the shard retired, not yet reclaimed */
+    Node *lastN;		/* most recently allocated node */
+    long nnodes;		/* number of nodes in use */
+    Table dTbl;			/* dummy table to hold dummy tuple */
+    long passes;		/* counter of passes through shard */
+    tstamp_t lastTs;		/* timestamp of the newest tuple */
+    long nheap;			/* nodes that overflowed onto the heap */
+    pthread_mutex_t mutex;
+    /*
+     * the epoch is advanced by 2 each time a node is retired, so that it
+     * is always odd and a pin of 0 can mark a free slot; pins are taken
+     * and released without the mutex
+     */
+    volatile unsigned int epoch;
+    volatile unsigned int pins[MB_MAXPINS];	/* pinned epochs, 0 if free */
+    volatile int npins;				/* number of pins in use */
+} MBShard;
+
+/*
+ * a stream table in the catalog of a memory buffer file; the Table itself
+ * lives here so that Node parent pointers remain valid across a restart
+ */
+typedef struct mbcatentry {
+    int inuse;				/* slot holds a table */
+    int ncols;				/* number of columns */
+    char name[MB_CATALOG_NAMELEN];	/* name of the table */
+    unsigned char coltype[MB_CATALOG_MAXCOLS];	/* primtype indices */
+    char colnames[MB_CATALOG_COLBYTES];	/* NUL-separated column names */
+    Table table;
+} MBCatEntry;
+
+/*
+ * header at the start of a memory buffer file
+ */
+typedef struct mbheader {
+    long long magic;			/* MB_MAGIC */
+    int version;			/* MB_VERSION */
+    int clean;				/* set when written at shutdown */
+    unsigned char *base;		/* address the file is mapped at */
+    long mapsize;			/* bytes in the file */
+    long size;				/* bytes in the buffer proper */
+    int nshards;			/* number of shards */
+    unsigned int nextShard;		/* round-robin cursor for tables */
+    int layout[4];			/* sizes of structures, see layout() */
+} MBHeader;
+
+static unsigned char *mb = NULL;	/* the memory buffer */
+static long mbsize = 0L;		/* number of bytes in mb */
+static MBShard *shards = NULL;		/* the shards carved out of mb */
+static int nshards = 0;			/* number of shards */
+static unsigned int nextShard = 0;	/* round-robin cursor for tables */
+static pthread_mutex_t shardlock = PTHREAD_MUTEX_INITIALIZER;
+static int mbfd = -1;			/* memory buffer file, if any */
+static pid_t mbowner = 0;		/* process that opened the file */
+static MBHeader *hdr = NULL;		/* header of the file */
+static MBCatEntry *catalog = NULL;	/* table catalog in the file */
+static int restored = 0;		/* set if file contents were kept */
+
+/*
+ * returns 1 if a node, and its tuple, were allocated on the heap rather
+ * than in the shard, see shard_alloc()
+ */
+#define on_heap(s, n) ((unsigned char *)(n) < (s)->base \
+                       || (unsigned char *)(n) >= (s)->base + (s)->size)
 
 /*
  * allocate another block of Nodes, working down from high memory
@@ -128,149 +279,803 @@ static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
  *
  * this should not happen
  */
-static void alloc_block(int ifFirst) {
+static void alloc_block(MBShard *s, int ifFirst) {
     long nNodes;
     long i, ind;
     long zoneIndex;
     Node *t;
     long tupleAverage;
-    if (partitionFixed)			/* no more nodes can be alloced */
+    if (s->partitionFixed)		/* no more nodes can be alloced */
         return;
     /* have to account for tuple space + Node space */
-    if (ifFirst)	/* assume tuple average is 24 + ALIGNED_NODE_SIZE) */
+    /* assume tuple average is 24 + ALIGNED_NODE_SIZE) if no tuples yet */
+    if (ifFirst || s->nnodes == s->nheap)
         tupleAverage = 24 + ALIGNED_NODE_SIZE;
     else		/* compute tuple average from nbytes and nnodes */
-        tupleAverage = nbytes / nnodes + ALIGNED_NODE_SIZE;
-    nNodes = (long)(lastPtr - nextT) / 4 / tupleAverage;
+        tupleAverage = s->nbytes / (s->nnodes - s->nheap) + ALIGNED_NODE_SIZE;
+    nNodes = (long)(s->lastPtr - s->nextT) / 4 / tupleAverage;
     if (nNodes <= 0) {
-        partitionFixed++;
+        s->partitionFixed++;
         return;
     } else if (nNodes < MINIMUM_NODES)
         nNodes = MINIMUM_NODES;
-    zoneIndex = (long)(nextT - mb) + BUFFER_ZONE;
+    zoneIndex = (long)(s->nextT - s->base) + BUFFER_ZONE;
     for (i = 0L; i < nNodes; i++) {
-        ind = lastIndex - ALIGNED_NODE_SIZE;
+        ind = s->lastIndex - ALIGNED_NODE_SIZE;
         if (ind < zoneIndex) {		/* node in buffer zone, stop */
-            partitionFixed++;
+            s->partitionFixed++;
             break;
         }
-        lastIndex = ind;		/* add node to free list */
-        lastPtr = &(mb[lastIndex]);
-        t = (Node *)lastPtr;
-        t->next = freeN;
-        freeN = t;
+        s->lastIndex = ind;		/* add node to free list */
+        s->lastPtr = &(s->base[s->lastIndex]);
+        t = (Node *)s->lastPtr;
+        t->next = s->freeN;
+        s->freeN = t;
     }
 }
 
 /*
- * allocate a node from the free list
+ * allocate a node from the shard's free list
  *
  * if free list is empty, attempt to allocate another block of Nodes
  * and try again
  *
  * return NULL if no more free nodes
  */
-static Node *alloc_node() {
+static Node *alloc_node(MBShard *s) {
     Node *p;
-    if (!freeN && !partitionFixed)
-        alloc_block(0);
-    if ((p = freeN))
-        freeN = p->next;
+    if (!s->freeN && !s->partitionFixed)
+        alloc_block(s, 0);
+    if ((p = s->freeN))
+        s->freeN = p->next;
     return p;
 }
 
 /*
- * free oldest node, cleaning up the data structures
+ * retire the oldest node in the shard that is still in a table, unlinking
+ * it from the table and stamping it with the current epoch; its space is
+ * not reused until reclaim_node()
+ *
+ * the owning table is locked exclusively while the node is unlinked; callers
+ * hold the shard mutex, so the lock order is always shard, then table
+ *
+ * the node's next pointer is left intact, so that a reader that is on the
+ * node can carry on to the rest of the table
  */
-static void free_node() {
-    Node *t = firstN;		/* least-recently allocated tuple */
-    firstN = t->younger;	/* unlink it from active list */
-    oldestT = firstN->tuple;	/* oldestT now points to new oldest tuple */
-    nbytes -= t->alloc_len;	/* update bytes allocated */
+static void retire_node(MBShard *s) {
+    Node *t = s->liveN;		/* least-recently allocated live tuple */
+    s->liveN = t->younger;
     Table *tb = t->parent;	/* locate the table holding tuple */
+    (void) pthread_rwlock_wrlock(&(tb->tb_lock));
     Node *u = t->next;
     tb->oldest = u;		/* remove from table */
+    tb->nbytes -= t->alloc_len;
+    table_ts_evict(tb, t);
+    table_index_remove(tb, t);
     if (!(--(tb->count)))	/* list now empty */
         tb->newest = NULL;
     else
         u->prev = NULL;
-    t->next = freeN;		/* return Node to free list */
-    freeN = t;
-    nnodes--;			/* update nodes in use */
+    (void) pthread_rwlock_unlock(&(tb->tb_lock));
+    t->retired = __sync_fetch_and_add(&(s->epoch), 2);
+    if (! on_heap(s, t))
+        s->nretired++;
+}
 
+/*
+ * return the oldest retired node in the shard, and its tuple space, to
+ * the free pool; a node on the heap is simply freed
+ */
+static void reclaim_node(MBShard *s) {
+    Node *t = s->firstN;	/* least-recently allocated tuple */
+    Node *u;
+    s->firstN = t->younger;	/* unlink it from active list */
+    s->nnodes--;		/* update nodes in use */
+    if (on_heap(s, t)) {
+        s->nheap--;
+        free(t->tuple);
+        free(t);
+        return;
+    }
+    s->nbytes -= t->alloc_len;	/* update bytes allocated */
+    s->nretired--;
+    for (u = s->firstN; u && on_heap(s, u); u = u->younger)
+        ;
+    if (u)			/* oldestT now points to new oldest tuple */
+        s->oldestT = u->tuple;
+    else			/* only tuples on the heap are left */
+        s->oldestT = s->nextT = s->base;
+    t->next = s->freeN;		/* return Node to free list */
+    s->freeN = t;
 }
 
 /*
- * mb_init() - initialize the circular buffer and node free pool
+ * oldest epoch still pinned by a reader of the shard, or the current
+ * epoch if there are no readers; epochs are compared modulo 2^32
+ */
+static unsigned int pinned_epoch(MBShard *s) {
+    unsigned int e = s->epoch, p;
+    int i;
+
+    for (i = 0; i < MB_MAXPINS; i++)
+        if ((p = s->pins[i]) && (int)(p - e) < 0)
+            e = p;
+    return e;
+}
+
+/*
+ * free the oldest node in the shard, retiring it first if need be
+ *
+ * while there are readers, nodes are retired ahead, so that
+ * MB_RETIRE_AHEAD, but no more than 1/16 of the nodes in the shard, are
+ * retired; otherwise, nodes are retired only as they are needed, and the
+ * oldest rows stay in their tables for as long as possible.  Nodes on
+ * the heap give back no space in the shard, so they are not counted as
+ * retired; instead, each is made up for by retiring one more node in the
+ * shard, so that the shard holds no more rows than it would have if the
+ * inserts had waited for the readers
+ *
+ * returns 0, leaving the node retired, if a reader that may still be
+ * looking at it has pinned an epoch, or if there is no node to free
+ */
+static int free_node(MBShard *s) {
+    long ahead;
+
+    while (s->liveN && ((ahead = s->nretired - s->nheap) <= 0
+                        || (s->npins && ahead < MB_RETIRE_AHEAD
+                            && ahead < (s->nnodes - s->nheap) / 16)))
+        retire_node(s);
+    if (s->firstN == s->liveN
+            || (int)(s->firstN->retired - pinned_epoch(s)) >= 0)
+        return 0;
+    reclaim_node(s);
+    return 1;
+}
+
+/*
+ * initialize a single shard covering [base, base+size)
  *
  * initializes the dummy tuple, then generates the first block of Nodes
  * in the free pool
  */
-void mb_init() {
-    (void) pthread_mutex_lock(&mutex);
-    firstN = (Node *)lastPtr;	/* least recently allocated node */
-    lastN = (Node *)lastPtr;	/* most recently allocated node */
-    firstN->parent = &dTbl;	/* fill in dummy tuple and table */
-    firstN->next = NULL;
-    firstN->younger = NULL;
-    firstN->alloc_len = ALIGNMENT;
-    firstN->real_len = ALIGNMENT;
-    firstN->tuple = oldestT;
-    (void) pthread_mutex_init(&(dTbl.tb_mutex), NULL);
-    (void) pthread_mutex_lock(&(dTbl.tb_mutex));
-    append2LL(firstN, dTbl.oldest, dTbl.newest, (dTbl.newest)->next, dTbl.count);
-    (void) pthread_mutex_unlock(&(dTbl.tb_mutex));
-    alloc_block(1);	/* allocate initial tranche of Nodes */
-    (void) pthread_mutex_unlock(&mutex);
+static void shard_init(MBShard *s, unsigned char *base, long size) {
+    memset(&(s->dTbl), 0, sizeof(Table));
+    (void) pthread_mutex_init(&(s->mutex), NULL);
+    (void) pthread_mutex_lock(&(s->mutex));
+    s->base = base;
+    s->size = size;
+    s->oldestT = base;
+    s->nextT = base + ALIGNMENT;
+    s->nbytes = ALIGNMENT;
+    s->lastIndex = size - ALIGNED_NODE_SIZE;
+    s->lastPtr = base + s->lastIndex;
+    s->partitionFixed = 0;
+    s->freeN = NULL;
+    s->nnodes = 1L;
+    s->passes = 0L;
+    s->lastTs = 0;
+    s->nheap = 0L;
+    s->epoch = 1;
+    memset((void *)s->pins, 0, sizeof(s->pins));
+    s->npins = 0;
+    s->firstN = (Node *)s->lastPtr;	/* least recently allocated node */
+    s->liveN = s->firstN;
+    s->nretired = 0L;
+    s->lastN = (Node *)s->lastPtr;	/* most recently allocated node */
+    s->firstN->parent = &(s->dTbl);	/* fill in dummy tuple and table */
+    s->firstN->next = NULL;
+    s->firstN->younger = NULL;
+    s->firstN->alloc_len = ALIGNMENT;
+    s->firstN->real_len = ALIGNMENT;
+    s->firstN->tuple = s->oldestT;
+    s->dTbl.oldest = NULL;
+    s->dTbl.newest = NULL;
+    s->dTbl.count = 0;
+    table_lock_init(&(s->dTbl));
+    (void) pthread_rwlock_wrlock(&(s->dTbl.tb_lock));
+    append2LL(s->firstN, s->dTbl.oldest, s->dTbl.newest, (s->dTbl.newest)->next, s->dTbl.count);
+    (void) pthread_rwlock_unlock(&(s->dTbl.tb_lock));
+    alloc_block(s, 1);	/* allocate initial tranche of Nodes */
+    (void) pthread_mutex_unlock(&(s->mutex));
 }
 
 /*
- * mb_insert - insert buffer into the circular buffer
+ * map the buffer, honouring the huge page and prefault flags
  *
- * return 1 if successful, 0 if not
+ * explicit huge pages are tried first if requested; if the kernel has none
+ * to give, fall back to normal pages with a transparent huge page hint
+ *
+ * returns the address of the mapping, or NULL on failure
  */
-int mb_insert(unsigned char *buf, long len, Table *tb) {
-    Node *n;
-    unsigned short alloc_len = ((len - 1) / ALIGNMENT + 1) * ALIGNMENT;
-    unsigned char *t;
-    struct timeval tv;
-    (void) pthread_mutex_lock(&mutex);
-    while (!(n = alloc_node()))
-        free_node();			/* free up oldest node */
+static unsigned char *map_buffer(long *size, int flags) {
+    void *p = MAP_FAILED;
+    int mflags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    long sz = *size;
+
+#ifdef MAP_POPULATE
+    if (flags & MB_PREFAULT)
+        mflags |= MAP_POPULATE;
+#endif /* MAP_POPULATE */
+#ifdef MAP_HUGETLB
+    if (flags & MB_HUGEPAGES_EXPLICIT) {
+        long hsz = ((sz - 1) / MB_HUGEPAGE_SIZE + 1) * MB_HUGEPAGE_SIZE;
+        /* no MAP_NORESERVE, so we fail now rather than SIGBUS later */
+        p = mmap(NULL, hsz, PROT_READ | PROT_WRITE,
+                 (mflags & ~MAP_NORESERVE) | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+            sz = hsz;
+        else {
+            fprintf(stderr, "mb: explicit huge pages unavailable, using transparent huge pages\n");
+            flags |= MB_HUGEPAGES_TRANSPARENT;
+        }
+    }
+#else
+    if (flags & MB_HUGEPAGES_EXPLICIT)
+        flags |= MB_HUGEPAGES_TRANSPARENT;
+#endif /* MAP_HUGETLB */
+    if (p == MAP_FAILED) {
+        p = mmap(NULL, sz, PROT_READ | PROT_WRITE, mflags, -1, 0);
+        if (p == MAP_FAILED)
+            return NULL;
+#ifdef MADV_HUGEPAGE
+        if (flags & MB_HUGEPAGES_TRANSPARENT)
+            (void) madvise(p, sz, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+    }
+#ifndef MAP_POPULATE
+    if (flags & MB_PREFAULT) {
+        long i, pg = sysconf(_SC_PAGESIZE);
+        for (i = 0; i < sz; i += pg)
+            ((volatile unsigned char *)p)[i] = 0;
+    }
+#endif /* MAP_POPULATE */
+    *size = sz;
+    return (unsigned char *)p;
+}
+
+/*
+ * fill in the structure sizes that must match for a file to be reused
+ */
+static void layout(int *l) {
+    l[0] = (int)ALIGNMENT;
+    l[1] = (int)sizeof(Node);
+    l[2] = (int)sizeof(Table);
+    l[3] = (int)sizeof(MBShard);
+}
+
+/*
+ * bytes needed in a file ahead of the buffer proper, rounded up to a page
+ */
+static long header_size(int nsh) {
+    long pg = sysconf(_SC_PAGESIZE);
+    long n = sizeof(MBHeader);
+    n = (n + 63) / 64 * 64 + nsh * sizeof(MBShard);
+    n = (n + 63) / 64 * 64 + MB_CATALOG_TABLES * sizeof(MBCatEntry);
+    return (n - 1) / pg * pg + pg;
+}
+
+/*
+ * write len bytes from buf at offset off in fd, coping with short writes
+ *
+ * returns 1 if successful, 0 otherwise
+ */
+static int write_all(int fd, unsigned char *buf, long len, off_t off) {
+    ssize_t n;
+    while (len > 0) {
+        n = pwrite(fd, buf, len, off);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        buf += n;
+        off += n;
+        len -= n;
+    }
+    return 1;
+}
+
+/*
+ * map the buffer from a file, reusing the previous contents if the file
+ * was cleanly written by a compatible build and can be mapped at the same
+ * address as before
+ *
+ * returns 1 if successful, 0 otherwise
+ */
+static int map_file(char *file, long size, int nsh, int flags) {
+    MBHeader h;
+    int l[4];
+    long hsize = header_size(nsh);
+    long mapsize = hsize + size;
+    int mflags = MAP_PRIVATE;
+    unsigned char *p = MAP_FAILED;
+    int i;
+
+#ifdef MAP_POPULATE
+    if (flags & MB_PREFAULT)
+        mflags |= MAP_POPULATE;
+#endif /* MAP_POPULATE */
+    if ((mbfd = open(file, O_RDWR | O_CREAT, 0644)) < 0) {
+        fprintf(stderr, "mb: unable to open memory buffer file %s\n", file);
+        return 0;
+    }
+    mbowner = getpid();
+    layout(l);
+    if (pread(mbfd, &h, sizeof(h), 0) == sizeof(h) && h.magic == MB_MAGIC
+            && h.version == MB_VERSION && h.clean && h.mapsize == mapsize
+            && h.nshards == nsh && memcmp(h.layout, l, sizeof(l)) == 0) {
+#ifdef MAP_FIXED_NOREPLACE
+        p = mmap(h.base, mapsize, PROT_READ | PROT_WRITE,
+                 mflags | MAP_FIXED_NOREPLACE, mbfd, 0);
+#else
+        p = mmap(h.base, mapsize, PROT_READ | PROT_WRITE, mflags, mbfd, 0);
+#endif /* MAP_FIXED_NOREPLACE */
+        if (p != MAP_FAILED && p != h.base) {
+            (void) munmap(p, mapsize);
+            p = MAP_FAILED;
+        }
+        if (p == MAP_FAILED)
+            fprintf(stderr, "mb: unable to map %s at %p, starting empty\n",
+                    file, (void *)h.base);
+    } else if (pread(mbfd, &h, sizeof(h), 0) > 0)
+        fprintf(stderr, "mb: %s unusable, starting empty\n", file);
+    restored = (p != MAP_FAILED);
+    if (! restored) {
+        if (ftruncate(mbfd, 0) < 0 || ftruncate(mbfd, mapsize) < 0) {
+            fprintf(stderr, "mb: unable to size %s to %ld bytes\n", file, mapsize);
+            goto fail;
+        }
+        p = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, mflags, mbfd, 0);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "mb: unable to map %s\n", file);
+            goto fail;
+        }
+    }
+#ifdef MADV_HUGEPAGE
+    if (flags & (MB_HUGEPAGES_TRANSPARENT | MB_HUGEPAGES_EXPLICIT))
+        (void) madvise(p, mapsize, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+    hdr = (MBHeader *)p;
+    shards = (MBShard *)(p + (sizeof(MBHeader) + 63) / 64 * 64);
+    catalog = (MBCatEntry *)((unsigned char *)shards
+                             + (nsh * sizeof(MBShard) + 63) / 64 * 64);
+    mb = p + hsize;
+    mbsize = size;
+    nshards = nsh;
+    if (restored) {
+        for (i = 0; i < nshards; i++) {
+            (void) pthread_mutex_init(&(shards[i].mutex), NULL);
+            table_lock_init(&(shards[i].dTbl));
+            /* no readers survive a restart */
+            memset((void *)shards[i].pins, 0, sizeof(shards[i].pins));
+            shards[i].npins = 0;
+            while (shards[i].firstN != shards[i].liveN)
+                reclaim_node(&shards[i]);
+        }
+        nextShard = hdr->nextShard;
+    } else {
+        long shardsize = (size / nsh / ALIGNMENT) * ALIGNMENT;
+        hdr->magic = MB_MAGIC;
+        hdr->version = MB_VERSION;
+        hdr->base = p;
+        hdr->mapsize = mapsize;
+        hdr->size = size;
+        hdr->nshards = nsh;
+        memcpy(hdr->layout, l, sizeof(l));
+        for (i = 0; i < nshards; i++)
+            shard_init(&shards[i], mb + i * shardsize, shardsize);
+    }
+    /* until we shut down cleanly, the file on disk is not reusable */
+    hdr->clean = 0;
+    if (! write_all(mbfd, (unsigned char *)hdr, sizeof(MBHeader), 0)
+            || fdatasync(mbfd) < 0) {
+        fprintf(stderr, "mb: unable to write header of %s\n", file);
+        (void) munmap(p, mapsize);
+        goto fail;
+    }
+    return 1;
+fail:
+    (void) close(mbfd);
+    mbfd = -1;
+    hdr = NULL;
+    catalog = NULL;
+    shards = NULL;
+    mb = NULL;
+    return 0;
+}
+
+/*
+ * mb_init() - initialize the circular buffer and node free pools
+ *
+ * if mbc is NULL, or any of its members is 0, the compiled-in defaults
+ * are used
+ *
+ * maps the buffer, carves it into shards and initializes each of them;
+ * if a file is specified in mbc, the buffer is mapped from that file and
+ * its previous contents are reused if possible - see mb_restore_tables()
+ *
+ * returns 1 if successful, 0 if the buffer could not be mapped
+ */
+int mb_init(MBConfig *mbc) {
+    long size = (mbc && mbc->size) ? mbc->size : (long)MB_SIZE;
+    int flags = mbc ? mbc->flags : 0;
+    long shardsize;
+    int i;
+
+    nshards = (mbc && mbc->nshards > 0) ? mbc->nshards : MB_NSHARDS;
+    if (size / nshards < MB_MIN_SHARD_SIZE) {
+        nshards = size / MB_MIN_SHARD_SIZE;
+        if (nshards < 1) {
+            nshards = 1;
+            size = MB_MIN_SHARD_SIZE;
+        }
+        fprintf(stderr, "mb: buffer too small, reducing to %d shard(s)\n", nshards);
+    }
+    if (mbc && mbc->file)
+        return map_file(mbc->file, size, nshards, flags);
+    if (!(mb = map_buffer(&size, flags))) {
+        fprintf(stderr, "mb: unable to map %ld bytes for the memory buffer\n", size);
+        return 0;
+    }
+    mbsize = size;
+    shards = (MBShard *)malloc(nshards * sizeof(MBShard));
+    if (!shards) {
+        (void) munmap(mb, mbsize);
+        mb = NULL;
+        return 0;
+    }
+    shardsize = (size / nshards / ALIGNMENT) * ALIGNMENT;
+    for (i = 0; i < nshards; i++)
+        shard_init(&shards[i], mb + i * shardsize, shardsize);
+    return 1;
+}
+
+/*
+ * mb_has_catalog() - returns 1 if stream tables must be created with
+ * mb_catalog_add(), 0 if they can be allocated anywhere
+ */
+int mb_has_catalog() {
+    return (catalog != NULL);
+}
+
+/*
+ * mb_catalog_add() - allocate and initialize a stream table in the
+ * catalog of the memory buffer file
+ *
+ * returns the table, or NULL if the catalog is full or the table is too
+ * big to be described in it
+ */
+Table *mb_catalog_add(char *name, int ncols, char **colnames, int **coltypes) {
+    MBCatEntry *e = NULL;
+    char *p;
+    int i, len;
+
+    if (!catalog)
+        return NULL;
+    if (strlen(name) >= MB_CATALOG_NAMELEN || ncols > MB_CATALOG_MAXCOLS) {
+        errorf("Table %s too big for memory buffer catalog\n", name);
+        return NULL;
+    }
+    for (i = 0, len = 0; i < ncols; i++)
+        len += strlen(colnames[i]) + 1;
+    if (len > MB_CATALOG_COLBYTES) {
+        errorf("Column names of %s too long for memory buffer catalog\n", name);
+        return NULL;
+    }
+    (void) pthread_mutex_lock(&shardlock);
+    for (i = 0; i < MB_CATALOG_TABLES; i++)
+        if (! catalog[i].inuse) {
+            e = &catalog[i];
+            break;
+        }
+    if (e) {
+        strcpy(e->name, name);
+        e->ncols = ncols;
+        for (i = 0, p = e->colnames; i < ncols; i++) {
+            e->coltype[i] = (unsigned char)*coltypes[i];
+            strcpy(p, colnames[i]);
+            p += strlen(p) + 1;
+        }
+        table_init(&(e->table), ncols, colnames, coltypes);
+        e->inuse = 1;
+    }
+    (void) pthread_mutex_unlock(&shardlock);
+    if (!e) {
+        errorf("Memory buffer catalog is full\n");
+        return NULL;
+    }
+    return &(e->table);
+}
+
+/*
+ * mb_restore_tables() - if the memory buffer file was reused, hand each of
+ * the stream tables in its catalog to restore(); the tables have been
+ * re-initialized, with their rows intact
+ *
+ * returns the number of tables restored
+ */
+int mb_restore_tables(void (*restore)(char *name, Table *tn)) {
+    char *colnames[MB_CATALOG_MAXCOLS];
+    int *coltypes[MB_CATALOG_MAXCOLS];
+    MBCatEntry *e;
+    char *p;
+    int i, j, n = 0;
+
+    if (!catalog || !restored)
+        return 0;
+    for (i = 0; i < MB_CATALOG_TABLES; i++) {
+        e = &catalog[i];
+        if (! e->inuse)
+            continue;
+        for (j = 0, p = e->colnames; j < e->ncols; j++) {
+            colnames[j] = p;
+            coltypes[j] = &primtype_val[e->coltype[j]];
+            p += strlen(p) + 1;
+        }
+        table_restore(&(e->table), e->ncols, colnames, coltypes);
+        restore(e->name, &(e->table));
+        n++;
+    }
+    return n;
+}
+
+/*
+ * remove the rows on the heap from a shard, which cannot be written to
+ * the file; they are the rows inserted while a reader held up the shard,
+ * so there are rarely any
+ *
+ * must be called with the shard mutex held; returns 0 if a reader still
+ * holds rows of the shard
+ */
+static int drop_heap_nodes(MBShard *s) {
+    Node *t, *p = NULL, *u;
+    Table *tb;
+    long n = s->nheap;
+
+    if (! n)
+        return 1;
+    while (s->firstN != s->liveN)
+        if ((int)(s->firstN->retired - pinned_epoch(s)) >= 0)
+            return 0;
+        else
+            reclaim_node(s);
+    for (t = s->firstN; t; t = u) {
+        u = t->younger;
+        if (! on_heap(s, t)) {
+            p = t;
+            continue;
+        }
+        if (p)				/* unlink it from the age list */
+            p->younger = u;
+        else
+            s->firstN = u;
+        if (s->liveN == t)
+            s->liveN = u;
+        if (s->lastN == t)
+            s->lastN = p;
+        tb = t->parent;			/* and from its table */
+        (void) pthread_rwlock_wrlock(&(tb->tb_lock));
+        table_index_remove(tb, t);
+        table_ts_remove(tb, t);
+        if (t->prev)
+            t->prev->next = t->next;
+        else
+            tb->oldest = t->next;
+        if (t->next)
+            t->next->prev = t->prev;
+        else
+            tb->newest = t->prev;
+        tb->count--;
+        tb->nbytes -= t->alloc_len;
+        (void) pthread_rwlock_unlock(&(tb->tb_lock));
+        s->nnodes--;
+        s->nheap--;
+        free(t->tuple);
+        free(t);
+    }
+    fprintf(stderr, "mb: %ld rows inserted while readers held up a shard not saved\n", n);
+    return 1;
+}
+
+/*
+ * mb_detach() - drop the file backing the buffer in a forked copy of the
+ * process, whose buffer is a private copy that goes stale as the parent
+ * carries on; the file is left to the parent, and mb_shutdown() in the
+ * copy does not write it
+ */
+void mb_detach() {
+    if (mbfd < 0)
+        return;
+    (void) close(mbfd);
+    mbfd = -1;
+}
+
+/*
+ * mb_shutdown() - if the buffer is backed by a file, write it back and
+ * mark it clean, so that it will be reused by the next mb_init()
+ *
+ * if any shard or table is busy, the file is left marked unclean and will
+ * be discarded on restart
+ *
+ * returns 1 if the file was written (or there is no file), 0 otherwise
+ */
+int mb_shutdown() {
+    int i, j, k, ok = 0;
+
+    if (mbfd >= 0 && getpid() != mbowner) {
+        fprintf(stderr, "mb: not saving the memory buffer of another process\n");
+        mb_detach();
+    }
+    if (mbfd < 0)
+        return 1;
+    for (i = 0; i < nshards; i++)
+        if (pthread_mutex_trylock(&(shards[i].mutex)))
+            break;
+        else if (! drop_heap_nodes(&shards[i])) {
+            (void) pthread_mutex_unlock(&(shards[i].mutex));
+            break;
+        }
+    for (j = 0; i == nshards && j < MB_CATALOG_TABLES; j++)
+        if (catalog[j].inuse && pthread_rwlock_trywrlock(&(catalog[j].table.tb_lock)))
+            break;
+    if (i == nshards && j == MB_CATALOG_TABLES) {
+        hdr->nextShard = nextShard;
+        if (write_all(mbfd, (unsigned char *)hdr, hdr->mapsize, 0)
+                && fdatasync(mbfd) == 0) {
+            hdr->clean = 1;
+            ok = write_all(mbfd, (unsigned char *)hdr, sizeof(MBHeader), 0)
+                 && fdatasync(mbfd) == 0;
+            hdr->clean = 0;
+        }
+    }
+    for (k = 0; k < j; k++)
+        if (catalog[k].inuse)
+            (void) pthread_rwlock_unlock(&(catalog[k].table.tb_lock));
+    for (k = 0; k < i; k++)
+        (void) pthread_mutex_unlock(&(shards[k].mutex));
+    return ok;
+}
+
+/*
+ * mb_pin() - pin the current epoch of the shard of a stream table, so
+ * that no row that is in a table of the shard when the pin is taken is
+ * reused until it is released
+ *
+ * must be called with the table to be read locked; once pinned, the table
+ * can be unlocked and its rows read, following next pointers, until the
+ * pin is released with mb_unpin().  A reader should not keep a pin for
+ * long, since the rows inserted into the shard meanwhile may have to be
+ * put on the heap
+ *
+ * returns the pin, or -1 if too many readers have pinned epochs already
+ */
+int mb_pin(Table *tb) {
+    MBShard *s = &shards[tb->shard];
+    unsigned int e = s->epoch;
+    int i;
+
+    for (i = 0; i < MB_MAXPINS; i++)
+        if (! s->pins[i] && __sync_bool_compare_and_swap(&(s->pins[i]), 0, e)) {
+            (void) __sync_fetch_and_add(&(s->npins), 1);
+            return i;
+        }
+    return -1;
+}
+
+/*
+ * mb_repin() - move a pin on to the current epoch, letting go of the rows
+ * retired since it was taken; must be called with the table locked, as
+ * for mb_pin()
+ */
+void mb_repin(Table *tb, int pin) {
+    MBShard *s = &shards[tb->shard];
+
+    s->pins[pin] = s->epoch;
+    __sync_synchronize();
+}
+
+/*
+ * mb_unpin() - release a pin obtained from mb_pin()
+ */
+void mb_unpin(Table *tb, int pin) {
+    MBShard *s = &shards[tb->shard];
+
+    if (pin >= 0) {
+        (void) __sync_fetch_and_sub(&(s->npins), 1);
+        __sync_lock_release(&(s->pins[pin]));
+    }
+}
+
+/*
+ * mb_next_shard() - select the shard for a newly-created table
+ *
+ * tables are spread over the shards round-robin
+ */
+int mb_next_shard() {
+    int i;
+    (void) pthread_mutex_lock(&shardlock);
+    i = nextShard++ % nshards;
+    (void) pthread_mutex_unlock(&shardlock);
+    return i;
+}
+
+/*
+ * allocate a node and a tuple of alloc_len bytes on the heap, for a
+ * tuple that cannot have the space of the oldest tuple in the shard yet
+ *
+ * returns NULL if out of memory, when there is nothing for it but to
+ * wait for the readers of the shard to move on
+ */
+static Node *heap_alloc(MBShard *s, unsigned short alloc_len, unsigned char **tp) {
+    Node *n = malloc(sizeof(Node));
+
+    if (n && (*tp = malloc(alloc_len))) {
+        s->nheap++;
+        return n;
+    }
+    free(n);
+    printf("Out of memory\n");
+    (void) sched_yield();
+    return NULL;
+}
+
+/*
+ * obtain space in the shard for a tuple of alloc_len bytes, evicting
+ * the oldest tuples in the shard as necessary
+ *
+ * if the oldest tuple cannot be evicted because a reader may still be
+ * looking at it, the node and tuple are allocated on the heap instead,
+ * and freed in turn when they are the oldest in the shard; the shard
+ * itself is used again as soon as the reader has moved on
+ *
+ * must be called with the shard mutex held
+ *
+ * returns the node, and the tuple address in *tp
+ */
+static Node *shard_alloc(MBShard *s, unsigned short alloc_len, unsigned char **tp) {
+    Node *n, *h;
+    while (!(n = alloc_node(s)))	/* free up oldest node */
+        if (! free_node(s) && (h = heap_alloc(s, alloc_len, tp)))
+            return h;
     for (;;) {
-        if (oldestT < nextT) {		/* oldestT behind nextT */
-            if ((nextT + alloc_len) >= lastPtr) {
-                free_node();	/* oldest node must be at mb or later */
-                nextT = mb;	/* reset pointer */
-                passes++;
+        if (s->oldestT < s->nextT || ! s->nbytes) {	/* oldestT behind nextT, or none */
+            if ((s->nextT + alloc_len) >= s->lastPtr) {
+                (void) free_node(s);	/* oldest node must be at base or later */
+                s->nextT = s->base;	/* reset pointer */
+                s->passes++;
             } else
                 break; /* OK */
         } else {		/* oldestT behind nextT */
-            if ((nextT + alloc_len >= oldestT)) {
-                free_node();
+            if ((s->nextT + alloc_len >= s->oldestT)) {
+                if (! free_node(s) && (h = heap_alloc(s, alloc_len, tp))) {
+                    n->next = s->freeN;	/* keep the node for later */
+                    s->freeN = n;
+                    return h;
+                }
             } else
                 break;	/* OK */
         }
     }
     /*
      * at this point, we have a node (n) and nextT points at location in
-     * buffer big enough to hold the tuple
+     * shard big enough to hold the tuple
      */
-    t = nextT;
-    nextT += alloc_len;		/* now point at next free location */
-    nbytes += alloc_len;	/* update the bytes in use counter */
-    n->parent = tb;		/* fill in node member data */
-    n->next = NULL;
-    n->prev = NULL;
-    n->younger = NULL;
-    n->alloc_len = alloc_len;
-    n->real_len = (unsigned short)len;
-    n->tuple = t;
-    (void) gettimeofday(&tv, NULL);		/* timestamp the tuple */
-    n->tstamp = timeval_to_timestamp(&tv);
-    memcpy(t, buf, len);	/* copy buf to t */
-    append2LL(n, firstN, lastN, lastN->younger, nnodes);
-    (void) pthread_mutex_lock(&(tb->tb_mutex));
+    *tp = s->nextT;
+    s->nextT += alloc_len;	/* now point at next free location */
+    s->nbytes += alloc_len;	/* update the bytes in use counter */
+    return n;
+}
+
+/*
+ * link a filled-in node onto the shard's age list and the table's list
+ *
+ * must be called with the shard mutex held
+ */
+static void shard_link(MBShard *s, Node *n, Table *tb) {
+    append2LL(n, s->firstN, s->lastN, s->lastN->younger, s->nnodes);
+    if (! s->liveN)
+        s->liveN = n;
+    (void) pthread_rwlock_wrlock(&(tb->tb_lock));
     if ((tb->count)++) {	/* list was not empty */
         tb->newest->next = n;
         n->prev = tb->newest;
@@ -279,55 +1084,148 @@ int mb_insert(unsigned char *buf, long len, Table *tb) {
         tb->newest = n;
         tb->oldest = n;
     }
-    (void) pthread_mutex_unlock(&(tb->tb_mutex));
-    (void) pthread_mutex_unlock(&mutex);
+    tb->nbytes += n->alloc_len;
+    table_ts_append(tb, n);
+    table_index_add(tb, n);
+    (void) pthread_rwlock_unlock(&(tb->tb_lock));
+}
 
-    return 1;
+/*
+ * returns 1 if the oldest row of a table with a retention policy should
+ * be dropped, 0 if it is within the policy
+ */
+static int retain_exceeded(Table *tb, Node *oldest, tstamp_t horizon) {
+    switch (tb->retain) {
+    case SQL_RETAIN_ROWS:
+        return (tb->count > tb->retain_limit);
+    case SQL_RETAIN_MILLIS:
+        return (oldest->tstamp < horizon);
+    case SQL_RETAIN_BYTES:
+        return (tb->nbytes > tb->retain_limit);
+    }
+    return 0;
 }
 
 /*
- * mb_insert_tuple - insert tuple into the circular buffer
+ * timestamp for the next tuple in the shard; timestamps within a shard,
+ * and hence within a table, are strictly increasing even if the clock
+ * has not moved on since the last insert
  *
- * return timestamp if successful, (tstamp_t)0 if not
+ * must be called with the shard mutex held
  */
-tstamp_t mb_insert_tuple(int ncols, char *vals[], Table *tb) {
+static tstamp_t shard_stamp(MBShard *s, tstamp_t now) {
+    if (now <= s->lastTs)
+        now = s->lastTs + 1;
+    return (s->lastTs = now);
+}
+
+/*
+ * allocate a node and tuple on the heap and fill them in, apart from the
+ * timestamp
+ */
+static Node *heap_node(int ncols, char *vals[], Table *tb) {
     Node *n;
-    int len = ncols * sizeof(char *);
-    int i;
+    unsigned char *t;
     unsigned short alloc_len;
-    unsigned char *t, *s;
-    union Tuple *p;
-    struct timeval tv;
-    tstamp_t ts;
+    int len = tuple_size(ncols, vals, tb->coltype);
 
-    for (i = 0; i < ncols; i++)
-        len += strlen(vals[i]) + 1;
     alloc_len = ((len - 1) / ALIGNMENT + 1) * ALIGNMENT;
-    (void) pthread_mutex_lock(&mutex);
-    while (!(n = alloc_node()))
-        free_node();			/* free up oldest node */
-    for (;;) {
-        if (oldestT < nextT) {		/* oldestT behind nextT */
-            if ((nextT + alloc_len) >= lastPtr) {
-                free_node();	/* oldest node must be at mb or later */
-                nextT = mb;	/* reset pointer */
-                passes++;
-            } else
-                break; /* OK */
-        } else {		/* oldestT behind nextT */
-            if ((nextT + alloc_len >= oldestT)) {
-                free_node();
-            } else
-                break;	/* OK */
+    n = malloc(sizeof(Node));
+    if (!n) {
+        printf("Out of memory\n");
+        return NULL;
+    }
+    t = malloc(alloc_len);
+    if (!t) {
+        printf("Out of memory\n");
+        free(n);
+        return NULL;
+    }
+    n->parent = tb;
+    n->next = NULL;
+    n->prev = NULL;
+    n->younger = NULL;
+    n->alloc_len = alloc_len;
+    n->real_len = (unsigned short) len;
+    n->tuple = t;
+    n->tstamp = 0;
+    tuple_encode(t, ncols, vals, tb->coltype);
+    return n;
+}
+
+/*
+ * append heap-allocated nodes to a table with a retention policy, giving
+ * each a timestamp later than that of the table's newest row, then drop
+ * the table's oldest rows until it is back within the policy; the newest
+ * row is always kept
+ *
+ * the timestamps assigned are returned in ts[]
+ */
+static void retain_link(Table *tb, Node *nodes[], int nrows, tstamp_t now,
+                        tstamp_t ts[]) {
+    Node *n, *u;
+    tstamp_t horizon = 0;
+    int i;
+
+    (void) pthread_rwlock_wrlock(&(tb->tb_lock));
+    for (i = 0; i < nrows; i++) {
+        n = nodes[i];
+        if (tb->newest && now <= tb->newest->tstamp)
+            now = tb->newest->tstamp + 1;
+        ts[i] = n->tstamp = now;
+        if ((tb->count)++) {	/* list was not empty */
+            tb->newest->next = n;
+            n->prev = tb->newest;
+            tb->newest = n;
+        } else {
+            tb->newest = n;
+            tb->oldest = n;
         }
+        tb->nbytes += n->alloc_len;
+        table_ts_append(tb, n);
+        table_index_add(tb, n);
     }
-    /*
-     * at this point, we have a node (n) and nextT points at location in
-     * buffer big enough to hold the tuple
-     */
-    t = nextT;
-    nextT += alloc_len;		/* now point at next free location */
-    nbytes += alloc_len;	/* update the bytes in use counter */
+    if (tb->retain == SQL_RETAIN_MILLIS)
+        horizon = timestamp_sub_incr(now, (unsigned long)tb->retain_limit, 1);
+    while ((u = tb->oldest) != tb->newest && retain_exceeded(tb, u, horizon)) {
+        table_ts_evict(tb, u);
+        heap_remove_node(u, tb);
+    }
+    (void) pthread_rwlock_unlock(&(tb->tb_lock));
+}
+
+/*
+ * mb_insert - insert buffer into the table's shard of the circular buffer
+ *
+ * return 1 if successful, 0 if not
+ */
+int mb_insert(unsigned char *buf, long len, Table *tb) {
+    Node *n;
+    unsigned short alloc_len = ((len - 1) / ALIGNMENT + 1) * ALIGNMENT;
+    unsigned char *t;
+    struct timeval tv;
+    tstamp_t ts;
+    MBShard *s = &shards[tb->shard];
+    (void) gettimeofday(&tv, NULL);		/* timestamp the tuple */
+    if (table_retained(tb)) {
+        if (!(n = malloc(sizeof(Node))) || !(t = malloc(alloc_len))) {
+            free(n);
+            printf("Out of memory\n");
+            return 0;
+        }
+        n->parent = tb;
+        n->next = NULL;
+        n->prev = NULL;
+        n->younger = NULL;
+        n->alloc_len = alloc_len;
+        n->real_len = (unsigned short)len;
+        n->tuple = t;
+        memcpy(t, buf, len);
+        retain_link(tb, &n, 1, timeval_to_timestamp(&tv), &ts);
+        return 1;
+    }
+    (void) pthread_mutex_lock(&(s->mutex));
+    n = shard_alloc(s, alloc_len, &t);
     n->parent = tb;		/* fill in node member data */
     n->next = NULL;
     n->prev = NULL;
@@ -335,48 +1233,105 @@ tstamp_t mb_insert_tuple(int ncols, char *vals[], Table *tb) {
     n->alloc_len = alloc_len;
     n->real_len = (unsigned short)len;
     n->tuple = t;
-    (void) gettimeofday(&tv, NULL);		/* timestamp the tuple */
-    ts = timeval_to_timestamp(&tv);
-    n->tstamp = ts;
-    p = (union Tuple *)t;
-    t += ncols * sizeof(char *);
-    for (i = 0; i < ncols; i++) {
-        p->ptrs[i] = (char *)t;
-        s = (unsigned char *)vals[i];
-        while ((*t++ = *s++))
-            ;
-    }
-    append2LL(n, firstN, lastN, lastN->younger, nnodes);
-    (void) pthread_mutex_lock(&(tb->tb_mutex));
-    if ((tb->count)++) {	/* list was not empty */
-        tb->newest->next = n;
-        n->prev = tb->newest;
-        tb->newest = n;
-    } else {
-        tb->newest = n;
-        tb->oldest = n;
+    n->tstamp = shard_stamp(s, timeval_to_timestamp(&tv));
+    memcpy(t, buf, len);	/* copy buf to t */
+    shard_link(s, n, tb);
+    (void) pthread_mutex_unlock(&(s->mutex));
+
+    return 1;
+}
+
+/*
+ * mb_insert_tuple - insert tuple into the table's shard of the circular
+ * buffer, or onto the heap if the table has a retention policy
+ *
+ * return timestamp if successful, (tstamp_t)0 if not
+ */
+tstamp_t mb_insert_tuple(int ncols, char *vals[], Table *tb) {
+    return mb_insert_tuples(1, ncols, &vals, tb, NULL);
+}
+
+/*
+ * mb_insert_tuples - insert nrows tuples, each of ncols columns, into a
+ * table as one batch
+ *
+ * the clock is read once and the shard (or, for a table with a retention
+ * policy, the table) is locked once for the whole batch; the rows are
+ * given strictly increasing timestamps, which are returned in ts[] if it
+ * is not NULL
+ *
+ * return timestamp of the last row if successful, (tstamp_t)0 if not
+ */
+tstamp_t mb_insert_tuples(int nrows, int ncols, char **vals[], Table *tb,
+                          tstamp_t ts[]) {
+    Node *n, **nodes;
+    int i, len;
+    unsigned short alloc_len;
+    unsigned char *t;
+    struct timeval tv;
+    tstamp_t now, last = 0;
+    MBShard *sh = &shards[tb->shard];
+
+    if (nrows <= 0)
+        return (tstamp_t)0;
+    (void) gettimeofday(&tv, NULL);		/* timestamp the batch */
+    now = timeval_to_timestamp(&tv);
+    if (table_retained(tb)) {
+        tstamp_t one;
+        if (!(nodes = malloc(nrows * sizeof(Node *))))
+            return (tstamp_t)0;
+        for (i = 0; i < nrows; i++)
+            if (!(nodes[i] = heap_node(ncols, vals[i], tb)))
+                break;
+        if (i == nrows) {
+            retain_link(tb, nodes, nrows, now, (ts) ? ts : &one);
+            last = nodes[nrows - 1]->tstamp;
+        } else
+            while (--i >= 0) {
+                free(nodes[i]->tuple);
+                free(nodes[i]);
+            }
+        free(nodes);
+        return last;
+    }
+    (void) pthread_mutex_lock(&(sh->mutex));
+    for (i = 0; i < nrows; i++) {
+        len = tuple_size(ncols, vals[i], tb->coltype);
+        alloc_len = ((len - 1) / ALIGNMENT + 1) * ALIGNMENT;
+        n = shard_alloc(sh, alloc_len, &t);
+        n->parent = tb;		/* fill in node member data */
+        n->next = NULL;
+        n->prev = NULL;
+        n->younger = NULL;
+        n->alloc_len = alloc_len;
+        n->real_len = (unsigned short)len;
+        n->tuple = t;
+        n->tstamp = last = shard_stamp(sh, now);
+        if (ts)
+            ts[i] = last;
+        tuple_encode(t, ncols, vals[i], tb->coltype);
+        shard_link(sh, n, tb);
     }
-    (void) pthread_mutex_unlock(&(tb->tb_mutex));
-    (void) pthread_mutex_unlock(&mutex);
+    (void) pthread_mutex_unlock(&(sh->mutex));
 
-    return ts;
+    return last;
 }
 
-tstamp_t heap_insert_tuple(int ncols, char *vals[], Table *tb, Node *node) {
+/*
+ * appends a row to a persistent table; a row with the key of an existing
+ * one replaces it if transform is set, and is refused if not, the key
+ * being looked up under the same write lock as the row is put in
+ */
+tstamp_t heap_insert_tuple(int ncols, char *vals[], Table *tb, int transform) {
 
-    Node *n;
+    Node *n, *node;
     struct timeval tv;
     tstamp_t ts;
 
-    int i;
-
-    unsigned char *t, *s, *buf;
-    union Tuple *p;
+    unsigned char *buf;
 
     unsigned short alloc_len;
-    int len = ncols * sizeof(char *);
-    for (i = 0; i < ncols; i++)
-        len += strlen(vals[i]) + 1;
+    int len = tuple_size(ncols, vals, tb->coltype);
     alloc_len = ((len - 1) / ALIGNMENT + 1) * ALIGNMENT;
 
     buf = malloc(alloc_len);
@@ -384,28 +1339,31 @@ tstamp_t heap_insert_tuple(int ncols, char *vals[], Table *tb, Node *node) {
         printf("Out of memory\n");
         return (tstamp_t)0;
     };
-    if (! (n = node)) {
-        n = malloc(sizeof(Node));
-        if (!n) {
-            printf("Out of memory\n");
-            free(buf);
-            return (tstamp_t)0;
-        }
+    n = malloc(sizeof(Node));
+    if (!n) {
+        printf("Out of memory\n");
+        free(buf);
+        return (tstamp_t)0;
     }
 
-    p = (union Tuple *) buf;
-    t = buf + ncols * sizeof(char *);
-    for (i = 0; i < ncols; i++) {
-        p->ptrs[i] = (char *) t;
-        s = (unsigned char *) vals[i];
-        while ((*t++ = *s++))
-            ;
-    }
+    tuple_encode(buf, ncols, vals, tb->coltype);
 
-    (void) pthread_mutex_lock(&mutex);
-    (void) pthread_mutex_lock(&(tb->tb_mutex));
-    if (node) {	/* must remove node from list & return previous tuple */
-        /* remove node from list */
+    (void) pthread_rwlock_wrlock(&(tb->tb_lock));
+    /* If the key is the timestamp, ignore under the assumption
+     * that all timestamps are unique. In any case, the new re-
+     * cord has not been assigned a timestamp yet.
+     */
+    if ((node = table_pk_lookup(tb, vals[tb->primary_column]))) {
+        debugf("Transformation %d\n", transform);
+        if (! transform) {
+            (void) pthread_rwlock_unlock(&(tb->tb_lock));
+            errorf("Insert violates primary key\n");
+            free(n);
+            free(buf);
+            return (tstamp_t)0;
+        }
+        free(n);
+        n = node;	/* must remove node from list & free previous tuple */
         if (tb->oldest == tb->newest) { /* == node */
             tb->oldest = NULL;
             tb->newest = NULL;
@@ -420,7 +1378,9 @@ tstamp_t heap_insert_tuple(int ncols, char *vals[], Table *tb, Node *node) {
             node->next->prev = node->prev;
         }
         --tb->count;
+        tb->nbytes -= node->alloc_len;
 
+        table_index_remove(tb, node);
         free(node->tuple);
     }
     /* fill in node member data */
@@ -442,8 +1402,11 @@ tstamp_t heap_insert_tuple(int ncols, char *vals[], Table *tb, Node *node) {
         tb->newest = n;
         tb->oldest = n;
     }
-    (void) pthread_mutex_unlock(&(tb->tb_mutex));
-    (void) pthread_mutex_unlock(&mutex);
+    tb->nbytes += alloc_len;
+    if (! node)		/* a replaced node keeps its key */
+        table_pk_add(tb, n);
+    table_index_add(tb, n);
+    (void) pthread_rwlock_unlock(&(tb->tb_lock));
     return ts;
 }
 
@@ -452,47 +1415,9 @@ Node *heap_alloc_node(int ncols, char *vals[], Table *tb) {
     Node *n;
     struct timeval tv;
 
-    int i;
-
-    unsigned char *t, *s;
-    union Tuple *p;
-
-    unsigned short alloc_len;
-    int len = ncols * sizeof(char *);
-    for (i = 0; i < ncols; i++)
-        len += strlen(vals[i]) + 1;
-    alloc_len = ((len - 1) / ALIGNMENT + 1) * ALIGNMENT;
-
-    n = malloc(sizeof(Node));
-    if (!n) {
-        printf("Out of memory\n");
-        return NULL;
-    }
-    t = malloc(alloc_len);
-    if (!t) {
-        printf("Out of memory\n");
-        free(n);
-        return NULL;
-    };
-
-    /* fill in node member data */
-    n->parent = tb;
-    n->next = NULL;
-    n->prev = NULL;
-    n->younger = NULL;
-    n->alloc_len = alloc_len;
-    n->real_len = (unsigned short) len;
-    n->tuple = t;
-    (void) gettimeofday(&tv, NULL); /* timestamp the tuple */
-    n->tstamp = timeval_to_timestamp(&tv);
-
-    p = (union Tuple *) t;
-    t += ncols * sizeof(char *);
-    for (i = 0; i < ncols; i++) {
-        p->ptrs[i] = (char *) t;
-        s = (unsigned char *) vals[i];
-        while ((*t++ = *s++))
-            ;
+    if ((n = heap_node(ncols, vals, tb))) {
+        (void) gettimeofday(&tv, NULL); /* timestamp the tuple */
+        n->tstamp = timeval_to_timestamp(&tv);
     }
     return n;
 }
@@ -501,6 +1426,8 @@ void heap_remove_node(Node *n, Table *tn) {
 
     union Tuple *p;
 
+    table_pk_remove(tn, n);
+    table_index_remove(tn, n);
     p = (union Tuple *)(n->tuple);
     /* remove n from list */
     if (tn->oldest == tn->newest) { /* == n */
@@ -517,21 +1444,37 @@ void heap_remove_node(Node *n, Table *tn) {
         n->next->prev = n->prev;
     }
     --tn->count;
+    tn->nbytes -= n->alloc_len;
 
     free(p);
     free(n);
 }
 
+/*
+ * mb_dump() - report usage of each shard, followed by the totals
+ */
 void mb_dump() {
     long bnodes, total, unused;
-    (void) pthread_mutex_lock(&mutex);
-    bnodes = nnodes * ALIGNED_NODE_SIZE;
-    total = nbytes + bnodes;
-    unused = MB_SIZE - total;
-    printf("bytes used for tuples = %ld\n", nbytes);
-    printf("bytes used for %ld nodes = %ld\n", nnodes, bnodes);
-    printf("average bytes per tuple = %.2f\n", (double)total / (double)nnodes);
-    printf("unused bytes in table %ld\n", unused);
-    printf("completed passes through the circular buffer %ld\n", passes);
-    (void) pthread_mutex_unlock(&mutex);
+    long tbytes = 0L, tnodes = 0L, tbnodes = 0L, tunused = 0L, tpasses = 0L;
+    int i;
+    for (i = 0; i < nshards; i++) {
+        MBShard *s = &shards[i];
+        (void) pthread_mutex_lock(&(s->mutex));
+        bnodes = (s->nnodes - s->nheap) * ALIGNED_NODE_SIZE;
+        total = s->nbytes + bnodes;
+        unused = s->size - total;
+        printf("shard %d: %ld tuple bytes, %ld nodes (%ld bytes), %ld unused, %ld passes, %ld on heap\n",
+               i, s->nbytes, s->nnodes, bnodes, unused, s->passes, s->nheap);
+        tbytes += s->nbytes;
+        tnodes += s->nnodes;
+        tbnodes += bnodes;
+        tunused += unused;
+        tpasses += s->passes;
+        (void) pthread_mutex_unlock(&(s->mutex));
+    }
+    printf("bytes used for tuples = %ld\n", tbytes);
+    printf("bytes used for %ld nodes = %ld\n", tnodes, tbnodes);
+    printf("average bytes per tuple = %.2f\n", (double)(tbytes + tbnodes) / (double)tnodes);
+    printf("unused bytes in table %ld\n", tunused);
+    printf("completed passes through the circular buffer %ld\n", tpasses);
 }
@@ -39,13 +39,44 @@
 #include "table.h"
 #include "timestamp.h"
 
-void mb_init();
+/*
+ * flags for MBConfig
+ */
+#define MB_HUGEPAGES_TRANSPARENT 0x1	/* advise kernel to use huge pages */
+#define MB_HUGEPAGES_EXPLICIT 0x2	/* map from the huge page pool */
+#define MB_PREFAULT 0x4			/* fault in the buffer at startup */
+
+/*
+ * startup configuration of the memory buffer; 0 means use the default
+ */
+typedef struct mbconfig {
+    long size;			/* number of bytes in the buffer */
+    int nshards;		/* number of shards to split it into */
+    int flags;			/* OR of the MB_ flags above */
+    char *file;			/* file backing the buffer, if any */
+} MBConfig;
+
+int mb_init(MBConfig *mbc);
+int mb_shutdown();
+void mb_detach();
+
+int mb_has_catalog();
+Table *mb_catalog_add(char *name, int ncols, char **colnames, int **coltypes);
+int mb_restore_tables(void (*restore)(char *name, Table *tn));
+
+int mb_next_shard();
+
+int mb_pin(Table *tb);
+void mb_repin(Table *tb, int pin);
+void mb_unpin(Table *tb, int pin);
 
 int mb_insert(unsigned char *buf, long len, Table *table);
 
 tstamp_t mb_insert_tuple(int ncols, char *vals[], Table *table);
+tstamp_t mb_insert_tuples(int nrows, int ncols, char **vals[], Table *table,
+                          tstamp_t ts[]);
 
-tstamp_t heap_insert_tuple(int ncols, char *vals[], Table *table, Node *n);
+tstamp_t heap_insert_tuple(int ncols, char *vals[], Table *table, int transform);
 Node *heap_alloc_node(int ncols, char *vals[], Table *table);
 void heap_remove_node(Node *n, Table *tn);
 void mb_dump();
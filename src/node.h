@@ -45,6 +45,7 @@ typedef struct node {
     unsigned char *tuple;	/* pointer to Tuple in circ buffer */
     unsigned short alloc_len;	/* bytes allocated for tuple in circ buffer */
     unsigned short real_len;	/* actual lengthof the tuple in bytes */
+    unsigned int retired;	/* epoch in which it left the table */
     struct table *parent;	/* table to which node belongs */
     tstamp_t tstamp;		/* timestamp when entered into database
                                    nanoseconds since epoch */
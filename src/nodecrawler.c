@@ -48,16 +48,19 @@
 #include "gram.h"
 
 #include "mb.h"
+#include "colindex.h"
+#include "plan.h"
+#include "sink.h"
 
 #include <string.h>
 #include <sys/time.h>
 #include <stdlib.h>
 
-#define set_dropped(node) {\
-	(node)->tstamp |= DROPPED; }
-#define clr_dropped(node) {\
-	(node)->tstamp &= ~DROPPED; }
-#define is_dropped(node) ((node)->tstamp & DROPPED)
+/* initial capacity of a selection vector */
+#define NC_SEL_SIZE 256L
+
+/* rows scanned between renewals of an epoch pin */
+#define NC_PIN_ROWS 256L
 
 Nodecrawler *nodecrawler_new(Node *first, Node *last) {
     Nodecrawler *nc;
@@ -67,6 +70,10 @@ Nodecrawler *nodecrawler_new(Node *first, Node *last) {
     nc->last = last;
     nc->current = first;
     nc->empty = 0; /*false*/
+    nc->table = NULL;
+    nc->sel = NULL;
+    nc->nsel = 0;
+    nc->cur = 0;
 
     if (!first && !last) {
         debugvf("Nodecrawler: empty list!\n");
@@ -77,6 +84,9 @@ Nodecrawler *nodecrawler_new(Node *first, Node *last) {
 }
 
 static void nodecrawler_reset(Nodecrawler *nc, Table *tbl) {
+    free(nc->sel);
+    nc->sel = NULL;
+    nc->nsel = 0;
     nc->first = tbl->oldest;
     nc->last = tbl->newest;
     nc->current = tbl->oldest;
@@ -93,6 +103,8 @@ Nodecrawler *nodecrawler_new_from_window(Table *tbl, sqlwindow *win) {
     Nodecrawler *nc;
 
     nc = nodecrawler_new(tbl->oldest, tbl->newest);
+    if (! table_persistent(tbl))
+        nc->table = tbl;
 
     nodecrawler_apply_window(nc, win);
 
@@ -100,6 +112,7 @@ Nodecrawler *nodecrawler_new_from_window(Table *tbl, sqlwindow *win) {
 }
 
 void nodecrawler_free(Nodecrawler *nc) {
+    free(nc->sel);
     free(nc);
 }
 
@@ -159,8 +172,29 @@ static int compts(int op, tstamp_t ts, tstamp_t then) {
     return ans;
 }
 
+/*
+ * if the crawler is over a stream table, use its timestamp index to find
+ * a node in [first, last] from which to scan forwards; the node returned
+ * is the newest checkpoint with timestamp < then (<= then if ifequal)
+ *
+ * returns NULL if the index is of no help
+ */
+static Node *skip_to(Nodecrawler *nc, tstamp_t then, int ifequal) {
+    Node *n;
+
+    if (! nc->table)
+        return NULL;
+    n = table_ts_before(nc->table, then, ifequal);
+    if (n && n->tstamp > nc->first->tstamp && n->tstamp <= nc->last->tstamp)
+        return n;
+    return NULL;
+}
+
 /*
  * scan linked list backwards for first node that satisfies tstamp inequality
+ *
+ * if the timestamp index can be used, scan forwards from the checkpoint
+ * just before the boundary instead
  */
 static Node *first_backward(int op, Nodecrawler *nc, tstamp_t then) {
     Node *tmp, *ans, *sentinel;
@@ -168,6 +202,11 @@ static Node *first_backward(int op, Nodecrawler *nc, tstamp_t then) {
     tmp = nc->last;
     if (! compts(op, tmp->tstamp, then))
         return NULL;
+    if ((ans = skip_to(nc, then, (op == GREATER)))) {
+        while (! compts(op, ans->tstamp, then))
+            ans = ans->next;
+        return ans;
+    }
     sentinel = nc->first->prev;
     ans = nc->first;		/* assume that all fit in the window */
     tmp = tmp->prev;
@@ -183,6 +222,9 @@ static Node *first_backward(int op, Nodecrawler *nc, tstamp_t then) {
 
 /*
  * scan linked list forwards for first node that satisfies tstamp inequality
+ *
+ * if the timestamp index can be used, start from the last checkpoint that
+ * satisfies it
  */
 static Node *first_forward(int op, Nodecrawler *nc, tstamp_t then) {
     Node *tmp, *ans, *sentinel;
@@ -190,6 +232,8 @@ static Node *first_forward(int op, Nodecrawler *nc, tstamp_t then) {
     tmp = nc->first;
     if (! compts(op, tmp->tstamp, then))
         return NULL;
+    if ((ans = skip_to(nc, then, (op == LESSEQ))))
+        tmp = ans;
     sentinel = nc->last->next;
     ans = nc->last;		/* assume that all fit in the window */
     tmp = tmp->next;
@@ -368,88 +412,12 @@ void nodecrawler_apply_window(Nodecrawler *nc, sqlwindow *win) {
 
 }
 
-static int compare(int op, void *cVal, int *cType, union filterval *filVal) {
-    if (cType == PRIMTYPE_INTEGER) {
-        long long val = strtoll((char *)cVal, NULL, 10);
-        switch(op) {
-        case SQL_FILTER_EQUAL:
-            return (val == filVal->intv);
-            break;
-        case SQL_FILTER_GREATER:
-            return (val > filVal->intv);
-            break;
-        case SQL_FILTER_LESS:
-            return (val < filVal->intv);
-            break;
-        case SQL_FILTER_LESSEQ:
-            return (val <= filVal->intv);
-            break;
-        case SQL_FILTER_GREATEREQ:
-            return (val >= filVal->intv);
-            break;
-        }
-    } else if (cType == PRIMTYPE_REAL) {
-        double val = strtod((char *)cVal, NULL);
-        switch(op) {
-        case SQL_FILTER_EQUAL:
-            return (val == filVal->realv);
-            break;
-        case SQL_FILTER_GREATER:
-            return (val > filVal->realv);
-            break;
-        case SQL_FILTER_LESS:
-            return (val < filVal->realv);
-            break;
-        case SQL_FILTER_LESSEQ:
-            return (val <= filVal->realv);
-            break;
-        case SQL_FILTER_GREATEREQ:
-            return (val >= filVal->realv);
-            break;
-        }
-    } else if (cType == PRIMTYPE_VARCHAR) {
-        char *val = (char *)cVal;
-        debugvf("compare %s with %s\n", val, filVal->stringv);
-        switch(op) {
-        case SQL_FILTER_EQUAL:
-            return (strcmp(val, filVal->stringv) == 0);
-            break;
-        case SQL_FILTER_CONTAINS:
-            return (strstr(val, filVal->stringv) != NULL);
-            break;
-        case SQL_FILTER_NOTCONTAINS:
-            return (strstr(val, filVal->stringv) == NULL);
-            break;
-            /* implement >, < on lexicographical order */
-        }
-    } else if (cType == PRIMTYPE_TIMESTAMP) {
-        unsigned long long val = *(tstamp_t *)cVal;
-        switch(op) {
-        case SQL_FILTER_EQUAL:
-            return (val == filVal->tstampv);
-            break;
-        case SQL_FILTER_GREATER:
-            return (val > filVal->tstampv);
-            break;
-        case SQL_FILTER_LESS:
-            return (val < filVal->tstampv);
-            break;
-        case SQL_FILTER_LESSEQ:
-            return (val <= filVal->tstampv);
-            break;
-        case SQL_FILTER_GREATEREQ:
-            return (val >= filVal->tstampv);
-            break;
-        }
-    }
-    return 0;			/* false if we get here */
-}
-
-static char *updatevalue(int op, void *cVal, int *cType, union filterval *filVal) {
+static char *updatevalue(int op, unsigned char *t, int idx, int *cType,
+                         union filterval *filVal) {
     char r[256];
     memset(r, 0, sizeof(r));
     if (cType == PRIMTYPE_INTEGER) {
-        long long val = strtoll((char *)cVal, NULL, 10);
+        long long val = tuple_int(t, idx);
         long long new = filVal->intv;
         debugvf("update: type integer value %lld\n", val);
         switch(op) {
@@ -467,7 +435,7 @@ static char *updatevalue(int op, void *cVal, int *cType, union filterval *filVal
             break;
         }
     } else if (cType == PRIMTYPE_REAL) {
-        double val = strtod((char *)cVal, NULL);
+        double val = tuple_real(t, idx);
         double new = filVal->realv;
         debugvf("update: type real value %5.2f\n", val);
         switch(op) {
@@ -488,77 +456,46 @@ static char *updatevalue(int op, void *cVal, int *cType, union filterval *filVal
     return NULL;
 }
 
-int passed_filter(Node *n, Table *tn, int nfilters, sqlfilter **filters, int filtertype) {
-    int i;
-    char *filName;
-    union filterval filVal;
-    int filSign;
-    int colIdx;
-    void *colVal;
-    int *colType;
-    union Tuple *p = (union Tuple *)(n->tuple);
-
-    for (i = 0; i < nfilters; i++) {
-
-        filName = filters[i]->varname;
-        memcpy(&filVal, &filters[i]->value, sizeof(union filterval));
-        filSign = filters[i]->sign;
-
-        colIdx = table_lookup_colindex(tn, filName);
-        if (colIdx == -1)  { /* i.e. invalid variable name */
-            if (strcmp(filName, "timestamp") == 0) {
-                colVal = (void *)&(n->tstamp);
-                colType = PRIMTYPE_TIMESTAMP;
-            } else {
-                errorf("Invalid column name in filter: %s\n", filName);
-                return 1; /* automatically pass this filter */
-            }
-        } else {
-            colType = tn->coltype[colIdx];
-            colVal = (void *)(p->ptrs[colIdx]);
-        }
-
-        if (filtertype == SQL_FILTER_TYPE_OR) {
-
-            debugf("Filtertype in nodecrawler is OR\n");
-
-            if (compare(filSign, colVal, colType, &filVal)) {
-                return 1;
-            }
-
-        } else { /* default to AND filter */
-
-            debugf("Filtertype in nodecrawler is AND\n");
-
-            if (! compare(filSign, colVal, colType, &filVal)) {
-                return 0;
-            }
-        }
-    }
-    /* If we get here, all filters passed; or not */
-    if (filtertype == SQL_FILTER_TYPE_OR)
-        return 0;
-    return 1;
-}
-
-void nodecrawler_apply_filter(Nodecrawler *nc, Table *tn, int nfilters,
-                              sqlfilter **filters, int filtertype) {
+/*
+ * builds the selection vector of the nodes in the window that pass the
+ * filters of the plan (all of them, if plan is NULL), in table order
+ */
+void nodecrawler_apply_filter(Nodecrawler *nc, Plan *plan) {
+    long size = NC_SEL_SIZE, nsel = 0;
+    Node **sel;
+    Node *n;
 
     if (nc->empty) {
         debugvf("Nodecrawler: empty list! (Doing nothing)\n");
         return ;
     }
 
-    nodecrawler_set_to_start(nc);
-    while(nodecrawler_has_more(nc)) {
-
-        if (!passed_filter(nc->current, tn, nfilters, filters, filtertype)) {
-            set_dropped(nc->current);
+    free(nc->sel);
+    nc->sel = NULL;
+    sel = (Node **)malloc(size * sizeof(Node *));
+    for (n = nc->first; sel && n; n = (n == nc->last) ? NULL : n->next) {
+        if (plan && ! plan_passes(plan, n))
+            continue;
+        if (nsel == size) {
+            Node **p = (Node **)realloc(sel, 2 * size * sizeof(Node *));
+            if (! p) {
+                free(sel);
+                sel = NULL;
+                break;
+            }
+            sel = p;
+            size *= 2;
         }
-
-        nodecrawler_move_to_next(nc);
+        sel[nsel++] = n;
     }
-
+    if (! sel) {
+        errorf("Nodecrawler: out of memory filtering rows\n");
+        nc->empty = 1;			/* nothing can be selected */
+        return;
+    }
+    nc->sel = sel;
+    nc->nsel = nsel;
+    nodecrawler_set_to_start(nc);
 }
 
 void nodecrawler_set_to_start(Nodecrawler *nc) {
@@ -568,15 +505,16 @@ void nodecrawler_set_to_start(Nodecrawler *nc) {
         return ;
     }
 
-    nc->current = nc->first;
-
-    if (is_dropped(nc->current))
-        nodecrawler_move_to_next(nc);
+    if (nc->sel) {
+        nc->cur = 0;
+        nc->current = (nc->nsel) ? nc->sel[0] : NULL;
+    } else
+        nc->current = nc->first;
 }
 
 int nodecrawler_has_more(Nodecrawler *nc) {
 
-    return (!nc->empty && nc->current != nc->last->next);
+    return (!nc->empty && nc->current != NULL);
 }
 
 void nodecrawler_move_to_next(Nodecrawler *nc) {
@@ -589,107 +527,174 @@ void nodecrawler_move_to_next(Nodecrawler *nc) {
     if (!nodecrawler_has_more(nc))
         return;
 
-    nc->current = nc->current->next;
-
-    while (nodecrawler_has_more(nc) && is_dropped(nc->current)) {
+    if (nc->sel)
+        nc->current = (++(nc->cur) < nc->nsel) ? nc->sel[nc->cur] : NULL;
+    else if (nc->current == nc->last)
+        nc->current = NULL;	/* past the end of the window */
+    else
         nc->current = nc->current->next;
-    }
 }
 
-/* NB: dangerous method if last does not follow first in chain */
-int nodecrawler_count_nondropped(Nodecrawler *nc) {
+long nodecrawler_count(Nodecrawler *nc) {
     Node *tmp;
-    int count;
+    long count;
 
     if (nc->empty) {
         return 0;
     }
+    if (nc->sel)
+        return nc->nsel;
 
-    tmp = nc->first;
-    count = 0;
-
-    while (tmp != nc->last->next) {
-
-        if (! is_dropped(tmp)) {
-            count++;
-        }
-
-        tmp = tmp->next;
-    }
+    count = 1;
+    for (tmp = nc->first; tmp != nc->last; tmp = tmp->next)
+        count++;
 
     return count;
 }
 
-void nodecrawler_reset_all_dropped(Nodecrawler *nc) {
-    Node *tmp;
+/*
+ * pushes the rows in the window that pass the filters of the plan into
+ * the sink, in one pass
+ */
+void nodecrawler_scan(Nodecrawler *nc, Plan *plan, Sink *sk) {
+    Node *n;
 
     if (nc->empty) {
         debugvf("Nodecrawler: empty list! (Doing nothing)\n");
         return ;
     }
 
-    tmp = nc->first;
+    debugvf("Nodecrawler: Scanning window\n");
 
-    while (tmp != nc->last->next) {
-        clr_dropped(tmp);
-        tmp = tmp->next;
-    }
+    for (n = nc->first; n; n = (n == nc->last) ? NULL : n->next)
+        if (plan_passes(plan, n) && ! sink_push(sk, n))
+            break;
 }
 
-void nodecrawler_project_cols(Nodecrawler *nc, Table *tn, Rtab *results) {
-    LinkedList *rowlist;
-    Rrow *r;
-    int i;
-    char *colname;
-    int colIdx;
-    int len;
-    union Tuple *p;
-    long dummyLen;
+/*
+ * oldest row of a stream table with timestamp >= ts, or NULL if none
+ */
+static Node *resume_at(Table *tn, tstamp_t ts) {
+    Node *n;
+
+    if (! (n = table_ts_before(tn, ts, 0)))
+        n = tn->oldest;
+    while (n && n->tstamp < ts)
+        n = n->next;
+    return n;
+}
+
+/*
+ * as nodecrawler_scan(), for a window over a stream table in the memory
+ * buffer that is read without holding the table lock; the caller has
+ * pinned an epoch in pin before unlocking the table, see mb_pin()
+ *
+ * every NC_PIN_ROWS rows the pin is moved on, so that inserts can reuse
+ * the space of the rows that have been evicted behind the scan, and the
+ * scan resumes at the oldest row still in the table that is no older
+ * than the one it had reached
+ */
+void nodecrawler_scan_pinned(Nodecrawler *nc, Plan *plan, Sink *sk, int pin) {
+    Table *tn = plan->table;
+    tstamp_t last, ts;
+    long k;
+    Node *n;
 
     if (nc->empty) {
         debugvf("Nodecrawler: empty list! (Doing nothing)\n");
         return ;
     }
 
-    debugvf("Nodecrawler: Projecting columns\n");
+    debugvf("Nodecrawler: Scanning window, unlocked\n");
 
-    rowlist = ll_create();
-    nodecrawler_set_to_start(nc);
-    while (nodecrawler_has_more(nc)) {
-        /* Extract data from tuple */
-        r = malloc(sizeof(Rrow));
-        r->cols = malloc(results->ncols * sizeof(char*));
-
-        for (i = 0; i < results->ncols; i++) {
-
-            colname = results->colnames[i];
-
-            colIdx = table_lookup_colindex(tn, colname);
-            if (colIdx == -1)	/* was timestamp */
-                r->cols[i] = timestamp_to_string(nc->current->tstamp);
-            else {
-                p = (union Tuple *)(nc->current->tuple);
-                debugvf("Sanity check: values[%d]=%s\n", colIdx,
-                        p->ptrs[colIdx]);
-                len = strlen(p->ptrs[colIdx]) + 1;
-                r->cols[i] = malloc(len);
-                strcpy(r->cols[i], p->ptrs[colIdx]);
-            }
-            debugvf("r->cols[%d]: %s\n", i, r->cols[i]);
+    last = nc->last->tstamp;
+    for (n = nc->first, k = 1; n && n->tstamp <= last; k++) {
+        if (plan_passes(plan, n) && ! sink_push(sk, n))
+            break;
+        n = n->next;
+        if (n && k % NC_PIN_ROWS == 0) {
+            ts = n->tstamp;
+            table_rdlock(tn);
+            mb_repin(tn, pin);
+            n = resume_at(tn, ts);
+            table_unlock(tn);
         }
+    }
+}
+
+/*
+ * pushes the rows of a stream table with timestamps from from to last that
+ * pass the filters of the plan into the sink, until it wants no more; the
+ * table must be read locked
+ */
+void nodecrawler_scan_range(Table *tn, tstamp_t from, tstamp_t last,
+                            Plan *plan, Sink *sk) {
+    Node *n;
 
-        (void)ll_add(rowlist, r);
+    for (n = resume_at(tn, from); n && n->tstamp <= last; n = n->next)
+        if (plan_passes(plan, n) && ! sink_push(sk, n))
+            break;
+}
 
-        nodecrawler_move_to_next(nc);
-    }
+static int cmp_tstamp(const void *a, const void *b) {
+    tstamp_t x = (*(Node **)a)->tstamp;
+    tstamp_t y = (*(Node **)b)->tstamp;
+    return (x < y) ? -1 : (x > y);
+}
 
-    /* Build array from rowlist */
-    results->nrows = (int)ll_size(rowlist);
-    results->rows = (Rrow**) ll_toArray(rowlist, &dummyLen);
-    ll_destroy(rowlist, NULL);
+/*
+ * if one of the filters can be answered by a secondary index of the
+ * table, push the rows it finds that lie in the window and pass all of
+ * the filters into the sink, in table order, and return 1; otherwise
+ * return 0, having done nothing, and the window must be scanned
+ */
+int nodecrawler_scan_indexed(Nodecrawler *nc, Plan *plan, Sink *sk) {
+    Table *tn = plan->table;
+    ColIndex *x = NULL;
+    Node **nodes;
+    PlanFilter *f = NULL;
+    tstamp_t lo, hi;
+    long i, n;
+    int whole;
+
+    if (nc->empty || ! tn->indexes || plan->nfilters < 1)
+        return 0;
+    if (plan->filtertype == SQL_FILTER_TYPE_OR && plan->nfilters > 1)
+        return 0;
+    for (i = 0; i < plan->nfilters && ! x; i++) {
+        f = &(plan->filters[i]);
+        if (f->col == -1)
+            continue;
+        /* the filter value must be of the column's kind */
+        if ((tuple_class(tn->coltype[f->col]) == TUPLE_STR) != (f->isstr != 0))
+            continue;
+        x = table_find_index(tn, f->col, f->sign);
+    }
+    if (! x)
+        return 0;
+    /* rows of a stream table are in timestamp order, so the window is a
+     * range of timestamps; persistent tables are only handled unwindowed */
+    whole = (nc->first == tn->oldest && nc->last == tn->newest);
+    if (! whole && table_persistent(tn))
+        return 0;
+    if ((n = cidx_lookup(x, f->sign, f->value, &nodes)) < 0)
+        return 0;
+    debugvf("Nodecrawler: index %s found %ld rows\n", cidx_name(x), n);
+    if (cidx_kind(x) == SQL_INDEX_ORDERED)
+        qsort(nodes, n, sizeof(Node *), cmp_tstamp);
+    lo = nc->first->tstamp;
+    hi = nc->last->tstamp;
+    for (i = 0; i < n; i++) {
+        if (! whole && (nodes[i]->tstamp < lo || nodes[i]->tstamp > hi))
+            continue;
+        if (plan_passes(plan, nodes[i]) && ! sink_push(sk, nodes[i]))
+            break;
+    }
+    free(nodes);
+    return 1;
 }
 
-char *updatetable(sqlupdate *update, void *colVal, int *colType, int idx,
+char *updatetable(sqlupdate *update, unsigned char *t, int *colType, int idx,
                   Table *tn) {
 
     int i, j;
@@ -709,7 +714,7 @@ char *updatetable(sqlupdate *update, void *colVal, int *colType, int idx,
         j = table_lookup_colindex(tn, varname); /* find column index */
         /* current index */
         if (j == idx) {
-            r = updatevalue(sign, colVal, colType, &value);
+            r = updatevalue(sign, t, idx, colType, &value);
             if (r)
                 debugvf("updated value for %s is %s\n", varname, r);
         }
@@ -718,49 +723,30 @@ char *updatetable(sqlupdate *update, void *colVal, int *colType, int idx,
 }
 
 void nodecrawler_delete_rows(Nodecrawler *nc, Table *tn, sqldelete *delete) {
+    long i;
 
     if (nc->empty) {
         debugvf("Nodecrawler: empty list! (Doing nothing)\n");
         return;
     }
     debugvf("Nodecrawler: deleting rows\n");
-    nodecrawler_set_to_start(nc);
-    while (nodecrawler_has_more(nc)) {
-        Node *n;
-        n = nc->current;
-
-        /* remove n from list */
-        if (tn->oldest == tn->newest) {  /* singleton list, == n */
-            tn->oldest = NULL;
-            tn->newest = NULL;
-        } else if (tn->oldest == n) {
-            tn->oldest = n->next;
-            n->next->prev = NULL;
-        } else if (tn->newest == n) {
-            tn->newest = n->prev;
-            n->prev->next = NULL;
-        } else {
-            n->prev->next = n->next;
-            n->next->prev = n->prev;
-        }
-        free(n->tuple);
-        free(n);
-        --tn->count;
-
-        nodecrawler_move_to_next(nc);
-    }
+    if (! nc->sel)
+        nodecrawler_apply_filter(nc, NULL);
+    for (i = 0; i < nc->nsel; i++)
+        heap_remove_node(nc->sel[i], tn);
+    /* the first and last nodes may have gone */
+    nodecrawler_reset(nc, tn);
     return;
 }
 
 void nodecrawler_update_cols(Nodecrawler *nc, Table *tn, sqlupdate *update) {
     Node *n, *u;
-    union Tuple *p;
 
     char *value;
 
     int i;
+    long j;
 
-    void *colVal;
     int *colType;
 
     LinkedList *lcols;
@@ -772,21 +758,22 @@ void nodecrawler_update_cols(Nodecrawler *nc, Table *tn, sqlupdate *update) {
         return;
     }
     debugvf("Nodecrawler: updating columns\n");
-    nodecrawler_set_to_start(nc);
-    while (nodecrawler_has_more(nc)) {
+    /* updated rows are moved to the end of the table, so work from a
+     * selection of the rows to be updated */
+    if (! nc->sel)
+        nodecrawler_apply_filter(nc, NULL);
+    for (j = 0; j < nc->nsel; j++) {
         long dummyLen;
-        n = nc->current;
-        p = (union Tuple *)(n->tuple);
-        debugvf("node @%p tuple @%p\n", n, p);
+        n = nc->sel[j];
+        debugvf("node @%p tuple @%p\n", n, n->tuple);
         lcols = ll_create();
         if (!lcols)
             return;
         for (i = 0; i < tn->ncols; i++) {
-            colVal = (void *)(p->ptrs[i]);
             colType = tn->coltype[i];
-            value = updatetable(update, colVal, colType, i, tn);
+            value = updatetable(update, n->tuple, colType, i, tn);
             if (!value)
-                (void)ll_add(lcols, (void *)strdup(colVal));
+                (void)ll_add(lcols, (void *)tuple_strdup(n->tuple, i, colType));
             else
                 (void)ll_add(lcols, (void *)(value));
         }
@@ -804,23 +791,7 @@ void nodecrawler_update_cols(Nodecrawler *nc, Table *tn, sqlupdate *update) {
         debugvf("table count %ld\n", tn->count);
 
         /* remove n from list */
-        if (tn->oldest == tn->newest) { /* == n */
-            tn->oldest = NULL;
-            tn->newest = NULL;
-        } else if (tn->oldest == n) {
-            tn->oldest = n->next;
-            n->next->prev = NULL;
-        } else if (tn->newest == n) {
-            tn->newest = n->prev;
-            n->prev->next = NULL;
-        } else {
-            n->prev->next = n->next;
-            n->next->prev = n->prev;
-        }
-        --tn->count;
-
-        free(p);
-        free(n);
+        heap_remove_node(n, tn);
 
         /* insert */
         u = heap_alloc_node(ncols, colvals, tn);
@@ -832,7 +803,9 @@ void nodecrawler_update_cols(Nodecrawler *nc, Table *tn, sqlupdate *update) {
             tn->newest = u;
             tn->oldest = u;
         }
-        set_dropped(u); /* avoid infinite loop */
+        tn->nbytes += u->alloc_len;
+        table_pk_add(tn, u);
+        table_index_add(tn, u);
 
         /* if (value)
         	free(value); `value' is free'd below */
@@ -840,35 +813,46 @@ void nodecrawler_update_cols(Nodecrawler *nc, Table *tn, sqlupdate *update) {
         for (i = 0; i < ncols; i++)
             free(colvals[i]);
         free(colvals);
-
-        /* nc->current = tn->oldest; */
-        nodecrawler_reset(nc, tn);
-
-        nodecrawler_move_to_next(nc);
     }
 
+    /* the selection now refers to removed nodes */
+    nodecrawler_reset(nc, tn);
     return;
 }
 
-Node *nodecrawler_find_value(Nodecrawler *nc, int key, char *value) {
+Node *nodecrawler_find_value(Nodecrawler *nc, Table *tn, int key, char *value) {
 
     Node *n;
-    union Tuple *p;
-    char *cv; /* Value at index 'key'. */
+    int *type = tn->coltype[key];
+    int class = tuple_class(type);
+    union TupleSlot v;
 
     if (nc->empty) {
         debugvf("Nodecrawler: empty list! (Doing nothing)\n");
         return NULL;
     }
 
+    tuple_parse(value, type, &v);	/* convert the value once */
     nodecrawler_set_to_start(nc);
     while(nodecrawler_has_more(nc)) {
 
         n = nc->current;
-        p = (union Tuple *)(n->tuple);
-        cv = (char *)(p->ptrs[key]);
-        debugvf("In nodecrawler: value at index %d is %s\n", key, cv);
-        if (strcmp(cv, value) == 0) return n;
+        switch (class) {
+        case TUPLE_INT:
+            if (tuple_int(n->tuple, key) == v.intv) return n;
+            break;
+        case TUPLE_REAL:
+            if (tuple_real(n->tuple, key) == v.realv) return n;
+            break;
+        case TUPLE_TSTAMP:
+            if (tuple_tstamp(n->tuple, key) == v.tstampv) return n;
+            break;
+        default:
+            debugvf("In nodecrawler: value at index %d is %s\n", key,
+                    tuple_str(n->tuple, key));
+            if (strcmp(tuple_str(n->tuple, key), value) == 0) return n;
+            break;
+        }
         nodecrawler_move_to_next(nc);
     }
     return NULL;
@@ -41,11 +41,15 @@
  * The tuples that remain in the list are all ok and then
  * the columns are projected from these tuples.
  *
- * To avoid expensive duplicating of list nodes, a field "dropped"
- * was added to typedef node. When set to true, the node is considered
- * dropped. Cleanup must be done on the list resetting all of these fields.
- *
- * Note that this implies that only one crawler can work on a list at any time.
+ * The window is a range [first, last] of the list.  A select scans the
+ * window once, pushing the nodes that pass the filters into a sink (see
+ * sink.h), and stopping as soon as the sink wants no more.  Updates and deletes instead apply the filters to build a
+ * selection vector, private to the crawler, of the nodes in the window
+ * that pass them; from then on, the crawler moves over the selection
+ * instead of the list.  Nothing is written to the nodes, so any number of
+ * crawlers can work on a list at the same time, as long as they hold the
+ * table's lock shared.  A window over a stream table in the memory buffer
+ * can also be scanned with just an epoch pinned, see mb_pin().
  *
  * Created by Oliver Sharma on 2009-05-06
  */
@@ -56,6 +60,8 @@
 #include "sqlstmts.h"
 #include "rtab.h"
 #include "table.h"
+#include "plan.h"
+#include "sink.h"
 
 
 typedef struct nodecrawler {
@@ -65,6 +71,12 @@ typedef struct nodecrawler {
     Node *last; /* last is last added (i.e newest) */
     Node *current;
     int empty;
+    Table *table; /* table crawled, if its timestamp index may be used */
+
+    /* Selection vector, once the filters have been applied */
+    Node **sel;
+    long nsel;
+    long cur; /* index of current in sel */
 } Nodecrawler;
 
 Nodecrawler *nodecrawler_new(Node *first, Node *last);
@@ -73,34 +85,35 @@ Nodecrawler *nodecrawler_new_from_window(Table *tbl, sqlwindow *win);
 void nodecrawler_free(Nodecrawler *nc);
 
 void nodecrawler_apply_window(Nodecrawler *nc, sqlwindow *win);
-void nodecrawler_apply_filter(Nodecrawler *nc, Table *tn, int nfilters,
-                              sqlfilter **filters, int filtertype);
+void nodecrawler_apply_filter(Nodecrawler *nc, Plan *plan);
 
-void nodecrawler_project_cols(Nodecrawler *nc, Table *tn, Rtab *results);
+void nodecrawler_scan(Nodecrawler *nc, Plan *plan, Sink *sk);
+int nodecrawler_scan_indexed(Nodecrawler *nc, Plan *plan, Sink *sk);
+void nodecrawler_scan_pinned(Nodecrawler *nc, Plan *plan, Sink *sk, int pin);
+void nodecrawler_scan_range(Table *tn, tstamp_t from, tstamp_t last,
+                            Plan *plan, Sink *sk);
 
-/* points current to first node
+/* points current to first node (of the selection, if filtered)
  */
 void nodecrawler_set_to_start(Nodecrawler *nc);
 
 
-/* returns TRUE if current node is last->next
+/* returns TRUE if current node is not past the last node
  */
 int nodecrawler_has_more(Nodecrawler *nc);
 
-/* Moves to next node in list where dropped is false
+/* Moves to next node in the window, or in the selection if filtered
  *
  * NB: always check with nodecrawler_not_at_end() first
  */
 void nodecrawler_move_to_next(Nodecrawler *nc);
 
-int nodecrawler_count_nondropped(Nodecrawler *nc);
-
-void nodecrawler_reset_all_dropped(Nodecrawler *nc);
+long nodecrawler_count(Nodecrawler *nc);
 
 void nodecrawler_update_cols(Nodecrawler *nc, Table *tn, sqlupdate *update);
 
 void nodecrawler_delete_rows(Nodecrawler *nc, Table *tn, sqldelete *delete);
 
-Node *nodecrawler_find_value(Nodecrawler *nc, int key, char *value);
+Node *nodecrawler_find_value(Nodecrawler *nc, Table *tn, int key, char *value);
 
 #endif
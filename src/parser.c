@@ -41,296 +41,348 @@
 #include "typetable.h"
 #include "util.h"
 #include "timestamp.h"
+#include "adts/linkedlist.h"
 #include <stdio.h>
+#include <string.h>
 #include <stdlib.h>
 
-extern int yyparse(void);
-extern int yyrestart(void);
-extern void *yy_scan_string(const char *);
-extern void yy_delete_buffer(void*);
+/* the scanner is reentrant; see scan.l */
+extern int yylex_init(void **scanner);
+extern int yylex_destroy(void *scanner);
+extern void *yy_scan_string(const char *query, void *scanner);
+extern void yy_delete_buffer(void *bufstate, void *scanner);
+extern int yyparse(void *scanner, SqlParse *ps);
 
-//extern int yylex_destroy(void);
-
-extern sqlstmt stmt;
-
-void reset_statement() {
+/*
+ * free the strings and arrays hanging off a statement, leaving it empty
+ */
+static void clear_stmt(sqlstmt *st) {
     int i;
 
     /* NB: possible memory leaks here !!! */
 
-    switch (stmt.type) {
+    switch (st->type) {
 
     case SQL_TABLE_META:
-        free(stmt.sql.meta.table);
-        stmt.type = 0;
+        free(st->sql.meta.table);
+        st->type = 0;
         break;
 
     case SQL_TYPE_REGISTER:
-        free(stmt.sql.regist.automaton);
-        free(stmt.sql.regist.ipaddr);
-        free(stmt.sql.regist.port);
-        free(stmt.sql.regist.service);
-        stmt.type = 0;
+        free(st->sql.regist.automaton);
+        free(st->sql.regist.ipaddr);
+        free(st->sql.regist.port);
+        free(st->sql.regist.service);
+        st->type = 0;
         break;
 
     case SQL_TYPE_UNREGISTER:
-        free(stmt.sql.unregist.id);
-        stmt.type = 0;
+        free(st->sql.unregist.id);
+        st->type = 0;
         break;
 
     case SQL_TYPE_SELECT:
-        if (stmt.sql.select.ncols > 0) {
-            for (i = 0; i < stmt.sql.select.ncols; i++)
-                free(stmt.sql.select.cols[i]);
-            free(stmt.sql.select.cols);
-            free(stmt.sql.select.colattrib);
+        if (st->sql.select.ncols > 0) {
+            for (i = 0; i < st->sql.select.ncols; i++)
+                free(st->sql.select.cols[i]);
+            free(st->sql.select.cols);
+            free(st->sql.select.colattrib);
         }
-        stmt.sql.select.ncols = 0;
-        stmt.sql.select.cols = NULL;
-        stmt.sql.select.colattrib = NULL;
-        if (stmt.sql.select.ntables > 0) {
-            for (i = 0; i < stmt.sql.select.ntables; i++) {
-                free(stmt.sql.select.tables[i]);
-                free(stmt.sql.select.windows[i]);
+        st->sql.select.ncols = 0;
+        st->sql.select.cols = NULL;
+        st->sql.select.colattrib = NULL;
+        if (st->sql.select.ntables > 0) {
+            for (i = 0; i < st->sql.select.ntables; i++) {
+                free(st->sql.select.tables[i]);
+                free(st->sql.select.windows[i]);
             }
-            free(stmt.sql.select.tables);
-            free(stmt.sql.select.windows);
+            free(st->sql.select.tables);
+            free(st->sql.select.windows);
         }
-        stmt.sql.select.ntables = 0;
-        stmt.sql.select.tables = NULL;
-        stmt.sql.select.windows = NULL;
-        if (stmt.sql.select.nfilters > 0) {
-            for (i = 0; i < stmt.sql.select.nfilters; i++) {
-                free(stmt.sql.select.filters[i]->varname);
-                if (stmt.sql.select.filters[i]->IS_STR &&
-                        stmt.sql.select.filters[i]->value.stringv) {
-                    free(stmt.sql.select.filters[i]->value.stringv);
+        st->sql.select.ntables = 0;
+        st->sql.select.tables = NULL;
+        st->sql.select.windows = NULL;
+        if (st->sql.select.nfilters > 0) {
+            for (i = 0; i < st->sql.select.nfilters; i++) {
+                free(st->sql.select.filters[i]->varname);
+                if (st->sql.select.filters[i]->IS_STR &&
+                        st->sql.select.filters[i]->value.stringv) {
+                    free(st->sql.select.filters[i]->value.stringv);
                 }
-                free(stmt.sql.select.filters[i]);
+                free(st->sql.select.filters[i]);
             }
-            free(stmt.sql.select.filters);
+            free(st->sql.select.filters);
         }
-        stmt.sql.select.nfilters = 0;
-        stmt.sql.select.filters = NULL;
-        stmt.sql.select.filtertype = 0;
-        if (stmt.sql.select.groupby_ncols > 0) {
-            for (i = 0; i < stmt.sql.select.groupby_ncols; i++)
-                free(stmt.sql.select.groupby_cols[i]);
-            free(stmt.sql.select.groupby_cols);
+        st->sql.select.nfilters = 0;
+        st->sql.select.filters = NULL;
+        st->sql.select.filtertype = 0;
+        if (st->sql.select.groupby_ncols > 0) {
+            for (i = 0; i < st->sql.select.groupby_ncols; i++)
+                free(st->sql.select.groupby_cols[i]);
+            free(st->sql.select.groupby_cols);
         }
-        stmt.sql.select.groupby_ncols = 0;
-        stmt.sql.select.groupby_cols = NULL;
-        if (stmt.sql.select.orderby)
-            free(stmt.sql.select.orderby);
-        stmt.sql.select.orderby = NULL;
-        stmt.sql.select.isCountStar = 0;
-        stmt.sql.select.containsMinMaxAvgSum = 0;
-        stmt.type = 0;
+        st->sql.select.groupby_ncols = 0;
+        st->sql.select.groupby_cols = NULL;
+        if (st->sql.select.orderby)
+            free(st->sql.select.orderby);
+        st->sql.select.orderby = NULL;
+        st->sql.select.isCountStar = 0;
+        st->sql.select.containsMinMaxAvgSum = 0;
+        st->sql.select.limit = -1;
+        st->sql.select.offset = 0;
+        if (st->sql.select.njoins > 0) {
+            for (i = 0; i < st->sql.select.njoins; i++) {
+                free(st->sql.select.joins[i]->left);
+                free(st->sql.select.joins[i]->right);
+                free(st->sql.select.joins[i]);
+            }
+            free(st->sql.select.joins);
+        }
+        st->sql.select.njoins = 0;
+        st->sql.select.joins = NULL;
+        st->type = 0;
         break;
 
     case SQL_TYPE_UPDATE:
-        free(stmt.sql.update.tablename);
-        if (stmt.sql.update.nfilters > 0) {
-            for (i = 0; i < stmt.sql.update.nfilters; i++) {
-                free(stmt.sql.update.filters[i]->varname);
-                free(stmt.sql.update.filters[i]);
+        free(st->sql.update.tablename);
+        if (st->sql.update.nfilters > 0) {
+            for (i = 0; i < st->sql.update.nfilters; i++) {
+                free(st->sql.update.filters[i]->varname);
+                free(st->sql.update.filters[i]);
             }
-            free(stmt.sql.update.filters);
+            free(st->sql.update.filters);
         }
-        stmt.sql.update.nfilters = 0;
-        stmt.sql.update.filters = NULL;
-        stmt.sql.update.filtertype = 0;
-        if (stmt.sql.update.npairs > 0) {
-            for (i = 0; i < stmt.sql.update.npairs; i++) {
-                free(stmt.sql.update.pairs[i]->varname);
-                if (stmt.sql.update.pairs[i]->IS_STR &&
-                        stmt.sql.update.pairs[i]->value.stringv) {
-                    free(stmt.sql.update.pairs[i]->value.stringv);
+        st->sql.update.nfilters = 0;
+        st->sql.update.filters = NULL;
+        st->sql.update.filtertype = 0;
+        if (st->sql.update.npairs > 0) {
+            for (i = 0; i < st->sql.update.npairs; i++) {
+                free(st->sql.update.pairs[i]->varname);
+                if (st->sql.update.pairs[i]->IS_STR &&
+                        st->sql.update.pairs[i]->value.stringv) {
+                    free(st->sql.update.pairs[i]->value.stringv);
                 }
-                free(stmt.sql.update.pairs[i]);
+                free(st->sql.update.pairs[i]);
             }
-            free(stmt.sql.update.pairs);
+            free(st->sql.update.pairs);
         }
-        stmt.sql.update.npairs = 0;
-        stmt.sql.update.pairs = NULL;
-        stmt.type = 0;
+        st->sql.update.npairs = 0;
+        st->sql.update.pairs = NULL;
+        st->type = 0;
         break;
 
     case SQL_TYPE_DELETE:
-        free(stmt.sql.delete.tablename);
-        if (stmt.sql.delete.nfilters > 0) {
-            for (i = 0; i < stmt.sql.delete.nfilters; i++) {
-                free(stmt.sql.delete.filters[i]->varname);
-                free(stmt.sql.delete.filters[i]);
+        free(st->sql.delete.tablename);
+        if (st->sql.delete.nfilters > 0) {
+            for (i = 0; i < st->sql.delete.nfilters; i++) {
+                free(st->sql.delete.filters[i]->varname);
+                free(st->sql.delete.filters[i]);
             }
-            free(stmt.sql.delete.filters);
+            free(st->sql.delete.filters);
         }
-        stmt.sql.delete.nfilters = 0;
-        stmt.sql.delete.filters = NULL;
-        stmt.sql.delete.filtertype = 0;
-        stmt.type = 0;
+        st->sql.delete.nfilters = 0;
+        st->sql.delete.filters = NULL;
+        st->sql.delete.filtertype = 0;
+        st->type = 0;
         break;
 
     case SQL_TYPE_CREATE:
-        free(stmt.sql.create.tablename);
-        if (stmt.sql.create.ncols > 0) {
-            for (i = 0; i < stmt.sql.create.ncols; i++)
-                free(stmt.sql.create.colname[i]);
-            free(stmt.sql.create.colname);
-            free(stmt.sql.create.coltype);
+        free(st->sql.create.tablename);
+        if (st->sql.create.ncols > 0) {
+            for (i = 0; i < st->sql.create.ncols; i++)
+                free(st->sql.create.colname[i]);
+            free(st->sql.create.colname);
+            free(st->sql.create.coltype);
         }
-        stmt.sql.create.ncols = 0;
-        stmt.sql.create.colname = NULL;
-        stmt.sql.create.coltype = NULL;
-        stmt.type = 0;
+        st->sql.create.ncols = 0;
+        st->sql.create.colname = NULL;
+        st->sql.create.coltype = NULL;
+        st->type = 0;
+        break;
+
+    case SQL_TYPE_INDEX:
+        free(st->sql.index.name);
+        free(st->sql.index.tablename);
+        free(st->sql.index.colname);
+        st->type = 0;
         break;
 
     case SQL_TYPE_INSERT:
-        free(stmt.sql.insert.tablename);
-        stmt.sql.insert.tablename = NULL;
-        if (stmt.sql.insert.ncols > 0) {
-            for (i = 0; i < stmt.sql.insert.ncols; i++) {
-                free(stmt.sql.insert.colval[i]);
-            }
-            free(stmt.sql.insert.colval);
-            free(stmt.sql.insert.coltype);
-        }
-        stmt.sql.insert.ncols = 0;
-        stmt.sql.insert.colval = NULL;
-        stmt.sql.insert.coltype = NULL;
-        stmt.type = 0;
+        sql_free_insert(&st->sql.insert);
+        st->type = 0;
         break;
 
     case SQL_SHOW_TABLES:
-        stmt.type = 0;
+        st->type = 0;
+        break;
+
+    case SQL_TYPE_EXECUTE:
+        free(st->sql.execute.name);
+        if (st->sql.execute.nargs > 0) {
+            for (i = 0; i < st->sql.execute.nargs; i++)
+                free(st->sql.execute.argval[i]);
+            free(st->sql.execute.argval);
+            free(st->sql.execute.argtype);
+        }
+        st->sql.execute.nargs = 0;
+        st->sql.execute.argval = NULL;
+        st->sql.execute.argtype = NULL;
+        st->type = 0;
         break;
 
     default:
-        stmt.type = 0;
+        st->type = 0;
     }
 
-    stmt.type = 0;
+    st->type = 0;
 }
 
-/* Places parsed output in externally declared global variable:
- *     sqlstmt stmt
+void sql_free_stmt(sqlstmt *st) {
+    if (st) {
+        clear_stmt(st);
+        free(st);
+    }
+}
+
+/*
+ * free the strings and arrays hanging off an insert statement, which may
+ * have been taken over from a parsed statement by the caller
  */
-void *sql_parse(char *query) {
-    int error;
-    void *bufstate;
+void sql_free_insert(sqlinsert *insert) {
+    int i;
 
-    reset_statement();
-    bufstate = yy_scan_string(query);
-    error = yyparse();
-    sql_reset_parser(bufstate);
-    if (error)
-        return NULL;
-    else
-        return bufstate;
+    free(insert->tablename);
+    insert->tablename = NULL;
+    if (insert->ncols > 0) {
+        for (i = 0; i < insert->ncols; i++) {
+            free(insert->colval[i]);
+        }
+        free(insert->colval);
+        free(insert->coltype);
+    }
+    insert->ncols = 0;
+    insert->colval = NULL;
+    insert->coltype = NULL;
 }
 
-void sql_reset_parser(void *bufstate) {
-    debugvf("resetting parser\n");
-    yy_delete_buffer(bufstate);
+/*
+ * frees what a parse that failed had collected
+ */
+static void discard(SqlParse *ps) {
+    if (ps->clist)
+        ll_destroy(ps->clist, free);
+    if (ps->cattriblist)
+        ll_destroy(ps->cattriblist, NULL);
+    if (ps->tlist)
+        ll_destroy(ps->tlist, free);
+    if (ps->flist)
+        ll_destroy(ps->flist, free);
+    if (ps->jlist)
+        ll_destroy(ps->jlist, free);
+    if (ps->wlist)
+        ll_destroy(ps->wlist, free);
+    if (ps->plist)
+        ll_destroy(ps->plist, free);
+    if (ps->grouplist)
+        ll_destroy(ps->grouplist, free);
+    if (ps->colnames)
+        ll_destroy(ps->colnames, free);
+    if (ps->coltypes)
+        ll_destroy(ps->coltypes, NULL);
+    if (ps->colvals)
+        ll_destroy(ps->colvals, free);
 }
 
-void sql_dup_stmt(sqlstmt *dup) {
-
-    dup->type = stmt.type;
-
-    switch (dup->type) {
-
-    case SQL_TYPE_SELECT:
-        dup->sql.select.ncols = stmt.sql.select.ncols;
-        dup->sql.select.cols = stmt.sql.select.cols;
-        dup->sql.select.ntables = stmt.sql.select.ntables;
-        dup->sql.select.tables = stmt.sql.select.tables;
-        dup->sql.select.filtertype = stmt.sql.select.filtertype;
-        dup->sql.select.orderby = stmt.sql.select.orderby;
-        break;
-
-    case SQL_TYPE_CREATE:
-        dup->sql.create.tablename = stmt.sql.create.tablename;
-        dup->sql.create.ncols = stmt.sql.create.ncols;
-        dup->sql.create.colname = stmt.sql.create.colname;
-        dup->sql.create.coltype = stmt.sql.create.coltype;
-        break;
-
-    case SQL_TYPE_INSERT:
-        dup->sql.insert.tablename = stmt.sql.insert.tablename;
-        dup->sql.insert.ncols = stmt.sql.insert.ncols;
-        dup->sql.insert.colval = stmt.sql.insert.colval;
-        dup->sql.insert.coltype = stmt.sql.insert.coltype;
-        break;
-
-    default:
-        errorf("can't duplicate unknown sqlstmt type\n");
+sqlstmt *sql_parse(char *query) {
+    SqlParse ps;
+    void *scanner;
+    void *bufstate;
+    int error;
 
+    memset(&ps, 0, sizeof(SqlParse));
+    if (! (ps.stmt = (sqlstmt *)calloc(1, sizeof(sqlstmt))))
+        return NULL;
+    if (yylex_init(&scanner)) {
+        free(ps.stmt);
+        return NULL;
+    }
+    bufstate = yy_scan_string(query, scanner);
+    error = yyparse(scanner, &ps);
+    debugvf("resetting parser\n");
+    yy_delete_buffer(bufstate, scanner);
+    yylex_destroy(scanner);
+    if (error) {
+        discard(&ps);
+        sql_free_stmt(ps.stmt);
+        return NULL;
     }
+    return ps.stmt;
 }
 
-/* Prints externally declared global variable
- *     sqlstmt stmt
- * to standard output
+/* Prints a statement to standard output
  */
-void sql_print() {
+void sql_print(sqlstmt *st) {
     int i;
 
     printf("-----[SQL statement]-------\n");
 
-    switch(stmt.type) {
+    switch(st->type) {
 
     case SQL_TYPE_REGISTER:
         printf("Registered %s:%s to automaton\n%s\n",
-               stmt.sql.regist.ipaddr, stmt.sql.regist.port, stmt.sql.regist.automaton);
+               st->sql.regist.ipaddr, st->sql.regist.port, st->sql.regist.automaton);
         break;
 
     case SQL_TYPE_UNREGISTER:
-        printf("Unregistered automaton, id = %s\n", stmt.sql.unregist.id);
+        printf("Unregistered automaton, id = %s\n", st->sql.unregist.id);
         break;
 
     case SQL_TYPE_SELECT:
         printf("Select statement\n");
-        if (stmt.sql.select.orderby != NULL) {
-            printf("{Ordered by: %s}\n", stmt.sql.select.orderby);
+        if (st->sql.select.orderby != NULL) {
+            printf("{Ordered by: %s}\n", st->sql.select.orderby);
         }
-        for (i = 0; i < stmt.sql.select.ncols; i++) {
-            printf("col[%d]: %s (colattrib: %s)\n", i, stmt.sql.select.cols[i], colattrib_name[*stmt.sql.select.colattrib[i]]);
+        if (st->sql.select.limit >= 0) {
+            printf("{Limit: %ld, offset: %ld}\n", st->sql.select.limit,
+                   st->sql.select.offset);
         }
-        for (i = 0; i < stmt.sql.select.ntables; i++) {
+        for (i = 0; i < st->sql.select.ncols; i++) {
+            printf("col[%d]: %s (colattrib: %s)\n", i, st->sql.select.cols[i], colattrib_name[*st->sql.select.colattrib[i]]);
+        }
+        for (i = 0; i < st->sql.select.ntables; i++) {
             char *tmpstr;
             int op;
             tstamp_t ts;
-            printf("table[%d]: %s ", i, stmt.sql.select.tables[i]);
-            switch(stmt.sql.select.windows[i]->type) {
+            printf("table[%d]: %s ", i, st->sql.select.tables[i]);
+            switch(st->sql.select.windows[i]->type) {
             case SQL_WINTYPE_NONE:
                 printf("\n");
                 break;
 
             case SQL_WINTYPE_TIME:
                 printf("[time window: %d (unitcode: %d)]\n",
-                       stmt.sql.select.windows[i]->num,
-                       stmt.sql.select.windows[i]->unit);
+                       st->sql.select.windows[i]->num,
+                       st->sql.select.windows[i]->unit);
                 break;
 
             case SQL_WINTYPE_TPL:
-                printf("[tuple window: %d]\n", stmt.sql.select.windows[i]->num);
+                printf("[tuple window: %d]\n", st->sql.select.windows[i]->num);
                 break;
 
             case SQL_WINTYPE_SINCE:
-                tmpstr = timestamp_to_string(stmt.sql.select.windows[i]->tstampv);
+                tmpstr = timestamp_to_string(st->sql.select.windows[i]->tstampv);
                 printf("[since window: %s]\n", tmpstr);
                 free(tmpstr);
                 break;
 
             case SQL_WINTYPE_INTERVAL:
-                op = stmt.sql.select.windows[i]->intv.leftOp;
-                ts = stmt.sql.select.windows[i]->intv.leftTs;
+                op = st->sql.select.windows[i]->intv.leftOp;
+                ts = st->sql.select.windows[i]->intv.leftTs;
                 tmpstr = timestamp_to_string(ts);
                 printf("[interval window: %c%s,", (op == GREATER) ? '(' : '[', tmpstr);
                 free(tmpstr);
-                op = stmt.sql.select.windows[i]->intv.rightOp;
-                ts = stmt.sql.select.windows[i]->intv.rightTs;
+                op = st->sql.select.windows[i]->intv.rightOp;
+                ts = st->sql.select.windows[i]->intv.rightTs;
                 tmpstr = timestamp_to_string(ts);
                 printf("%s%c ]\n", tmpstr, (op == LESS) ? ')' : ']');
                 free(tmpstr);
@@ -344,26 +396,44 @@ void sql_print() {
 
     case SQL_TYPE_CREATE:
         printf("Create statement\n");
-        printf("tablename: %s\n", stmt.sql.create.tablename);
-        for (i = 0; i < stmt.sql.create.ncols; i++) {
+        printf("tablename: %s\n", st->sql.create.tablename);
+        for (i = 0; i < st->sql.create.ncols; i++) {
             printf("name: %s, type %s\n",
-                   stmt.sql.create.colname[i],
-                   primtype_name[*stmt.sql.create.coltype[i]]);
+                   st->sql.create.colname[i],
+                   primtype_name[*st->sql.create.coltype[i]]);
         }
         break;
 
+    case SQL_TYPE_INDEX:
+        printf("Create index statement\n");
+        printf("index %s on %s(%s), kind %d\n", st->sql.index.name,
+               st->sql.index.tablename, st->sql.index.colname,
+               st->sql.index.kind);
+        break;
+
     case SQL_TYPE_UPDATE:
         printf("Update statement\n");
-        printf("tablename: %s\n", stmt.sql.update.tablename);
+        printf("tablename: %s\n", st->sql.update.tablename);
         break;
 
     case SQL_TYPE_INSERT:
         printf("Insert statement\n");
-        printf("tablename: %s\n", stmt.sql.insert.tablename);
-        for (i = 0; i < stmt.sql.insert.ncols; i++) {
+        printf("tablename: %s\n", st->sql.insert.tablename);
+        for (i = 0; i < st->sql.insert.ncols; i++) {
             printf("val: %s, type %s\n",
-                   stmt.sql.insert.colval[i],
-                   primtype_name[*stmt.sql.insert.coltype[i]]);
+                   st->sql.insert.colval[i],
+                   (st->sql.insert.coltype[i]) ?
+                   primtype_name[*st->sql.insert.coltype[i]] : "?");
+        }
+        break;
+
+    case SQL_TYPE_EXECUTE:
+        printf("Execute statement %s\n", st->sql.execute.name);
+        for (i = 0; i < st->sql.execute.nargs; i++) {
+            printf("arg: %s, type %s\n",
+                   st->sql.execute.argval[i],
+                   (st->sql.execute.argtype[i]) ?
+                   primtype_name[*st->sql.execute.argtype[i]] : "?");
         }
         break;
 
@@ -372,7 +442,7 @@ void sql_print() {
         break;
 
     case SQL_TABLE_META:
-        printf("Show table %s\n", stmt.sql.meta.table);
+        printf("Show table %s\n", st->sql.meta.table);
         break;
 
     default:
@@ -45,21 +45,20 @@
 #include "sqlstmts.h"
 #include "gram.h"
 
-/* Places parsed output in externally declared global variable:
- *     sqlstmt stmt
+/*
+ * parses query, and returns the statement, which the caller frees with
+ * sql_free_stmt(), or NULL if it does not parse; each call has a scanner
+ * and parser state of its own, so queries may be parsed on several
+ * threads at once
  */
-void *sql_parse(char *query);
-
-void reset_statement(void);
+sqlstmt *sql_parse(char *query);
 
-void sql_reset_parser(void *bufstate);
+void sql_free_stmt(sqlstmt *st);
 
-void sql_dup_stmt(sqlstmt *dup);
+void sql_free_insert(sqlinsert *insert);
 
-/* Prints externally declared global variable
- *     sqlstmt stmt
- * to standard output
+/* Prints a statement to standard output
  */
-void sql_print();
+void sql_print(sqlstmt *st);
 
 #endif
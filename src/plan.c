@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * plan.c - compiled form of the filters and projection of a statement
+ */
+#include "plan.h"
+
+#include "tuple.h"
+#include "util.h"
+#include "timestamp.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+/*
+ * comparison functions for each storage class and operator; the value of
+ * the column, or of the row's timestamp, is on the left
+ */
+#define ORDER_TESTS(kind, type, get, field) \
+static int kind##_eq(Node *n, int c, union filterval *v) { \
+    return ((type)(get) == v->field); } \
+static int kind##_gt(Node *n, int c, union filterval *v) { \
+    return ((type)(get) > v->field); } \
+static int kind##_lt(Node *n, int c, union filterval *v) { \
+    return ((type)(get) < v->field); } \
+static int kind##_le(Node *n, int c, union filterval *v) { \
+    return ((type)(get) <= v->field); } \
+static int kind##_ge(Node *n, int c, union filterval *v) { \
+    return ((type)(get) >= v->field); }
+
+ORDER_TESTS(int, long long, tuple_int(n->tuple, c), intv)
+ORDER_TESTS(real, double, tuple_real(n->tuple, c), realv)
+ORDER_TESTS(tstamp, tstamp_t, tuple_tstamp(n->tuple, c), tstampv)
+ORDER_TESTS(rowts, tstamp_t, n->tstamp, tstampv)
+
+static int str_eq(Node *n, int c, union filterval *v) {
+    return (strcmp(tuple_str(n->tuple, c), v->stringv) == 0);
+}
+
+static int str_contains(Node *n, int c, union filterval *v) {
+    return (strstr(tuple_str(n->tuple, c), v->stringv) != NULL);
+}
+
+static int str_notcontains(Node *n, int c, union filterval *v) {
+    return (strstr(tuple_str(n->tuple, c), v->stringv) == NULL);
+}
+
+/* operators that do not apply to the type of the column never match */
+static int never(Node *n, int c, union filterval *v) {
+    return 0;
+}
+
+/* storage class of the row's timestamp, after the TUPLE_ classes */
+#define PLAN_ROWTS (TUPLE_STR + 1)
+
+typedef int (*Test)(Node *n, int col, union filterval *value);
+
+/*
+ * tests[class][sign], for the SQL_FILTER_ operators EQUAL, GREATER, LESS,
+ * LESSEQ, GREATEREQ, CONTAINS and NOTCONTAINS
+ */
+static const Test tests[PLAN_ROWTS + 1][SQL_FILTER_NOTCONTAINS + 1] = {
+    {never, int_eq, int_gt, int_lt, int_le, int_ge, never, never},
+    {never, real_eq, real_gt, real_lt, real_le, real_ge, never, never},
+    {never, tstamp_eq, tstamp_gt, tstamp_lt, tstamp_le, tstamp_ge, never, never},
+    {never, str_eq, never, never, never, never, str_contains, str_notcontains},
+    {never, rowts_eq, rowts_gt, rowts_lt, rowts_le, rowts_ge, never, never},
+};
+
+Plan *plan_compile(Table *tn, int nfilters, sqlfilter **filters,
+                   int filtertype, Rtab *results) {
+    Plan *p;
+    PlanFilter *f;
+    int i, class;
+
+    if (! (p = (Plan *)calloc(1, sizeof(Plan))))
+        return NULL;
+    p->table = tn;
+    p->filtertype = filtertype;
+    if (nfilters > 0 &&
+            ! (p->filters = (PlanFilter *)malloc(nfilters * sizeof(PlanFilter)))) {
+        free(p);
+        return NULL;
+    }
+    p->nfilters = nfilters;
+    for (i = 0; i < nfilters; i++) {
+        f = &(p->filters[i]);
+        f->sign = filters[i]->sign;
+        f->isstr = filters[i]->IS_STR;
+        f->value = &(filters[i]->value);
+        f->col = table_lookup_colindex(tn, filters[i]->varname);
+        if (f->col != -1)
+            class = tuple_class(tn->coltype[f->col]);
+        else if (strcmp(filters[i]->varname, "timestamp") == 0)
+            class = PLAN_ROWTS;
+        else {
+            errorf("Invalid column name in filter: %s\n", filters[i]->varname);
+            f->test = NULL;
+            continue;
+        }
+        if (f->sign < 0 || f->sign > SQL_FILTER_NOTCONTAINS)
+            f->test = never;
+        else
+            f->test = tests[class][f->sign];
+    }
+    if (results && results->ncols > 0) {
+        if (! (p->proj = (int *)malloc(results->ncols * sizeof(int)))) {
+            plan_free(p);
+            return NULL;
+        }
+        p->ncols = results->ncols;
+        for (i = 0; i < p->ncols; i++)	/* -1 is the timestamp */
+            p->proj[i] = table_lookup_colindex(tn, results->colnames[i]);
+    }
+    return p;
+}
+
+void plan_free(Plan *p) {
+    if (p) {
+        free(p->filters);
+        free(p->proj);
+        free(p);
+    }
+}
+
+int plan_passes(Plan *p, Node *n) {
+    PlanFilter *f;
+    int i, ans;
+
+    for (i = 0; i < p->nfilters; i++) {
+        f = &(p->filters[i]);
+        if (! f->test)		/* invalid column, automatically passes */
+            return 1;
+        ans = f->test(n, f->col, f->value);
+        if (p->filtertype == SQL_FILTER_TYPE_OR) {
+            if (ans)
+                return 1;
+        } else if (! ans)	/* default to AND filter */
+            return 0;
+    }
+    /* If we get here, all filters passed; or not */
+    return (p->filtertype != SQL_FILTER_TYPE_OR);
+}
+
+char *plan_text(Plan *p, Node *n, int i, char *buf) {
+    int col = p->proj[i];
+
+    if (col != -1)
+        return tuple_text(n->tuple, col, p->table->coltype[col], buf);
+    sprintf(buf, "@%016llx@", n->tstamp);	/* was timestamp */
+    return buf;
+}
+
+/*
+ * copies the slots of the projected columns of the row to vals, the
+ * timestamp of the row standing in for column -1
+ */
+static void plan_slots(Plan *p, Node *n, union TupleSlot *vals) {
+    int i;
+
+    for (i = 0; i < p->ncols; i++)
+        if (p->proj[i] != -1)
+            vals[i] = tuple_slot(n->tuple, p->proj[i]);
+        else
+            vals[i].tstampv = n->tstamp;
+}
+
+Rrow *plan_project(Plan *p, Node *n, Rtab *results) {
+    char buf[TUPLE_TEXT_LEN];
+    Rrow *r;
+    int i;
+
+    if (results) {
+        if (! (r = rtab_new_row(results)))
+            return NULL;
+        for (i = 0; i < p->ncols; i++)
+            if (! (r->cols[i] = rtab_strdup(results, plan_text(p, n, i, buf))))
+                return NULL;
+        if (! (r->vals = (union TupleSlot *)arena_alloc(results->arena,
+                               p->ncols * sizeof(union TupleSlot))))
+            return NULL;
+        plan_slots(p, n, r->vals);
+        return r;
+    }
+    if (! (r = (Rrow *)malloc(sizeof(Rrow))))
+        return NULL;
+    if (! (r->cols = (char **)calloc(p->ncols, sizeof(char *)))) {
+        free(r);
+        return NULL;
+    }
+    for (i = 0; i < p->ncols; i++)
+        r->cols[i] = strdup(plan_text(p, n, i, buf));
+    r->vals = (union TupleSlot *)malloc(p->ncols * sizeof(union TupleSlot));
+    if (r->vals)
+        plan_slots(p, n, r->vals);
+    return r;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * plan.h - compiled form of the filters and projection of a statement
+ *
+ * the column names in a statement are resolved against the table once,
+ * and each filter is bound to a comparison function for the type of its
+ * column and its operator, so that evaluating a row involves no name
+ * lookups or type dispatch
+ */
+#ifndef _PLAN_H_
+#define _PLAN_H_
+
+#include "node.h"
+#include "table.h"
+#include "sqlstmts.h"
+#include "rtab.h"
+
+typedef struct planfilter {
+    int col;			/* column index, -1 for the timestamp */
+    int sign;			/* SQL_FILTER_ operator */
+    int isstr;			/* value is a string */
+    union filterval *value;	/* value compared against */
+    int (*test)(Node *n, int col, union filterval *value);
+				/* NULL if the column does not exist */
+} PlanFilter;
+
+typedef struct plan {
+    Table *table;		/* table the plan was compiled against */
+    int nfilters;		/* number of filters */
+    PlanFilter *filters;	/* the filters, in statement order */
+    int filtertype;		/* SQL_FILTER_TYPE_AND or _OR */
+    int ncols;			/* number of projected columns */
+    int *proj;			/* column index of each, -1 for the timestamp */
+} Plan;
+
+/*
+ * compiles the filters of a statement, and the projection of the columns
+ * of results, if not NULL, against the table; the filters must outlive
+ * the plan
+ *
+ * returns NULL if there is insufficient memory
+ */
+Plan *plan_compile(Table *tn, int nfilters, sqlfilter **filters,
+                   int filtertype, Rtab *results);
+
+void plan_free(Plan *p);
+
+/*
+ * returns 1 if the row passes the filters of the plan, 0 otherwise
+ */
+int plan_passes(Plan *p, Node *n);
+
+/*
+ * returns projected column i of the row as text, in the form stored in a
+ * result row; fixed-width values are formatted into buf, which must be at
+ * least TUPLE_TEXT_LEN bytes long
+ */
+char *plan_text(Plan *p, Node *n, int i, char *buf);
+
+/*
+ * returns the projection of the row as a row of the results, allocated
+ * from their arena, with the native values of its columns as well as
+ * their text; if results is NULL, the row and its values are malloc'ed
+ * instead, for a row that may be dropped before the results are complete
+ *
+ * returns NULL if there is insufficient memory
+ */
+Rrow *plan_project(Plan *p, Node *n, Rtab *results);
+
+#endif /* _PLAN_H_ */
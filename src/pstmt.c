@@ -0,0 +1,745 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pstmt.c - prepared statements, and a cache of parsed statements
+ */
+#include "pstmt.h"
+
+#include "parser.h"
+#include "hwdb.h"
+#include "table.h"
+#include "tuple.h"
+#include "typetable.h"
+#include "timestamp.h"
+#include "util.h"
+#include "adts/hashmap.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <pthread.h>
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static HashMap *texts;		/* cached statements by normalized text */
+static HashMap *names;		/* prepared statements by name */
+static PStmt *newest;		/* the cache, most recently used first */
+static PStmt *oldest;
+static long ncached;		/* number of statements in the cache */
+
+void pstmt_init(void) {
+    texts = hm_create(2L * PSTMT_CACHE_SIZE, 2.0);
+    names = hm_create(25L, 10.0);
+}
+
+/*
+ * returns a copy of query with each run of white space outside of a
+ * double-quoted string replaced by a single space, leading and trailing
+ * white space and semicolons dropped; comments are copied as they are,
+ * as they end at a newline
+ */
+static char *normalize(char *query) {
+    char *text, *p, *q;
+    int quoted = 0;
+
+    if (! (text = malloc(strlen(query) + 1)))
+        return NULL;
+    for (p = query; isspace((int)*p); p++)
+        ;
+    for (q = text; *p; p++) {
+        if (quoted) {
+            if (*p == '"' || *p == '\n')	/* as in the lexer */
+                quoted = 0;
+        } else if (*p == '"') {
+            quoted = 1;
+        } else if (p[0] == '/' && p[1] == '/') {
+            while (*p && *p != '\n')
+                *q++ = *p++;
+            if (! *p)
+                break;
+        } else if (isspace((int)*p)) {
+            while (isspace((int)p[1]))
+                p++;
+            *q++ = ' ';
+            continue;
+        }
+        *q++ = *p;
+    }
+    while (q > text && (q[-1] == ' ' || q[-1] == ';'))
+        q--;
+    *q = '\0';
+    return text;
+}
+
+/* the following are called with the lock held */
+
+static void unlink_entry(PStmt *ps) {
+    if (ps->prev)
+        ps->prev->next = ps->next;
+    else
+        newest = ps->next;
+    if (ps->next)
+        ps->next->prev = ps->prev;
+    else
+        oldest = ps->prev;
+    ps->prev = ps->next = NULL;
+}
+
+static void link_entry(PStmt *ps) {
+    ps->prev = NULL;
+    ps->next = newest;
+    if (newest)
+        newest->prev = ps;
+    else
+        oldest = ps;
+    newest = ps;
+}
+
+static void free_entry(PStmt *ps) {
+    sql_free_stmt(ps->stmt);
+    free(ps->paramtype);
+    free(ps->text);
+    free(ps);
+}
+
+/*
+ * drops the least recently used statements that are not held until the
+ * cache is back to its size
+ */
+static void evict(void) {
+    PStmt *ps, *prev;
+    void *dummy;
+
+    for (ps = oldest; ps && ncached > PSTMT_CACHE_SIZE; ps = prev) {
+        prev = ps->prev;
+        if (ps->refs > 0)
+            continue;
+        unlink_entry(ps);
+        (void) hm_remove(texts, ps->text, &dummy);
+        ncached--;
+        debugvf("PSTMT: dropping %s\n", ps->text);
+        free_entry(ps);
+    }
+}
+
+/*
+ * returns the cached statement with the normalized text, held, or NULL
+ */
+static PStmt *find(char *text) {
+    PStmt *ps;
+
+    pthread_mutex_lock(&lock);
+    if (hm_get(texts, text, (void **)&ps)) {
+        ps->refs++;
+        unlink_entry(ps);
+        link_entry(ps);
+    } else
+        ps = NULL;
+    pthread_mutex_unlock(&lock);
+    return ps;
+}
+
+static int *column_type(Table *tn, char *name) {
+    int col = table_lookup_colindex(tn, name);
+
+    if (col != -1)
+        return tn->coltype[col];
+    if (strcmp(name, "timestamp") == 0)
+        return PRIMTYPE_TIMESTAMP;
+    return NULL;
+}
+
+static int count_filters(int n, sqlfilter **filters) {
+    int i, k = 0;
+
+    for (i = 0; i < n; i++)
+        if (filters[i]->IS_PARAM)
+            k++;
+    return k;
+}
+
+static int count_pairs(int n, sqlpair **pairs) {
+    int i, k = 0;
+
+    for (i = 0; i < n; i++)
+        if (pairs[i]->IS_PARAM)
+            k++;
+    return k;
+}
+
+int pstmt_nparams(sqlstmt *st) {
+    int i, n = 0;
+
+    switch (st->type) {
+    case SQL_TYPE_SELECT:
+        n = count_filters(st->sql.select.nfilters, st->sql.select.filters);
+        break;
+    case SQL_TYPE_DELETE:
+        n = count_filters(st->sql.delete.nfilters, st->sql.delete.filters);
+        break;
+    case SQL_TYPE_UPDATE:
+        n = count_pairs(st->sql.update.npairs, st->sql.update.pairs) +
+            count_filters(st->sql.update.nfilters, st->sql.update.filters);
+        break;
+    case SQL_TYPE_INSERT:
+        for (i = 0; i < st->sql.insert.ncols; i++)
+            if (! st->sql.insert.coltype[i])
+                n++;
+        break;
+    }
+    return n;
+}
+
+/*
+ * returns the type of the column that each of the n placeholders of a
+ * statement is bound to, in statement order; a type is NULL if it is not
+ * known, as when the table has not been created yet
+ */
+static int **resolve(sqlstmt *st, int n) {
+    int **types;
+    char *tablename = NULL;
+    Table *tn;
+    int nfilters = 0, i, k = 0;
+    sqlfilter **filters = NULL;
+
+    if (n == 0 || ! (types = (int **)calloc(n, sizeof(int *))))
+        return NULL;
+    switch (st->type) {
+    case SQL_TYPE_SELECT:		/* not if a join */
+        if (st->sql.select.ntables == 1)
+            tablename = st->sql.select.tables[0];
+        nfilters = st->sql.select.nfilters;
+        filters = st->sql.select.filters;
+        break;
+    case SQL_TYPE_DELETE:
+        tablename = st->sql.delete.tablename;
+        nfilters = st->sql.delete.nfilters;
+        filters = st->sql.delete.filters;
+        break;
+    case SQL_TYPE_UPDATE:
+        tablename = st->sql.update.tablename;
+        nfilters = st->sql.update.nfilters;
+        filters = st->sql.update.filters;
+        break;
+    case SQL_TYPE_INSERT:
+        tablename = st->sql.insert.tablename;
+        break;
+    }
+    if (! tablename || ! (tn = hwdb_table_lookup(tablename)))
+        return types;
+    if (st->type == SQL_TYPE_INSERT) {
+        for (i = 0; i < st->sql.insert.ncols; i++)
+            if (! st->sql.insert.coltype[i] && i < tn->ncols)
+                types[k++] = tn->coltype[i];
+        return types;
+    }
+    if (st->type == SQL_TYPE_UPDATE)	/* the pairs come first */
+        for (i = 0; i < st->sql.update.npairs; i++)
+            if (st->sql.update.pairs[i]->IS_PARAM)
+                types[k++] = column_type(tn, st->sql.update.pairs[i]->varname);
+    for (i = 0; i < nfilters; i++)
+        if (filters[i]->IS_PARAM)
+            types[k++] = column_type(tn, filters[i]->varname);
+    return types;
+}
+
+/*
+ * returns the table that an insert is into if the insert fits it, its
+ * placeholders taking the types of their columns, else NULL; tables are
+ * never dropped, so the table can be kept for as long as the statement
+ */
+static Table *insert_table(sqlstmt *st) {
+    sqlinsert *insert = &st->sql.insert;
+    int **types;
+    Table *tn;
+    int i, ok;
+
+    if (st->type != SQL_TYPE_INSERT || ! (tn = hwdb_table_lookup(insert->tablename)))
+        return NULL;
+    if (insert->ncols != tn->ncols) {
+        errorf("Insert: Not the same number of columns\n");
+        return NULL;
+    }
+    if (! (types = (int **)malloc(insert->ncols * sizeof(int *))))
+        return NULL;
+    for (i = 0; i < insert->ncols; i++)
+        types[i] = (insert->coltype[i]) ? insert->coltype[i] : tn->coltype[i];
+    table_rdlock(tn);
+    ok = table_compatible(tn, insert->ncols, types);
+    table_unlock(tn);
+    free(types);
+    return (ok) ? tn : NULL;
+}
+
+/*
+ * adds a parsed statement to the cache under text, taking over both, and
+ * returns it held
+ */
+static PStmt *insert(char *text, sqlstmt *st) {
+    PStmt *ps, *old;
+    void *dummy;
+
+    if (! (ps = (PStmt *)malloc(sizeof(PStmt)))) {
+        sql_free_stmt(st);
+        free(text);
+        return NULL;
+    }
+    ps->text = text;
+    ps->stmt = st;
+    ps->nparams = pstmt_nparams(ps->stmt);
+    ps->paramtype = resolve(ps->stmt, ps->nparams);
+    ps->table = insert_table(ps->stmt);
+    ps->refs = 1;
+    pthread_mutex_lock(&lock);
+    if (hm_get(texts, text, (void **)&old)) {	/* cached meanwhile */
+        old->refs++;
+        pthread_mutex_unlock(&lock);
+        free_entry(ps);
+        return old;
+    }
+    (void) hm_put(texts, text, ps, &dummy);
+    link_entry(ps);
+    ncached++;
+    evict();
+    pthread_mutex_unlock(&lock);
+    debugvf("PSTMT: cached %s\n", text);
+    return ps;
+}
+
+PStmt *pstmt_cached(char *query) {
+    PStmt *ps;
+    char *text;
+
+    while (isspace((int)*query))
+        query++;
+    if (strncasecmp(query, "select", 6) != 0 || ! (text = normalize(query)))
+        return NULL;
+    ps = find(text);
+    free(text);
+    if (ps && ps->nparams > 0) {
+        pstmt_release(ps);
+        ps = NULL;
+    }
+    return ps;
+}
+
+PStmt *pstmt_cache(char *query, sqlstmt *st) {
+    char *text;
+
+    if (st->type != SQL_TYPE_SELECT || pstmt_nparams(st) > 0)
+        return NULL;
+    if (! (text = normalize(query)))
+        return NULL;
+    return insert(text, st);
+}
+
+PStmt *pstmt_lookup(char *name) {
+    PStmt *ps;
+
+    pthread_mutex_lock(&lock);
+    if (hm_get(names, name, (void **)&ps))
+        ps->refs++;
+    else
+        ps = NULL;
+    pthread_mutex_unlock(&lock);
+    return ps;
+}
+
+void pstmt_release(PStmt *ps) {
+    pthread_mutex_lock(&lock);
+    ps->refs--;
+    pthread_mutex_unlock(&lock);
+}
+
+static int prepare(char *name, char *query) {
+    PStmt *ps, *old = NULL;
+    sqlstmt *st;
+    char *text;
+
+    if (! (text = normalize(query)))
+        return 0;
+    if ((ps = find(text))) {
+        free(text);
+    } else {
+        if (! (st = sql_parse(query))) {
+            errorf("PREPARE: cannot parse %s\n", query);
+            free(text);
+            return 0;
+        }
+        if (st->type == SQL_TYPE_EXECUTE) {
+            errorf("PREPARE: an EXECUTE cannot be prepared\n");
+            sql_free_stmt(st);
+            free(text);
+            return 0;
+        }
+        if (! (ps = insert(text, st)))
+            return 0;
+    }
+    pthread_mutex_lock(&lock);		/* the name holds it from now on */
+    (void) hm_put(names, name, ps, (void **)&old);
+    pthread_mutex_unlock(&lock);
+    if (old)
+        pstmt_release(old);
+    debugf("PREPARE: %s, with %d placeholders\n", name, ps->nparams);
+    return 1;
+}
+
+static int deallocate(char *name) {
+    PStmt *ps;
+    int found;
+
+    pthread_mutex_lock(&lock);
+    if ((found = hm_remove(names, name, (void **)&ps)))
+        ps->refs--;
+    pthread_mutex_unlock(&lock);
+    if (! found) {
+        errorf("DEALLOCATE: no prepared statement %s\n", name);
+    }
+    return found;
+}
+
+/*
+ * if *p starts with the keyword, moves *p past it and the white space
+ * after it, and returns 1
+ */
+static int keyword(char **p, char *word) {
+    int n = strlen(word);
+
+    if (strncasecmp(*p, word, n) != 0 || ((*p)[n] && ! isspace((int)(*p)[n])))
+        return 0;
+    for (*p += n; isspace((int)**p); (*p)++)
+        ;
+    return 1;
+}
+
+/*
+ * returns a copy of the name that *p starts with, which must be a word to
+ * the lexer, and moves *p past it and the white space after it
+ */
+static char *read_name(char **p) {
+    char *q = *p, *ans;
+
+    if (! isalpha((int)*q))
+        return NULL;
+    while (isalnum((int)*q) || *q == '.' || *q == '-')
+        q++;
+    if (*q && ! isspace((int)*q) && *q != ';')
+        return NULL;
+    if (! (ans = malloc(q - *p + 1)))
+        return NULL;
+    memcpy(ans, *p, q - *p);
+    ans[q - *p] = '\0';
+    for (*p = q; isspace((int)**p); (*p)++)
+        ;
+    return ans;
+}
+
+int pstmt_command(char *query, int *ok) {
+    char *p = query, *s;
+
+    while (isspace((int)*p))
+        p++;
+    if (keyword(&p, "prepare")) {
+        if (! (s = read_name(&p)) || ! keyword(&p, "as")) {
+            errorf("PREPARE: expected PREPARE name AS statement\n");
+            *ok = 0;
+        } else
+            *ok = prepare(s, p);
+        free(s);
+        return 1;
+    }
+    if (keyword(&p, "deallocate")) {
+        if (! (s = read_name(&p))) {
+            errorf("DEALLOCATE: expected DEALLOCATE name\n");
+            *ok = 0;
+        } else
+            *ok = deallocate(s);
+        free(s);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * returns the type that value k of an EXECUTE is bound as: that of its
+ * column if known, else its own
+ */
+static int *bound_type(PStmt *ps, sqlexecute *exec, int k) {
+    if (ps->paramtype && ps->paramtype[k])
+        return ps->paramtype[k];
+    return exec->argtype[k];
+}
+
+/*
+ * returns 1 if a value of type argtype can be bound as type, as when an
+ * integer is compared with, or inserted into, a real column
+ */
+static int accepts(int *type, int *argtype) {
+    if (! argtype)			/* a ? among the values */
+        return 0;
+    if (type == argtype)
+        return 1;
+    switch (tuple_class(type)) {
+    case TUPLE_INT:
+        return (argtype == PRIMTYPE_INTEGER || argtype == PRIMTYPE_BOOLEAN);
+    case TUPLE_REAL:
+        return (argtype == PRIMTYPE_INTEGER);
+    case TUPLE_STR:
+        return (argtype == PRIMTYPE_VARCHAR);
+    }
+    return 0;
+}
+
+static void bind_value(int *type, char *arg, union filterval *value,
+                       unsigned char *isstr) {
+    *isstr = 0;
+    switch (tuple_class(type)) {
+    case TUPLE_REAL:
+        value->realv = strtod(arg, NULL);
+        break;
+    case TUPLE_TSTAMP:
+        value->tstampv = string_to_timestamp(arg);
+        break;
+    case TUPLE_STR:
+        value->stringv = strdup(arg);
+        *isstr = 1;
+        break;
+    default:
+        value->intv = strtoll(arg, NULL, 10);
+    }
+}
+
+static void unbind_filters(int n, sqlfilter **bound, sqlfilter **filters) {
+    int i;
+
+    if (bound == filters)
+        return;
+    for (i = 0; i < n; i++) {
+        if (bound[i] == filters[i])
+            continue;
+        if (bound[i]->IS_STR)
+            free(bound[i]->value.stringv);
+        free(bound[i]);
+    }
+    free(bound);
+}
+
+static void unbind_pairs(int n, sqlpair **bound, sqlpair **pairs) {
+    int i;
+
+    if (bound == pairs)
+        return;
+    for (i = 0; i < n; i++) {
+        if (bound[i] == pairs[i])
+            continue;
+        if (bound[i]->IS_STR)
+            free(bound[i]->value.stringv);
+        free(bound[i]);
+    }
+    free(bound);
+}
+
+/*
+ * returns a copy of the array of filters in which those with placeholders
+ * are replaced by copies bound to the values of exec from *k on, or the
+ * array itself if it has no placeholders
+ */
+static sqlfilter **bind_filters(int n, sqlfilter **filters, PStmt *ps,
+                                sqlexecute *exec, int *k) {
+    sqlfilter **bound, *f;
+    int i;
+
+    if (count_filters(n, filters) == 0)
+        return filters;
+    if (! (bound = (sqlfilter **)malloc(n * sizeof(sqlfilter *))))
+        return NULL;
+    memcpy(bound, filters, n * sizeof(sqlfilter *));
+    for (i = 0; i < n; i++) {
+        if (! filters[i]->IS_PARAM)
+            continue;
+        if (! (f = (sqlfilter *)malloc(sizeof(sqlfilter)))) {
+            unbind_filters(n, bound, filters);
+            return NULL;
+        }
+        *f = *filters[i];
+        f->IS_PARAM = 0;
+        bind_value(bound_type(ps, exec, *k), exec->argval[*k], &f->value,
+                   &f->IS_STR);
+        (*k)++;
+        bound[i] = f;
+    }
+    return bound;
+}
+
+static sqlpair **bind_pairs(int n, sqlpair **pairs, PStmt *ps,
+                            sqlexecute *exec, int *k) {
+    sqlpair **bound, *p;
+    int i;
+
+    if (count_pairs(n, pairs) == 0)
+        return pairs;
+    if (! (bound = (sqlpair **)malloc(n * sizeof(sqlpair *))))
+        return NULL;
+    memcpy(bound, pairs, n * sizeof(sqlpair *));
+    for (i = 0; i < n; i++) {
+        if (! pairs[i]->IS_PARAM)
+            continue;
+        if (! (p = (sqlpair *)malloc(sizeof(sqlpair)))) {
+            unbind_pairs(n, bound, pairs);
+            return NULL;
+        }
+        *p = *pairs[i];
+        p->IS_PARAM = 0;
+        bind_value(bound_type(ps, exec, *k), exec->argval[*k], &p->value,
+                   &p->IS_STR);
+        (*k)++;
+        bound[i] = p;
+    }
+    return bound;
+}
+
+/*
+ * copies the insert with the values bound into it; if there is
+ * insufficient memory, whatever was copied is freed, leaving the insert
+ * empty
+ */
+static int bind_insert(PStmt *ps, sqlexecute *exec, sqlinsert *insert) {
+    sqlinsert *from = &(ps->stmt->sql.insert);
+    int i, k = 0;
+
+    insert->ncols = 0;
+    insert->tablename = strdup(from->tablename);
+    insert->colval = (char **)malloc(from->ncols * sizeof(char *));
+    insert->coltype = (int **)malloc(from->ncols * sizeof(int *));
+    if (! insert->tablename || ! insert->colval || ! insert->coltype)
+        goto fail;
+    for (i = 0; i < from->ncols; i++) {
+        if (from->coltype[i]) {
+            insert->colval[i] = strdup(from->colval[i]);
+            insert->coltype[i] = from->coltype[i];
+        } else {
+            insert->colval[i] = strdup(exec->argval[k]);
+            insert->coltype[i] = bound_type(ps, exec, k);
+            k++;
+        }
+        if (! insert->colval[i]) {
+            while (--i >= 0)
+                free(insert->colval[i]);
+            goto fail;
+        }
+    }
+    insert->ncols = from->ncols;
+    return 1;
+fail:
+    errorf("EXECUTE: out of memory binding %s\n", exec->name);
+    free(insert->tablename);
+    free(insert->colval);
+    free(insert->coltype);
+    insert->tablename = NULL;
+    insert->colval = NULL;
+    insert->coltype = NULL;
+    return 0;
+}
+
+int pstmt_bind(PStmt *ps, sqlexecute *exec, sqlstmt *st) {
+    int k;
+
+    if (exec->nargs != ps->nparams) {
+        errorf("EXECUTE: %s takes %d values, not %d\n", exec->name,
+               ps->nparams, exec->nargs);
+        return 0;
+    }
+    for (k = 0; k < ps->nparams; k++)
+        if (! accepts(bound_type(ps, exec, k), exec->argtype[k])) {
+            errorf("EXECUTE: value %d of %s is of the wrong type\n", k + 1,
+                   exec->name);
+            return 0;
+        }
+    *st = *ps->stmt;
+    if (st->type == SQL_TYPE_INSERT)
+        return bind_insert(ps, exec, &(st->sql.insert));
+    if (ps->nparams == 0)
+        return 1;
+    k = 0;
+    switch (st->type) {
+    case SQL_TYPE_SELECT:
+        st->sql.select.filters = bind_filters(st->sql.select.nfilters,
+                                              st->sql.select.filters, ps,
+                                              exec, &k);
+        return (st->sql.select.filters != NULL);
+    case SQL_TYPE_DELETE:
+        st->sql.delete.filters = bind_filters(st->sql.delete.nfilters,
+                                              st->sql.delete.filters, ps,
+                                              exec, &k);
+        return (st->sql.delete.filters != NULL);
+    case SQL_TYPE_UPDATE:
+        st->sql.update.pairs = bind_pairs(st->sql.update.npairs,
+                                          st->sql.update.pairs, ps,
+                                          exec, &k);
+        if (! st->sql.update.pairs)
+            return 0;
+        st->sql.update.filters = bind_filters(st->sql.update.nfilters,
+                                              st->sql.update.filters, ps,
+                                              exec, &k);
+        if (! st->sql.update.filters) {
+            unbind_pairs(st->sql.update.npairs, st->sql.update.pairs,
+                         ps->stmt->sql.update.pairs);
+            return 0;
+        }
+        return 1;
+    }
+    return 1;
+}
+
+void pstmt_unbind(PStmt *ps, sqlstmt *st) {
+    switch (st->type) {
+    case SQL_TYPE_SELECT:
+        unbind_filters(st->sql.select.nfilters, st->sql.select.filters,
+                       ps->stmt->sql.select.filters);
+        break;
+    case SQL_TYPE_DELETE:
+        unbind_filters(st->sql.delete.nfilters, st->sql.delete.filters,
+                       ps->stmt->sql.delete.filters);
+        break;
+    case SQL_TYPE_UPDATE:
+        unbind_pairs(st->sql.update.npairs, st->sql.update.pairs,
+                     ps->stmt->sql.update.pairs);
+        unbind_filters(st->sql.update.nfilters, st->sql.update.filters,
+                       ps->stmt->sql.update.filters);
+        break;
+    case SQL_TYPE_INSERT:
+        sql_free_insert(&(st->sql.insert));
+        break;
+    }
+    st->type = 0;
+}
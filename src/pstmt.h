@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pstmt.h - prepared statements, and a cache of parsed statements
+ *
+ * a statement is parsed once for each distinct text, after which the
+ * parsed form is reused; the text is normalized by collapsing white space
+ * outside of quotes, so that statements that differ only in layout share
+ * an entry.  PREPARE name AS statement gives a parsed statement a name,
+ * and EXECUTE name (values) binds its ? placeholders to the values, so
+ * that only the values are parsed each time it is run; the column each
+ * placeholder is compared with, or inserted into, is resolved against
+ * the table when the statement is first parsed, as is whether an insert
+ * fits its table, so that EXECUTE inserts into it without looking it up
+ *
+ * the cache holds PSTMT_CACHE_SIZE statements; the least recently used
+ * statement that is neither named nor being run is dropped to make room
+ * for another
+ */
+#ifndef _PSTMT_H_
+#define _PSTMT_H_
+
+#include "sqlstmts.h"
+
+#define PSTMT_CACHE_SIZE 256
+
+typedef struct pstmt {
+    char *text;			/* normalized text, the key in the cache */
+    sqlstmt *stmt;		/* parsed statement, unchanged once cached */
+    int nparams;		/* number of ? placeholders */
+    int **paramtype;		/* type of the column of each, NULL if unknown */
+    struct table *table;	/* table of an insert that fits it, else NULL */
+    int refs;			/* names and runs holding the statement */
+    struct pstmt *prev;		/* more recently used */
+    struct pstmt *next;		/* less recently used */
+} PStmt;
+
+void pstmt_init(void);
+
+/*
+ * runs query if it is PREPARE name AS statement or DEALLOCATE name, which
+ * are recognized before parsing so that the statement can be found in
+ * the cache, and sets *ok to whether it succeeded
+ *
+ * returns 0 if query is neither
+ */
+int pstmt_command(char *query, int *ok);
+
+/*
+ * returns the cached select with the text of query, held until released,
+ * or NULL if there is none
+ */
+PStmt *pstmt_cached(char *query);
+
+/*
+ * adds st, just parsed from query, to the cache, which takes it over, and
+ * returns it held until released; returns NULL, leaving st to the caller,
+ * unless it is a select with no placeholders
+ */
+PStmt *pstmt_cache(char *query, sqlstmt *st);
+
+/*
+ * returns the statement prepared as name, held until released, or NULL
+ * if there is none
+ */
+PStmt *pstmt_lookup(char *name);
+
+void pstmt_release(PStmt *ps);
+
+/*
+ * returns the number of ? placeholders in a statement
+ */
+int pstmt_nparams(sqlstmt *st);
+
+/*
+ * fills st with the statement of ps, its placeholders bound to the values
+ * of exec; an insert is copied whole, and may be taken over and freed by
+ * sql_free_insert(), otherwise only the filters and pairs that are bound
+ * are new
+ *
+ * returns 0, having logged why, if the values do not fit the placeholders
+ */
+int pstmt_bind(PStmt *ps, sqlexecute *exec, sqlstmt *st);
+
+/*
+ * frees what pstmt_bind() allocated for st
+ */
+void pstmt_unbind(PStmt *ps, sqlstmt *st);
+
+#endif /* _PSTMT_H_ */
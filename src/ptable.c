@@ -41,6 +41,7 @@
 #include "topic.h"
 #include "tuple.h"
 #include "typetable.h"
+#include "mb.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -71,115 +72,84 @@ int ptab_create(char *name) {
 
 int ptab_hasEntry(char *name, char *ident) {
     Table *tn = hwdb_table_lookup(name);
-    Nodecrawler *nc;
     int result;
 
     if (! tn || (! tn->tabletype))
         return 0;
-    table_lock(tn);
-    nc = nodecrawler_new(tn->oldest, tn->newest);
-    result = (nodecrawler_find_value(nc, tn->primary_column, ident) != NULL);
+    table_rdlock(tn);
+    result = (table_pk_lookup(tn, ident) != NULL);
     table_unlock(tn);
-    nodecrawler_free(nc);
     return result;
 }
 
 void ptab_delete(char *name, char *ident) {
     Table *tn = hwdb_table_lookup(name);
-    Nodecrawler *nc;
     Node *n;
+
+    if (! tn || (! tn->tabletype))
+        return;
     table_lock(tn);
-    nc = nodecrawler_new(tn->oldest, tn->newest);
-    if ((n = nodecrawler_find_value(nc, tn->primary_column, ident))) {
-        /* remove n from list */
-        if (tn->oldest == tn->newest) {	/* one item, == n */
-            tn->oldest = NULL;
-            tn->newest = NULL;
-        } else if (tn->oldest == n) {
-            tn->oldest = n->next;
-            n->next->prev = NULL;
-        } else if (tn->newest == n) {
-            tn->newest = n->prev;
-            n->prev->next = NULL;
-        } else {
-            n->prev->next = n->next;
-            n->next->prev = n->prev;
-        }
-        free(n->tuple);
-        free(n);
-        --tn->count;
-    }
-    nodecrawler_free(nc);
+    if ((n = table_pk_lookup(tn, ident)))
+        heap_remove_node(n, tn);
     table_unlock(tn);
 }
 
 GAPLSequence *ptab_lookup(char *name, char *ident) {
     GAPLSequence *ans = NULL;
     Table *tn = hwdb_table_lookup(name);
-    Nodecrawler *nc;
-    char bf[4096], *b = NULL;
-    int i;
+    int i, j;
+    int ncols, nelems;
+    SchemaCell *schema;
+    DataStackEntry *d;
     Node *n;
-    union Tuple *p;
 
     if (! tn || (! tn->tabletype))
         return ans;
-    table_lock(tn);
-    nc = nodecrawler_new(tn->oldest, tn->newest);
-    if ((n = nodecrawler_find_value(nc, tn->primary_column, ident))) {
-        p = (union Tuple *)(n->tuple);	/* convert it to a tuple */
-        b = bf;
-        for (i = tn->primary_column; i < tn->ncols; i++) {
-            b += sprintf(b, "%s", (char *)(p->ptrs[i]));
-            *b++ = '\0';
-        }
+    (void) top_schema(name, &ncols, &schema);	/* obtain the table schema */
+    nelems = ncols - tn->primary_column - 1;
+    ans = (GAPLSequence *)malloc(sizeof(GAPLSequence));
+    if (! ans)
+        return ans;
+    ans->entries = (DataStackEntry *)malloc(nelems * sizeof(DataStackEntry));
+    if (! ans->entries) {
+        free(ans);
+        return NULL;
     }
-    nodecrawler_free(nc);
-    table_unlock(tn);
-    if (b != NULL) {	/* non-primary key values in bf, generate GAPLSequence */
-        int ncols;
-        SchemaCell *schema;
-        (void) top_schema(name, &ncols, &schema);	/* obtain the table schema */
-        ans = (GAPLSequence *)malloc(sizeof(GAPLSequence));
-        if (ans) {
-            int nelems = ncols - tn->primary_column - 1;
-            ans->entries = (DataStackEntry *)malloc(nelems * sizeof(DataStackEntry));
-            if (ans->entries) {
-                char *q = bf;
-                DataStackEntry *d = ans->entries;
-                int j;
-                ans->used = nelems;
-                ans->size = nelems;
-                for (i = tn->primary_column+1, j = 0; i < ncols; i++, j++) {
-                    b = q;
-                    while (*q++) ;	/* skip to beginning of next value */
-                    d[j].type = schema[i].type;
-                    d[j].flags = 0;
-                    switch(d[j].type) {
-                    case dBOOLEAN:
-                        d[j].value.bool_v = atoi(b);
-                        break;
-                    case dINTEGER:
-                        d[j].value.int_v = atoll(b);
-                        break;
-                    case dDOUBLE:
-                        d[j].value.dbl_v = atof(b);
-                        break;
-                    case dTSTAMP:
-                        d[j].value.tstamp_v = string_to_timestamp(b);
-                        break;
-                    case dSTRING:
-                        d[j].value.str_v = strdup(b);
-                        d[j].flags |= MUST_FREE;
-                        break;
-                    }
-                }
-            } else {
-                free(ans);
-                ans = NULL;
+    table_rdlock(tn);
+    if ((n = table_pk_lookup(tn, ident))) {
+        /* values are read directly from the tuple; schema entry i
+         * describes table column i-1, since entry 0 is the timestamp */
+        d = ans->entries;
+        ans->used = nelems;
+        ans->size = nelems;
+        for (i = tn->primary_column+1, j = 0; i < ncols; i++, j++) {
+            d[j].type = schema[i].type;
+            d[j].flags = 0;
+            switch(d[j].type) {
+            case dBOOLEAN:
+                d[j].value.bool_v = tuple_int(n->tuple, i-1);
+                break;
+            case dINTEGER:
+                d[j].value.int_v = tuple_int(n->tuple, i-1);
+                break;
+            case dDOUBLE:
+                d[j].value.dbl_v = tuple_real(n->tuple, i-1);
+                break;
+            case dTSTAMP:
+                d[j].value.tstamp_v = tuple_tstamp(n->tuple, i-1);
+                break;
+            case dSTRING:
+                d[j].value.str_v = strdup(tuple_str(n->tuple, i-1));
+                d[j].flags |= MUST_FREE;
+                break;
             }
         }
+    } else {
+        free(ans->entries);
+        free(ans);
+        ans = NULL;
     }
+    table_unlock(tn);
     return ans;
 }
 
@@ -265,7 +235,7 @@ int ptab_keys(char *name, char ***theKeys) {
     int ans = -1;
     if (! tn || (! tn->tabletype))
         return ans;
-    table_lock(tn);
+    table_rdlock(tn);
     ans = tn->count;
     if (ans) {
         char **keys = (char **)malloc(ans * sizeof(char *));
@@ -275,13 +245,12 @@ int ptab_keys(char *name, char ***theKeys) {
             Nodecrawler *nc;
             int i;
             Node *n;
-            union Tuple *p;
+            int key = tn->primary_column;
             nc = nodecrawler_new(tn->oldest, tn->newest);
             nodecrawler_set_to_start(nc);
             for (i =0; nodecrawler_has_more(nc); i++) {
                 n = nc->current;
-                p = (union Tuple *)(n->tuple);
-                keys[i] = strdup((char *)(p->ptrs[tn->primary_column]));
+                keys[i] = tuple_strdup(n->tuple, key, tn->coltype[key]);
                 nodecrawler_move_to_next(nc);
             }
             nodecrawler_free(nc);
@@ -43,6 +43,7 @@
 #include "util.h"
 #include "typetable.h"
 #include "sqlstmts.h"
+#include "tuple.h"
 #include "adts/linkedlist.h"
 
 #include <stdio.h>
@@ -72,6 +73,7 @@ Rtab *rtab_new() {
     results->colnames = NULL;
     results->coltypes = NULL;
     results->rows = NULL;
+    results->arena = NULL;
     results->mtype = RTAB_MSG_SUCCESS;
     strcpy(results->msg, error_msgs[0]);
 
@@ -89,24 +91,20 @@ Rtab *rtab_new_msg(char mtype, char *message) {
 }
 
 static void rtab_purge(Rtab *results) {
-    int i, j;
+    int i;
 
     for (i = 0; i < results->ncols; i++)
         free(results->colnames[i]);
-    for (i = 0; i < results->nrows; i++) {
-        for (j = 0; j < results->ncols; j++)
-            free(results->rows[i]->cols[j]);
-        free(results->rows[i]->cols);
-        free(results->rows[i]);
-    }
     free(results->colnames);
     free(results->coltypes);
     free(results->rows);
+    arena_free(results->arena);
     results->nrows = 0;
     results->ncols = 0;
     results->colnames = NULL;
     results->coltypes = NULL;
     results->rows = NULL;
+    results->arena = NULL;
 }
 
 void rtab_free(Rtab *results) {
@@ -124,6 +122,61 @@ char **rtab_getrow(Rtab *results, int row) {
     return results->rows[row]->cols;
 }
 
+/*
+ * returns a row for the results, with the row and its array of
+ * ncols NULL columns in one piece of the arena
+ *
+ * returns NULL if there is insufficient memory
+ */
+Rrow *rtab_new_row(Rtab *results) {
+    Rrow *r;
+
+    if (! results->arena && ! (results->arena = arena_new()))
+        return NULL;
+    if (! (r = (Rrow *)arena_alloc(results->arena, sizeof(Rrow) +
+                                   results->ncols * sizeof(char *))))
+        return NULL;
+    r->cols = (char **)(r + 1);
+    memset(r->cols, 0, results->ncols * sizeof(char *));
+    r->vals = NULL;
+    return r;
+}
+
+/*
+ * returns a copy of value in the arena of the results, or NULL if there
+ * is insufficient memory
+ */
+char *rtab_strdup(Rtab *results, char *value) {
+    if (! results->arena && ! (results->arena = arena_new()))
+        return NULL;
+    return arena_strdup(results->arena, value);
+}
+
+/*
+ * returns a copy of a row, which may belong to other results or be
+ * malloc'ed, in the arena of the results; NULL columns are left NULL,
+ * and the native values of the row, if any, are copied with it
+ *
+ * returns NULL if there is insufficient memory
+ */
+Rrow *rtab_copy_row(Rtab *results, Rrow *row) {
+    Rrow *r;
+    int c;
+
+    if (! (r = rtab_new_row(results)))
+        return NULL;
+    for (c = 0; c < results->ncols; c++)
+        if (row->cols[c] && ! (r->cols[c] = rtab_strdup(results, row->cols[c])))
+            return NULL;
+    if (row->vals) {
+        if (! (r->vals = (union TupleSlot *)arena_alloc(results->arena,
+                               results->ncols * sizeof(union TupleSlot))))
+            return NULL;
+        memcpy(r->vals, row->vals, results->ncols * sizeof(union TupleSlot));
+    }
+    return r;
+}
+
 void  rtab_print(Rtab *results) {
     int c, r;
     char **row;
@@ -224,6 +277,234 @@ int rtab_pack(Rtab *results, char *packed, int size, int *len) {
     return status;
 }
 
+/*
+ * routines used by rtab_pack_binary and rtab_unpack to put and get the
+ * little-endian integers and the strings of binary results
+ */
+static unsigned char *put_u32(unsigned char *p, unsigned long v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+    return p + 4;
+}
+
+static unsigned char *put_u64(unsigned char *p, unsigned long long v) {
+    p = put_u32(p, (unsigned long)(v & 0xffffffffULL));
+    return put_u32(p, (unsigned long)(v >> 32));
+}
+
+static unsigned char *put_str(unsigned char *p, char *str, int n) {
+    p = put_u32(p, n);
+    memcpy(p, str, n);
+    p[n] = '\0';
+    return p + n + 1;
+}
+
+static unsigned long get_u32(unsigned char *p) {
+    return (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+           ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static unsigned long long get_u64(unsigned char *p) {
+    return (unsigned long long)get_u32(p) |
+           ((unsigned long long)get_u32(p + 4) << 32);
+}
+
+/*
+ * points *str at the next string, which is left in place, and moves *p
+ * past it
+ *
+ * returns 0 if the string runs past end
+ */
+static int get_str(unsigned char **p, unsigned char *end, char **str) {
+    unsigned long n;
+
+    if (end - *p < 4)
+        return 0;
+    n = get_u32(*p);
+    if ((unsigned long)(end - *p) - 4 < n + 1 || (*p)[4 + n] != '\0')
+        return 0;
+    *str = (char *)(*p + 4);
+    *p += 4 + n + 1;
+    return 1;
+}
+
+/*
+ * encoding of the values of a column of the given type
+ */
+static int class_encoding(int *type) {
+    switch (tuple_class(type)) {
+    case TUPLE_INT:
+        return RTAB_ENC_INT;
+    case TUPLE_REAL:
+        return RTAB_ENC_REAL;
+    case TUPLE_TSTAMP:
+        return RTAB_ENC_TSTAMP;
+    default:
+        return RTAB_ENC_STR;
+    }
+}
+
+/*
+ * encoding of column c of results: numbers and timestamps are packed as
+ * such if every value in the column reads as one, and as text if not
+ *
+ * the value of a row with native values is taken as it is; that of any
+ * other row is parsed, once, into slots[r], whence put_value() packs it
+ */
+static int column_encoding(Rtab *results, int c, union TupleSlot *slots) {
+    int enc = class_encoding(results->coltypes[c]);
+    char *str, *end;
+    int r;
+
+    for (r = 0; r < results->nrows && enc != RTAB_ENC_STR; r++) {
+        if (results->rows[r]->vals)
+            continue;
+        str = results->rows[r]->cols[c];
+        switch (enc) {
+        case RTAB_ENC_INT:
+            slots[r].intv = strtoll(str, &end, 10);
+            break;
+        case RTAB_ENC_REAL:
+            slots[r].realv = strtod(str, &end);
+            break;
+        default:
+            end = str;
+            if (str[0] == '@') {
+                slots[r].tstampv = strtoull(str + 1, &end, 16);
+                if (end == str + 17 && *end == '@')
+                    end++;
+                else
+                    end = str;
+            }
+            break;
+        }
+        if (end == str || *end != '\0')
+            enc = RTAB_ENC_STR;
+    }
+    return enc;
+}
+
+static int binary_cell(int enc, char *str) {
+    return (enc == RTAB_ENC_STR) ? (int)strlen(str) + 5 : 8;
+}
+
+static unsigned char *put_value(unsigned char *p, int enc,
+                                union TupleSlot *slot, char *str) {
+    switch (enc) {
+    case RTAB_ENC_INT:
+    case RTAB_ENC_REAL:		/* the bits of the double */
+        return put_u64(p, (unsigned long long)slot->intv);
+    case RTAB_ENC_TSTAMP:
+        return put_u64(p, slot->tstampv);
+    default:
+        return put_str(p, str, strlen(str));
+    }
+}
+
+int rtab_pack_binary(Rtab *results, char *packed, int size, int *len) {
+    unsigned char *p = (unsigned char *)packed;
+    unsigned char *enc = NULL;
+    union TupleSlot *slots = NULL, *slot;
+    int ncols = results->ncols;
+    int nrows = results->nrows;
+    int c, r, first, n, m, tl, nl;
+    int status = 1;
+
+    debugf("Packing rtab in binary\n");
+
+    if (nrows <= 0)
+        ncols = nrows = 0;
+    /* values parsed from the text of rows without native ones */
+    for (r = 0; r < nrows && results->rows[r]->vals; r++)
+        ;
+    if (ncols > 0 && (! (enc = (unsigned char *)malloc(ncols)) ||
+                      (r < nrows && ! (slots = (union TupleSlot *)
+                           malloc(ncols * nrows * sizeof(union TupleSlot)))))) {
+        ncols = nrows = 0;
+        status = 0;
+    }
+    n = RTAB_BINARY_MAGIC_LEN + 1 + 4 + strlen(results->msg) + 1 + 8;
+    for (c = 0; c < ncols; c++) {
+        enc[c] = column_encoding(results, c,
+                                 (slots) ? slots + c * nrows : NULL);
+        n += 1 + 4 + strlen(primtype_name[*results->coltypes[c]]) + 1 +
+             strlen(results->colnames[c]) + 1;
+    }
+    /* as for rtab_pack(), the latest rows are the ones that fit */
+    for (first = nrows; first > 0; first--) {
+        for (m = 0, c = 0; c < ncols; c++)
+            m += binary_cell(enc[c], results->rows[first - 1]->cols[c]);
+        if (n + m > size) {
+            status = 0;		/* buffer overrun */
+            break;
+        }
+        n += m;
+    }
+    memcpy(p, RTAB_BINARY_MAGIC, RTAB_BINARY_MAGIC_LEN);
+    p += RTAB_BINARY_MAGIC_LEN;
+    *p++ = results->mtype;
+    p = put_str(p, results->msg, strlen(results->msg));
+    p = put_u32(p, ncols);
+    p = put_u32(p, nrows - first);
+    for (c = 0; c < ncols; c++) {
+        tl = strlen(primtype_name[*results->coltypes[c]]);
+        nl = strlen(results->colnames[c]);
+        *p++ = enc[c];
+        p = put_u32(p, tl + 1 + nl);
+        memcpy(p, primtype_name[*results->coltypes[c]], tl);
+        p[tl] = ':';
+        memcpy(p + tl + 1, results->colnames[c], nl + 1);
+        p += tl + 1 + nl + 1;
+    }
+    for (c = 0; c < ncols; c++)
+        for (r = first; r < nrows; r++) {
+            slot = (results->rows[r]->vals) ? &results->rows[r]->vals[c] :
+                                              &slots[c * nrows + r];
+            p = put_value(p, enc[c], slot, results->rows[r]->cols[c]);
+        }
+    free(slots);
+    free(enc);
+    *len = p - (unsigned char *)packed;
+    return status;
+}
+
+int rtab_binary(char *packed, int len) {
+    return (len >= RTAB_BINARY_MAGIC_LEN &&
+            memcmp(packed, RTAB_BINARY_MAGIC, RTAB_BINARY_MAGIC_LEN) == 0);
+}
+
+/*
+ * bytes taken by the status line and column headers of results when
+ * packed by rtab_pack() or rtab_pack_binary(), allowing for the longest
+ * status message
+ */
+int rtab_packed_header(Rtab *results) {
+    int c, n;
+
+    n = 3 * (int)strlen(separator) + RTAB_MSG_MAX_LENGTH + 3 * 12 + 2;
+    for (c = 0; c < results->ncols; c++)
+        n += strlen(primtype_name[*results->coltypes[c]]) + 1 +
+             strlen(results->colnames[c]) + strlen(separator);
+    return n + 1;
+}
+
+/*
+ * bytes taken by a row of results when packed by rtab_pack() or by
+ * rtab_pack_binary(), whichever is the larger
+ */
+int rtab_packed_row(Rtab *results, Rrow *row) {
+    int c, len, n = 1, b = 0;
+
+    for (c = 0; c < results->ncols; c++) {
+        len = strlen(row->cols[c]);
+        n += len + strlen(separator);
+        b += (len + 5 > 8) ? len + 5 : 8;
+    }
+    return (n > b) ? n : b;
+}
+
 /*
  * routines used by rtab_unpack to obtain integers and strings from
  * the packed buffers received over the network
@@ -267,12 +548,103 @@ int rtab_status(char *packed, char *stsmsg) {
     return mtype;
 }
 
+/*
+ * unpacks results packed by rtab_pack_binary()
+ *
+ * returns NULL if they are malformed
+ */
+static Rtab *unpack_binary(char *packed, int len) {
+    unsigned char *p = (unsigned char *)packed + RTAB_BINARY_MAGIC_LEN;
+    unsigned char *end = (unsigned char *)packed + len;
+    unsigned char *enc = NULL;
+    char buf[TUPLE_TEXT_LEN];
+    union TupleSlot slot;
+    Rtab *results;
+    unsigned long ncols, nrows;
+    char *str, *name;
+    int c, r, index;
+
+    if (end - p < 1 || ! (results = rtab_new()))
+        return NULL;
+    results->mtype = *p++;
+    if (! get_str(&p, end, &str) || end - p < 8)
+        goto malformed;
+    snprintf(results->msg, RTAB_MSG_MAX_LENGTH, "%s", str);
+    ncols = get_u32(p);
+    nrows = get_u32(p + 4);
+    p += 8;
+    debugf("RTAB MESSAGE TYPE: %d\n", results->mtype);
+    debugf("RTAB MESSAGE: %s\n", results->msg);
+    debugf("RTAB NCOLS: %lu\n", ncols);
+    debugf("RTAB NROWS: %lu\n", nrows);
+    if (ncols == 0 || nrows == 0)
+        return results;
+    /* every value takes at least 5 bytes */
+    if (ncols > (unsigned long)len || nrows > (unsigned long)len / (5 * ncols))
+        goto malformed;
+    results->colnames = (char **)calloc(ncols, sizeof(char *));
+    results->coltypes = (int **)malloc(ncols * sizeof(int *));
+    results->rows = (Rrow **)malloc(nrows * sizeof(Rrow *));
+    enc = (unsigned char *)malloc(ncols);
+    if (! results->colnames || ! results->coltypes || ! results->rows || ! enc)
+        goto malformed;
+    results->ncols = ncols;
+    for (c = 0; c < (int)ncols; c++) {
+        if (end - p < 1)
+            goto malformed;
+        enc[c] = *p++;
+        if (! get_str(&p, end, &str) || ! (name = strchr(str, ':')))
+            goto malformed;
+        *name = '\0';
+        index = typetable_index(str);
+        *name++ = ':';
+        if (index < 0)
+            goto malformed;
+        results->coltypes[c] = &primtype_val[index];
+        if (enc[c] != RTAB_ENC_STR &&
+                enc[c] != class_encoding(results->coltypes[c]))
+            goto malformed;
+        if (! (results->colnames[c] = strdup(name)))
+            goto malformed;
+    }
+    for (r = 0; r < (int)nrows; r++) {
+        if (! (results->rows[r] = rtab_new_row(results)))
+            goto malformed;
+        results->nrows = r + 1;
+    }
+    for (c = 0; c < (int)ncols; c++)
+        for (r = 0; r < (int)nrows; r++) {
+            if (enc[c] == RTAB_ENC_STR) {
+                if (! get_str(&p, end, &str))
+                    goto malformed;
+            } else {
+                if (end - p < 8)
+                    goto malformed;
+                slot.tstampv = get_u64(p);
+                p += 8;
+                str = tuple_slot_text(&slot, results->coltypes[c], buf);
+            }
+            if (! (results->rows[r]->cols[c] = rtab_strdup(results, str)))
+                goto malformed;
+        }
+    free(enc);
+    return results;
+
+malformed:
+    errorf("RTAB: malformed binary results\n");
+    free(enc);
+    rtab_free(results);
+    return NULL;
+}
+
 Rtab *rtab_unpack(char *packed, int len) {
     Rtab *results;
     char *buf, *p;
     char tmpbuf[1024];
     int mtype, size, ncols, nrows, i, j;
 
+    if (rtab_binary(packed, len))
+        return unpack_binary(packed, len);
     debugf("Unpacking RTAB\n");
     i = len;			/* eliminate unused warning */
     results = rtab_new();
@@ -314,12 +686,11 @@ Rtab *rtab_unpack(char *packed, int len) {
             buf = p;
             p = strchr(buf, '\n');
             *p++ = '\0';
-            row = (Rrow *)malloc(sizeof(Rrow));
+            row = rtab_new_row(results);
             results->rows[j] = row;
-            row->cols = (char **)malloc(ncols * sizeof(char *));
             for (i = 0; i < ncols; i++) {
                 buf = rtab_fetch_str(buf, tmpbuf, &size);
-                row->cols[i] = strdup(tmpbuf);
+                row->cols[i] = rtab_strdup(results, tmpbuf);
             }
             if ((p-packed) >= len) {
                 results->nrows = j + 1;
@@ -353,92 +724,49 @@ int rtab_send(Rtab *results, RpcConnection outgoing) {
 
 /* ----------------[ Manipulator methods ] ---------------- */
 
-int cmp_rrow_by_col(const Rrow *ra, const Rrow *rb, int col, int *ct) {
+/*
+ * order by sorts on a key parsed once from the text of each row; ties
+ * keep the order in which the rows were found
+ */
+typedef struct sortkey {
+    union {
+        long long intv;
+        double realv;
+        char *str;
+    } v;
+    int seq;
+    Rrow *row;
+} SortKey;
 
-    char **cols_a;
-    char **cols_b;
+static int cmp_seq(const SortKey *a, const SortKey *b) {
+    return (a->seq > b->seq) - (a->seq < b->seq);
+}
 
-    cols_a = ra->cols;
-    cols_b = rb->cols;
+static int cmp_int_key(const void *x, const void *y) {
+    const SortKey *a = (const SortKey *)x, *b = (const SortKey *)y;
 
-    debugvf("cols_a: %p, cols_a[%d]: %s\n", cols_a, col, cols_a[col]);
-    debugvf("cols_b: %p, cols_b[%d]: %s\n", cols_b, col, cols_b[col]);
+    if (a->v.intv != b->v.intv)
+        return (a->v.intv < b->v.intv) ? -1 : 1;
+    return cmp_seq(a, b);
+}
 
-    if (ct == PRIMTYPE_INTEGER) {
-        long long i1, i2;
-        int ans = 0;
-        i1 = strtoll(cols_a[col], NULL, 10);
-        i2 = strtoll(cols_b[col], NULL, 10);
-        if (i1 < i2)
-            ans = -1;
-        else if (i1 > i2)
-            ans = 1;
-        return ans;
-    }
-    if (ct == PRIMTYPE_TINYINT || ct == PRIMTYPE_SMALLINT) {
-        int i1, i2;
-        i1 = atoi(cols_a[col]);
-        i2 = atoi(cols_b[col]);
-        return (i1 - i2);
-    }
-    if (ct == PRIMTYPE_REAL) {
-        double d1, d2;
-        int ans = 0;
-        d1 = strtod(cols_a[col], NULL);
-        d2 = strtod(cols_b[col], NULL);
-        if (d1 < d2)
-            ans = -1;
-        else if (d1 > d2)
-            ans = 1;
-        return ans;
-    }
-    return strcmp(cols_a[col], cols_b[col]);
+static int cmp_real_key(const void *x, const void *y) {
+    const SortKey *a = (const SortKey *)x, *b = (const SortKey *)y;
+
+    if (a->v.realv < b->v.realv)
+        return -1;
+    if (a->v.realv > b->v.realv)
+        return 1;
+    return cmp_seq(a, b);
 }
 
-/*  quickSort
- *
- *  Variant of public-domain C implementation by Darel Rex Finley.
- *
- *  * This function assumes it is called with valid parameters.
- */
+static int cmp_str_key(const void *x, const void *y) {
+    const SortKey *a = (const SortKey *)x, *b = (const SortKey *)y;
+    int ans;
 
-static void quickSort(Rrow **arr, int elements, int col, int *ct) {
-
-#define  MAX_LEVELS  300
-
-    Rrow *piv;
-    int  beg[MAX_LEVELS], end[MAX_LEVELS], i=0, L, R, swap ;
-
-    beg[0]=0;
-    end[0]=elements;
-    while (i>=0) {
-        L=beg[i];
-        R=end[i]-1;
-        if (L<R) {
-            piv=arr[L];
-            while (L<R) {
-                while ((cmp_rrow_by_col(arr[R], piv, col, ct) >= 0) && L<R) R--;
-                if (L<R) arr[L++]=arr[R];
-                while ((cmp_rrow_by_col(arr[L], piv, col, ct) <= 0) && L<R) L++;
-                if (L<R) arr[R--]=arr[L];
-            }
-            arr[L]=piv;
-            beg[i+1]=L+1;
-            end[i+1]=end[i];
-            end[i++]=L;
-            if (end[i]-beg[i]>end[i-1]-beg[i-1]) {
-                swap=beg[i];
-                beg[i]=beg[i-1];
-                beg[i-1]=swap;
-                swap=end[i];
-                end[i]=end[i-1];
-                end[i-1]=swap;
-            }
-        }
-        else {
-            i--;
-        }
-    }
+    if ((ans = strcmp(a->v.str, b->v.str)))
+        return ans;
+    return cmp_seq(a, b);
 }
 
 void rtab_orderby(Rtab *results, char *colname) {
@@ -446,6 +774,8 @@ void rtab_orderby(Rtab *results, char *colname) {
     int i;
     int valid;
     int *ct;
+    SortKey *keys;
+    int (*cmp)(const void *, const void *);
 
     if (colname == NULL) {
         debugvf("Rtab: No orderby in select. returning.\n");
@@ -468,35 +798,72 @@ void rtab_orderby(Rtab *results, char *colname) {
         return;
     }
 
-    /* DEBUG */
-    for (i=0; i < results->nrows; i++) {
-        debugvf("ptr results->rows[%d]->cols: %p, results->rows[%d]->cols[%d]: %s\n",
-                i, results->rows[i]->cols,
-                i, valid, results->rows[i]->cols[valid]);
+    if (results->nrows < 2)
+        return;
+    if (! (keys = (SortKey *)malloc(results->nrows * sizeof(SortKey)))) {
+        errorf("Unable to order results.\n");
+        return;
     }
     ct = results->coltypes[valid];
-    quickSort(results->rows, results->nrows, valid, ct);
+    if (ct == PRIMTYPE_INTEGER || ct == PRIMTYPE_TINYINT || ct == PRIMTYPE_SMALLINT)
+        cmp = cmp_int_key;
+    else if (ct == PRIMTYPE_REAL)
+        cmp = cmp_real_key;
+    else
+        cmp = cmp_str_key;
+    for (i = 0; i < results->nrows; i++) {
+        char *val = results->rows[i]->cols[valid];
+        if (cmp == cmp_int_key)
+            keys[i].v.intv = strtoll(val, NULL, 10);
+        else if (cmp == cmp_real_key)
+            keys[i].v.realv = strtod(val, NULL);
+        else
+            keys[i].v.str = val;
+        keys[i].seq = i;
+        keys[i].row = results->rows[i];
+    }
+    qsort(keys, results->nrows, sizeof(SortKey), cmp);
+    for (i = 0; i < results->nrows; i++)
+        results->rows[i] = keys[i].row;
+    free(keys);
+}
+
+void rtab_limit(Rtab *results, long offset, long limit) {
+    int n;
+
+    if (limit < 0 && offset <= 0)
+        return;
+    n = results->nrows;
+    if (offset > n)
+        offset = n;
+    if (limit < 0 || limit > n - offset)
+        limit = n - offset;
+    /* the rows that are dropped stay in the arena until it is freed */
+    memmove(results->rows, results->rows + offset, limit * sizeof(Rrow *));
+    results->nrows = (int)limit;
 }
 
 void rtab_countstar(Rtab *results) {
-    int count;
-    //char *countstr;
-    char countstr[100];
-    char **newcolnames;
-    int **newcoltypes;
-    Rrow **newrows;
-    Rrow *row;
 
     debugf("rtab_countstar...\n");
 
     if (results->nrows < 1)
         return;
 
-    //countstr = malloc(sizeof(char)*100);
-    //(void) memset((void *)countstr, 0, sizeof(char)*100);
+    rtab_count(results, results->nrows);
+}
 
-    count = results->nrows;
-    sprintf(countstr, "%d", count);
+/*
+ * replaces the results with a single count(*) of count
+ */
+void rtab_count(Rtab *results, long count) {
+    char countstr[100];
+    char **newcolnames;
+    int **newcoltypes;
+    Rrow **newrows;
+    Rrow *row;
+
+    sprintf(countstr, "%ld", count);
 
     rtab_purge(results);
     results->nrows = 1;
@@ -507,15 +874,13 @@ void rtab_countstar(Rtab *results) {
     results->colnames = newcolnames;
 
     newcoltypes = malloc(sizeof(int*));
-    //newcoltypes[0] = (int *)malloc(sizeof(int));
     newcoltypes[0] = PRIMTYPE_INTEGER;
     results->coltypes = newcoltypes;
 
     newrows = (Rrow **)malloc(sizeof(Rrow*));
-    row = (Rrow *)malloc(sizeof(Rrow));
+    row = rtab_new_row(results);
     newrows[0] = row;
-    row->cols = (char **)malloc(sizeof(char *));
-    row->cols[0] = strdup(countstr);
+    row->cols[0] = rtab_strdup(results, countstr);
     results->rows = newrows;
 
 }
@@ -719,20 +1084,14 @@ char *rtab_process_sum(Rtab *results, int col) {
 }
 
 void rtab_to_onerow_if_no_others(Rtab *results) {
-    int i, j;
     debugf("Rtab: to onerow (if no others)\n");
 
     /*
      * all selected columns have been min/max/avg/sum'ed
      * therefore, the colnames and coltypes are correct
      * rows[0] has the data, rows[1] ... rows[results->nrows-1] are
-     * superfluous, so need to be freed
+     * superfluous, and are left in the arena
      */
-    for (i = 1; i < results->nrows; i++) {
-        for (j = 0; j < results->ncols; j++)
-            free(results->rows[i]->cols[j]);
-        free(results->rows[i]);
-    }
     results->nrows = 1;
 }
 
@@ -801,8 +1160,8 @@ void rtab_replace_col_val(Rtab *results, int c, char *val) {
 
     for (r = 0; r < results->nrows; r++) {
         row = rtab_getrow(results, r);
-        free(row[c]);
-        row[c] = strdup(val);
+        row[c] = rtab_strdup(results, val);
+        results->rows[r]->vals = NULL;	/* no longer those of the tuple */
     }
     free(val);
 
@@ -837,10 +1196,8 @@ Rtab *rtab_fake_results() {
     results->coltypes = malloc(results->ncols * sizeof(int*));
     results->colnames = malloc(results->ncols * sizeof(char*));
     results->rows = malloc(results->nrows * sizeof(Rrow*));
-    for (i=0; i<results->nrows; i++) {
-        results->rows[i] = malloc(sizeof(Rrow));
-        results->rows[i]->cols = malloc(results->ncols * sizeof(char*));
-    }
+    for (i=0; i<results->nrows; i++)
+        results->rows[i] = rtab_new_row(results);
 
     for (i=0; i < results->ncols; i++) {
         results->coltypes[i] = PRIMTYPE_VARCHAR;
@@ -853,226 +1210,3 @@ Rtab *rtab_fake_results() {
     return results;
 }
 
-static void rtab_update_colnames(Rtab *results, Rtab* newresults) {
-    int c;
-    for (c = 0; c < results->ncols; c++) {
-        free(results->colnames[c]);
-        results->colnames[c] = strdup(newresults->colnames[c]);
-    }
-    return;
-}
-
-/* The group-by operator */
-
-typedef struct group_t *groupP;
-typedef struct group_t {
-    groupP next;
-    Rtab *t; /* */
-    LinkedList *rowlist;
-    char *key;
-} group_t;
-#define NKEYS 100
-#define MULT 31
-static groupP bin[NKEYS];
-static int groupsize = 0;
-static int gverbose = 0;
-
-static void groupby_free() {
-    unsigned int i;
-    groupP p, q;
-    for (i = 0; i < NKEYS; i++) {
-        for (p = bin[i]; p != NULL; p = q) {
-            q = p->next;
-            free(p->key);
-            rtab_free(p->t);
-            ll_destroy(p->rowlist, NULL);
-            free(p);
-        }
-    }
-}
-
-static void groupby_dump() {
-    unsigned int i;
-    groupP p;
-    debugf("Dump table of size %d\n", groupsize);
-    for (i = 0; i < NKEYS; i++) {
-        for (p = bin[i]; p != NULL; p = p->next) {
-            debugf("%s ->\n", p->key);
-            rtab_print(p->t);
-        }
-    }
-}
-
-static void groupby_init() {
-    unsigned int i;
-    for (i = 0; i < NKEYS; i++)
-        bin[i] = NULL;
-    groupsize = 0;
-}
-
-static unsigned int groupby_hash(char *key) {
-    unsigned int h = 0;
-    for (; *key; key++)
-        h = MULT * h + *key;
-    return h % NKEYS;
-}
-
-static groupP groupby_get(char *key) {
-    groupP p;
-    unsigned int h = groupby_hash(key);
-    for (p = bin[h]; p != NULL; p = p->next) {
-        if (strcmp(key, p->key) == 0) {
-            return p;
-        }
-    }
-    return NULL;
-}
-
-static groupP groupby_set(char *key, Rtab* results) {
-    int i;
-    groupP p;
-    unsigned int h = groupby_hash(key);
-    p = malloc(sizeof(group_t));
-    p->key = strdup(key);
-    p->t = rtab_new();
-    /* create new rtab with the same columns as `results` */
-    p->t->ncols = results->ncols;
-    p->t->colnames = (char **)malloc(results->ncols * sizeof(char *));
-    p->t->coltypes = malloc(results->ncols * sizeof(int*));
-    p->t->ncols = results->ncols;
-    for (i = 0; i < results->ncols; i++) {
-        p->t->colnames[i] = strdup(results->colnames[i]);
-        p->t->coltypes[i] = results->coltypes[i];
-    }
-    p->t->nrows = 0;
-    /* create a row list that holds the relevant rows */
-    p->rowlist = ll_create();
-    /* add to hashtable */
-    groupsize++;
-    p->next = bin[h];
-    bin[h] = p;
-    return p;
-}
-
-static void groupby_addrow(groupP p, Rrow *row) {
-    int i;
-    Rrow *r;
-    r = malloc(sizeof(Rrow));
-    r->cols = malloc(p->t->ncols * sizeof(char*));
-    for (i = 0; i < p->t->ncols; i++) {
-        r->cols[i] = strdup(row->cols[i]);
-        debugf("copied value is %s\n", r->cols[i]);
-    }
-    (void)ll_add(p->rowlist, r);
-    return;
-}
-
-static void groupby_explode() {
-    int i;
-    groupP p;
-    for (i = 0; i < NKEYS; i++) {
-        for (p = bin[i]; p != NULL; p = p->next) {
-            long dummyLen;
-            /* Build array from rowlist */
-            p->t->nrows = ll_size(p->rowlist);
-            p->t->rows = (Rrow**) ll_toArray(p->rowlist, &dummyLen);
-        }
-    }
-    return;
-}
-
-static void groupby_implode(Rtab *results, int isCountStar,
-                            int containsMinMaxAvg, int **colattrib) {
-    int i, j;
-    groupP p;
-    LinkedList* newrowlist;
-    long dummyLen;
-    /* clear results */
-    for (i = 0; i < results->nrows; i++) {
-        for (j = 0; j < results->ncols; j++) {
-            free(results->rows[i]->cols[j]);
-        }
-        free(results->rows[i]->cols);
-        free(results->rows[i]);
-    }
-    /* repopulate results */
-    newrowlist = ll_create();
-    for (i = 0; i < NKEYS; i++) {
-        for (p = bin[i]; p != NULL; p = p->next) {
-            if (isCountStar) {
-                debugf("not yet implemented");
-            } else if (containsMinMaxAvg) {
-                rtab_processMinMaxAvgSum(p->t, colattrib);
-                rtab_update_colnames(results, p->t);
-            }
-            /* only the last row is of interest for the results */
-            Rrow *row = p->t->rows[p->t->nrows-1];
-            Rrow *r;
-            r = malloc(sizeof(Rrow));
-            r->cols = malloc(p->t->ncols * sizeof(char*));
-            for (j = 0; j < p->t->ncols; j++) {
-                r->cols[j] = strdup(row->cols[j]);
-                debugf("copied value is %s\n", r->cols[j]);
-            }
-            (void)ll_add(newrowlist, r);
-        }
-    }
-    /* rowlist contains all the relevant rows; append to results */
-    results->nrows = ll_size(newrowlist);
-    results->rows = (Rrow**) ll_toArray(newrowlist, &dummyLen);
-    ll_destroy(newrowlist, NULL);
-    return;
-}
-
-void rtab_groupby(Rtab *results, int ncols, char** cols,
-                  int isCountStar, int containsMinMaxAvg, int** colattrib) {
-    int i, j, r;
-    char **row;
-    char key[1024];
-    groupP p;
-    int *index = (int *) malloc(ncols * sizeof(int));
-    groupby_init();
-    debugf("Rtab: grouping by\n");
-    for (i = 0; i < ncols; i++) {
-        debugf("%s\n", cols[i]);
-        for (j = 0; j < results->ncols; j++) {
-            if (strcmp(results->colnames[j], cols[i]) == 0) {
-                debugf("index is %d\n", j);
-                *(index + i) = j;
-            }
-        }
-    }
-    if (gverbose > 0) {
-        debugf("dumping indices\n");
-        for (i = 0; i < ncols; i++) {
-            debugf("%d = %i\n", i, *(index + i));
-        }
-    }
-    /* iterate through results */
-    for (r = 0; r < results->nrows; r++) {
-        row = rtab_getrow(results, r);
-        /* memset key to 0 */
-        memset(key, 0, 1024);
-        /* construct key */
-        j = 0;
-        for (i = 0; i < ncols; i++) {
-            j += sprintf(key+j, "%s%s", row[*(index+i)], separator);
-        }
-        debugf("row %d's key is %s\n", r, key);
-        /* lookup in hashtable */
-        if ((p = groupby_get(key)) == NULL) {
-            debugf("Key does not exist. Insert.\n");
-            p = groupby_set(key, results);
-        } else {
-            debugf("Key exists.\n");
-        }
-        groupby_addrow(p, results->rows[r]);
-    }
-    groupby_explode();
-    groupby_implode(results, isCountStar, containsMinMaxAvg, colattrib);
-    if (gverbose > 0) groupby_dump();
-    free(index);
-    groupby_free();
-    return;
-}
-
@@ -33,6 +33,7 @@
 #define _RTAB_H_
 
 #include "config.h"
+#include "arena.h"
 #include "srpc/srpc.h"
 
 /* Rtab Status flags */
@@ -54,16 +55,55 @@
 #define RTAB_MSG_UNREGISTER_FAILED 15
 #define RTAB_MSG_DELETE_FAILED 16
 
+/* status message of a chunk of results with more to FETCH, see cursor.h */
+#define RTAB_MSG_CURSOR "Cursor %ld"
+
+/*
+ * results packed by rtab_pack_binary(), in response to SQLB: requests,
+ * start with RTAB_BINARY_MAGIC; integers are little-endian, and a string
+ * is its 4-byte length n followed by n bytes and a NUL
+ *
+ *   magic[4] mtype[1] msg ncols[4] nrows[4]
+ *   ncols descriptors: encoding[1] "type:name"
+ *   ncols columns, each holding the nrows values of the column
+ *
+ * values of a column encoded as RTAB_ENC_INT, RTAB_ENC_REAL or
+ * RTAB_ENC_TSTAMP are 8 bytes each: a two's complement integer, an IEEE
+ * double or a timestamp; values of a column encoded as RTAB_ENC_STR
+ * are strings.  As for rtab_pack(), ncols is 0 if nrows is 0.
+ */
+#define RTAB_BINARY_MAGIC "HWB\001"
+#define RTAB_BINARY_MAGIC_LEN 4
+#define RTAB_ENC_INT 0
+#define RTAB_ENC_REAL 1
+#define RTAB_ENC_TSTAMP 2
+#define RTAB_ENC_STR 3
+
+union TupleSlot;
+
+/*
+ * vals, if not NULL, holds the native value of each column whose type is
+ * a number or a timestamp, as the row was projected from a tuple, which
+ * rtab_pack_binary() packs in place of parsing the text of the column
+ */
 typedef struct rrow {
     char **cols;		/* All data stored as strings */
+    union TupleSlot *vals;	/* Native values of the columns, or NULL */
 } Rrow;
 
+/*
+ * the rows, their arrays of columns and the values in them are allocated
+ * from the arena of the results, with rtab_new_row() and rtab_strdup(),
+ * and are only freed, all at once, by rtab_free(); the array of rows and
+ * the column names are malloc'ed
+ */
 typedef struct rtab {
     int nrows;
     int ncols;
     char **colnames;		/* Array of column names */
     int  **coltypes;		/* Array of column data types */
     Rrow **rows; 		/* Array of rows (data) */
+    Arena *arena;		/* Rows and their data, NULL until needed */
     /* Embedded messages (e.g. error messages) */
     char msg[RTAB_MSG_MAX_LENGTH];
     char mtype;
@@ -73,17 +113,24 @@ Rtab *rtab_new();
 Rtab *rtab_new_msg(char mtype, char *message);
 void rtab_free(Rtab *results);
 char **rtab_getrow(Rtab *results, int row);
+Rrow *rtab_new_row(Rtab *results);
+char *rtab_strdup(Rtab *results, char *value);
+Rrow *rtab_copy_row(Rtab *results, Rrow *row);
 void rtab_print(Rtab *results);
 int rtab_pack(Rtab *results, char *packed, int size, int *len);
 Rtab *rtab_unpack(char *packed, int len);
+int rtab_pack_binary(Rtab *results, char *packed, int size, int *len);
+int rtab_binary(char *packed, int len);
 int rtab_status(char *packed, char *stsmsg);
+int rtab_packed_header(Rtab *results);
+int rtab_packed_row(Rtab *results, Rrow *row);
 int rtab_send(Rtab *results, RpcConnection outgoing);
 
 /* Manipulators */
 void rtab_orderby(Rtab *results, char *colname);
-void rtab_groupby(Rtab *results, int ncols, char** cols,
-                  int isCountStar, int containsMinMaxAvg, int** colattrib);
+void rtab_limit(Rtab *results, long offset, long limit);
 void rtab_countstar(Rtab *results);
+void rtab_count(Rtab *results, long count);
 char *rtab_process_min(Rtab *results, int col);
 char *rtab_process_max(Rtab *results, int col);
 char *rtab_process_avg(Rtab *results, int col);
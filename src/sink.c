@@ -0,0 +1,889 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * sink.c - consumers of the rows selected by a query
+ */
+#include "sink.h"
+
+#include "tuple.h"
+#include "typetable.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#define SINK_ROWS 64		/* initial room for rows */
+
+/*
+ * frees a row malloc'ed by plan_project() or agg_row()
+ */
+static void free_row(Rrow *r, int ncols) {
+    int i;
+
+    for (i = 0; i < ncols; i++)
+        free(r->cols[i]);
+    free(r->cols);
+    free(r->vals);
+    free(r);
+}
+
+int sink_rows_new(Sink *sk) {
+    if (! (sk->rows = (Rrow **)malloc(SINK_ROWS * sizeof(Rrow *))))
+        return 0;
+    sk->nrows = 0;
+    sk->size = SINK_ROWS;
+    return 1;
+}
+
+int sink_keep(Sink *sk, Rrow *r) {
+    Rrow **rows;
+
+    if (! r)
+        return 0;
+    if (sk->nrows == sk->size) {
+        if (! (rows = (Rrow **)realloc(sk->rows, 2 * sk->size * sizeof(Rrow *))))
+            return 0;
+        sk->rows = rows;
+        sk->size *= 2;
+    }
+    sk->rows[sk->nrows++] = r;
+    return 1;
+}
+
+void sink_rows_done(Sink *sk) {
+    sk->results->nrows = (int)sk->nrows;
+    sk->results->rows = sk->rows;
+    sk->rows = NULL;
+}
+
+/*
+ * the rows are projected as they arrive, until as many as can be returned
+ * have been
+ */
+static int project_push(Sink *sk, Node *n) {
+    if (sk->want >= 0 && sk->count >= sk->want)
+        return 0;
+    if (! sink_keep(sk, plan_project(sk->plan, n, sk->results)))
+        return 0;
+    sk->count++;
+    return (sk->want < 0 || sk->count < sk->want);
+}
+
+static void project_finish(Sink *sk) {
+    sink_rows_done(sk);
+}
+
+/*
+ * a chunk takes rows until it has as many as it wants, or is out of room
+ */
+static int chunk_push(Sink *sk, Node *n) {
+    SinkChunk *ch = sk->chunk;
+    Rrow *r;
+    int len;
+
+    if (ch->skip > 0) {
+        ch->skip--;
+        return 1;
+    }
+    if (ch->want > 0 && (r = plan_project(sk->plan, n, sk->results))) {
+        /* a row that does not fit is left unused in the arena */
+        len = rtab_packed_row(sk->results, r);
+        if ((sk->count == 0 || len <= ch->room) && sink_keep(sk, r)) {
+            sk->count++;
+            ch->room -= len;
+            ch->last = n->tstamp;
+            if (--ch->want > 0)
+                return 1;
+        }
+    }
+    ch->full = 1;
+    return 0;
+}
+
+/*
+ * count(*) only needs the number of rows
+ */
+static int count_push(Sink *sk, Node *n) {
+    (void)n;
+    sk->count++;
+    return 1;
+}
+
+static void count_finish(Sink *sk) {
+    if (sk->count > 0)
+        rtab_count(sk->results, sk->count);
+}
+
+/*
+ * order by with a limit keeps only the rows that can still be returned,
+ * in a heap with the one that would be returned last at the top; the key
+ * of each row is taken from its tuple, and the row is only projected if
+ * it enters the heap.  Ties are kept in the order the rows were found,
+ * as rtab_orderby() does
+ */
+#define TOP_HEAP 64		/* initial size of the heap */
+
+typedef struct topentry {
+    union {
+        long long intv;
+        double realv;
+        tstamp_t tstampv;
+        char *str;		/* text of the column in the row */
+    } key;
+    long seq;			/* order in which the row was found */
+    Rrow *row;
+} TopEntry;
+
+typedef struct topsink {
+    int col;			/* result column ordered by */
+    int tcol;			/* column of the table, -1 for timestamp */
+    int class;			/* TUPLE_ class of the column */
+    long k;			/* number of rows to keep */
+    long n;			/* number of rows in the heap */
+    long size;			/* size of the heap */
+    TopEntry *heap;
+} TopSink;
+
+static int cmp_top(TopSink *t, TopEntry *a, TopEntry *b) {
+    int ans = 0;
+
+    switch (t->class) {
+    case TUPLE_INT:
+        ans = (a->key.intv > b->key.intv) - (a->key.intv < b->key.intv);
+        break;
+    case TUPLE_REAL:
+        ans = (a->key.realv > b->key.realv) - (a->key.realv < b->key.realv);
+        break;
+    case TUPLE_TSTAMP:
+        ans = (a->key.tstampv > b->key.tstampv) - (a->key.tstampv < b->key.tstampv);
+        break;
+    case TUPLE_STR:
+        ans = strcmp(a->key.str, b->key.str);
+        break;
+    }
+    if (ans)
+        return ans;
+    return (a->seq > b->seq) - (a->seq < b->seq);
+}
+
+static void top_key(TopSink *t, Node *n, TopEntry *e) {
+    if (t->tcol == -1)
+        e->key.tstampv = n->tstamp;
+    else if (t->class == TUPLE_STR)
+        e->key.str = tuple_str(n->tuple, t->tcol);
+    else
+        e->key.intv = tuple_int(n->tuple, t->tcol);	/* any fixed width */
+}
+
+static void top_down(TopSink *t, long i, long n) {
+    TopEntry e;
+    long j;
+
+    for (; (j = 2 * i + 1) < n; i = j) {
+        if (j + 1 < n && cmp_top(t, &(t->heap[j + 1]), &(t->heap[j])) > 0)
+            j++;
+        if (cmp_top(t, &(t->heap[j]), &(t->heap[i])) <= 0)
+            break;
+        e = t->heap[i];
+        t->heap[i] = t->heap[j];
+        t->heap[j] = e;
+    }
+}
+
+static void top_up(TopSink *t, long i) {
+    TopEntry e;
+    long j;
+
+    for (; i > 0 && cmp_top(t, &(t->heap[i]), &(t->heap[j = (i - 1) / 2])) > 0; i = j) {
+        e = t->heap[i];
+        t->heap[i] = t->heap[j];
+        t->heap[j] = e;
+    }
+}
+
+static int top_push(Sink *sk, Node *n) {
+    TopSink *t = sk->top;
+    TopEntry e, *p;
+    long size;
+
+    if (t->k == 0)
+        return 0;
+    top_key(t, n, &e);
+    e.seq = sk->count++;
+    if (t->n == t->k) {
+        if (cmp_top(t, &e, &(t->heap[0])) >= 0)
+            return 1;
+        free_row(t->heap[0].row, sk->results->ncols);
+        p = &(t->heap[0]);
+    } else {
+        if (t->n == t->size) {
+            size = (2 * t->size < t->k) ? 2 * t->size : t->k;
+            if (! (p = (TopEntry *)realloc(t->heap, size * sizeof(TopEntry)))) {
+                sk->failed = 1;
+                return 0;
+            }
+            t->heap = p;
+            t->size = size;
+        }
+        p = &(t->heap[t->n++]);
+    }
+    *p = e;
+    if (! (p->row = plan_project(sk->plan, n, NULL))) {
+        if (p != t->heap)
+            t->n--;
+        else {			/* the row it was to replace is gone */
+            t->heap[0] = t->heap[--t->n];
+            top_down(t, 0, t->n);
+        }
+        sk->failed = 1;
+        return 0;
+    }
+    if (t->class == TUPLE_STR)
+        p->key.str = p->row->cols[t->col];
+    if (p == t->heap)
+        top_down(t, 0, t->n);
+    else
+        top_up(t, t->n - 1);
+    return 1;
+}
+
+static void top_finish(Sink *sk) {
+    TopSink *t = sk->top;
+    TopEntry e;
+    Rrow *r;
+    long i;
+
+    if (! t->n)
+        return;
+    if (! (sk->results->rows = (Rrow **)malloc(t->n * sizeof(Rrow *)))) {
+        sk->failed = 1;
+        return;
+    }
+    /* heapsort, so that the rows come out in order */
+    for (i = t->n - 1; i > 0; i--) {
+        e = t->heap[0];
+        t->heap[0] = t->heap[i];
+        t->heap[i] = e;
+        top_down(t, 0, i);
+    }
+    /* the rows are copied into the arena, and freed with the sink */
+    for (i = 0; i < t->n; i++) {
+        if (! (r = rtab_copy_row(sk->results, t->heap[i].row))) {
+            sk->failed = 1;
+            break;
+        }
+        sk->results->rows[i] = r;
+        sk->results->nrows++;
+    }
+}
+
+static void top_free(TopSink *t, int ncols) {
+    long i;
+
+    for (i = 0; i < t->n; i++)
+        free_row(t->heap[i].row, ncols);
+    free(t->heap);
+    free(t);
+}
+
+/*
+ * returns a top sink if the rows are ordered by one of the results
+ */
+static TopSink *top_new(sqlselect *select, Plan *plan, Rtab *results, long k) {
+    TopSink *t;
+    int i;
+
+    for (i = 0; i < results->ncols; i++)
+        if (strcmp(results->colnames[i], select->orderby) == 0)
+            break;
+    if (i == results->ncols || ! (t = (TopSink *)malloc(sizeof(TopSink))))
+        return NULL;
+    t->col = i;
+    t->tcol = plan->proj[i];
+    t->class = (t->tcol == -1) ? TUPLE_TSTAMP :
+               tuple_class(plan->table->coltype[t->tcol]);
+    t->k = k;
+    t->n = 0;
+    t->size = (k < TOP_HEAP) ? k : TOP_HEAP;
+    if (! (t->heap = (TopEntry *)malloc((t->size + 1) * sizeof(TopEntry)))) {
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+/*
+ * min, max, avg and sum
+ *
+ * each result column that is aggregated has an accumulator in each group
+ * of rows (there is just the one group if there is no group by), which is
+ * updated from the tuple as each row arrives; the columns that are not
+ * aggregated take the values of the last row in the group, as does the
+ * group's row in the results.  Without a group by, if there are columns
+ * that are not aggregated, every row is kept, and the aggregates are
+ * filled in to all of them at the end.
+ *
+ * integer columns are accumulated as long long, and real ones as double;
+ * other columns cannot be aggregated, and produce "undefined"
+ *
+ * the groups are kept in an open-addressed table, local to the query,
+ * which doubles in size whenever it becomes half full; a group is found
+ * by comparing the values of its group by columns, as stored in the
+ * tuple, so no key is built for each row
+ */
+#define AGG_UNDEFINED 0
+#define AGG_INT 1
+#define AGG_REAL 2
+
+#define GROUP_TABLE 64		/* initial size of the table of groups */
+#define GROUP_BUCKETS 100	/* for ordering the groups, see below */
+
+typedef struct aggcol {
+    int attrib;			/* *SQL_COLATTRIB_ */
+    int class;			/* AGG_ class of the column */
+    int col;			/* column of the table, -1 for timestamp */
+    int keyed;			/* part of the group key */
+    int keyclass;		/* TUPLE_ class, if keyed */
+} AggCol;
+
+typedef union accum {
+    long long intv;		/* min, max or sum of an integer column */
+    double realv;		/* of a real column, or any average */
+} Accum;
+
+typedef struct group {
+    unsigned int hash;		/* hash of its key */
+    unsigned int bucket;	/* legacy hash bucket of its key, for ordering */
+    long seq;			/* order in which the group was found */
+    long n;			/* number of rows in the group */
+    Rrow *row;			/* values of the last row in the group */
+    union TupleSlot *key;	/* fixed-width values of the group by columns */
+    Accum acc[1];		/* accumulator per column, ncols of them */
+} Group;
+
+typedef struct aggsink {
+    int ncols;			/* number of result columns */
+    AggCol *cols;		/* the result columns */
+    int plain;			/* some column is not aggregated */
+    int ngroupcols;		/* number of group by columns */
+    int *groupcols;		/* result column of each */
+    Group **groups;		/* table of groups, if grouped */
+    unsigned long size;		/* size of the table, a power of 2 */
+    long ngroups;		/* number of groups in it */
+    Group *all;			/* the only group, if not grouped */
+} AggSink;
+
+static const char *separator = "<|>";	/* between values in a legacy key */
+
+/*
+ * fill in the columns of the row that are not aggregated; the columns in
+ * the key of a group are filled in, even if aggregated, only if all is set
+ *
+ * the row is in the arena of results, or malloc'ed if results is NULL,
+ * as is the row of a group, whose columns are replaced with each row
+ * that is folded into it
+ */
+static void agg_project(AggSink *a, Plan *plan, Node *n, Rrow *r, int all,
+                        Rtab *results) {
+    char buf[TUPLE_TEXT_LEN];
+    int i;
+
+    for (i = 0; i < a->ncols; i++) {
+        if ((a->cols[i].keyed) ? ! all : a->cols[i].attrib != *SQL_COLATTRIB_NONE)
+            continue;
+        if (results)
+            r->cols[i] = rtab_strdup(results, plan_text(plan, n, i, buf));
+        else {
+            free(r->cols[i]);
+            r->cols[i] = strdup(plan_text(plan, n, i, buf));
+        }
+    }
+}
+
+static Rrow *agg_row(AggSink *a, Rtab *results) {
+    Rrow *r;
+
+    if (results)
+        return rtab_new_row(results);
+    if (! (r = (Rrow *)malloc(sizeof(Rrow))))
+        return NULL;
+    if (! (r->cols = (char **)calloc(a->ncols, sizeof(char *)))) {
+        free(r);
+        return NULL;
+    }
+    r->vals = NULL;
+    return r;
+}
+
+static Group *agg_group(AggSink *a, long seq) {
+    Group *g;
+
+    if (! (g = (Group *)malloc(sizeof(Group) + a->ncols * sizeof(Accum) +
+                               a->ngroupcols * sizeof(union TupleSlot))))
+        return NULL;
+    g->key = (union TupleSlot *)&(g->acc[a->ncols]);
+    g->hash = 0;
+    g->bucket = 0;
+    g->seq = seq;
+    g->n = 0;
+    g->row = NULL;
+    return g;
+}
+
+static void agg_fold(AggSink *a, Group *g, Node *n) {
+    AggCol *c;
+    Accum *acc;
+    long long x;
+    double y;
+    int i;
+
+    for (i = 0; i < a->ncols; i++) {
+        c = &(a->cols[i]);
+        acc = &(g->acc[i]);
+        if (c->attrib == *SQL_COLATTRIB_NONE || c->class == AGG_UNDEFINED)
+            continue;
+        if (c->class == AGG_INT) {
+            x = tuple_int(n->tuple, c->col);
+            y = (double)x;
+        } else
+            x = (long long)(y = tuple_real(n->tuple, c->col));
+        if (c->attrib == *SQL_COLATTRIB_AVG) {
+            if (g->n)
+                acc->realv = (y + (double)g->n * acc->realv) / (double)(g->n + 1);
+            else
+                acc->realv = y;
+        } else if (c->class == AGG_INT) {
+            if (! g->n || (c->attrib == *SQL_COLATTRIB_MIN && x < acc->intv)
+                    || (c->attrib == *SQL_COLATTRIB_MAX && x > acc->intv))
+                acc->intv = x;
+            else if (c->attrib == *SQL_COLATTRIB_SUM)
+                acc->intv += x;
+        } else {
+            if (! g->n || (c->attrib == *SQL_COLATTRIB_MIN && y < acc->realv)
+                    || (c->attrib == *SQL_COLATTRIB_MAX && y > acc->realv))
+                acc->realv = y;
+            else if (c->attrib == *SQL_COLATTRIB_SUM)
+                acc->realv += y;
+        }
+    }
+    g->n++;
+}
+
+/*
+ * fill in the aggregated columns of the row from the group
+ */
+static void agg_fill(AggSink *a, Group *g, Rrow *r, Rtab *results) {
+    char tb[100];
+    AggCol *c;
+    int i;
+
+    for (i = 0; i < a->ncols; i++) {
+        c = &(a->cols[i]);
+        if (c->attrib == *SQL_COLATTRIB_NONE)
+            continue;
+        if (c->class == AGG_UNDEFINED)
+            strcpy(tb, "undefined");
+        else if (c->attrib == *SQL_COLATTRIB_AVG && c->class == AGG_INT)
+            sprintf(tb, "%lld", (long long)g->acc[i].realv);
+        else if (c->attrib == *SQL_COLATTRIB_AVG || c->class == AGG_REAL)
+            sprintf(tb, "%f", g->acc[i].realv);
+        else
+            sprintf(tb, "%lld", g->acc[i].intv);
+        r->cols[i] = rtab_strdup(results, tb);
+    }
+}
+
+static int agg_push(Sink *sk, Node *n) {
+    AggSink *a = sk->agg;
+    Rrow *r;
+
+    agg_fold(a, a->all, n);
+    if (a->plain && (r = agg_row(a, sk->results))) {
+        agg_project(a, sk->plan, n, r, 1, sk->results);
+        (void)sink_keep(sk, r);
+    }
+    return 1;
+}
+
+/*
+ * the fixed-width value of result column i of the row
+ */
+static union TupleSlot *key_slot(AggSink *a, Node *n, int i,
+                                 union TupleSlot *slot) {
+    if (a->cols[i].col == -1) {
+        slot->tstampv = n->tstamp;
+        return slot;
+    }
+    return &tuple_slot(n->tuple, a->cols[i].col);
+}
+
+static unsigned int group_hash(AggSink *a, Node *n) {
+    unsigned long long h = 14695981039346656037ULL;
+    union TupleSlot slot;
+    unsigned char *p;
+    int i, c;
+
+    for (i = 0; i < a->ngroupcols; i++) {
+        c = a->groupcols[i];
+        if (a->cols[c].keyclass == TUPLE_STR) {
+            for (p = (unsigned char *)tuple_str(n->tuple, a->cols[c].col); *p; p++)
+                h = (h ^ *p) * 1099511628211ULL;
+        } else
+            h = (h ^ (unsigned long long)key_slot(a, n, c, &slot)->intv)
+                * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 29;
+    }
+    return (unsigned int)(h ^ (h >> 32));
+}
+
+static int group_matches(AggSink *a, Group *g, Node *n) {
+    union TupleSlot slot;
+    int i, c;
+
+    for (i = 0; i < a->ngroupcols; i++) {
+        c = a->groupcols[i];
+        if (a->cols[c].keyclass == TUPLE_STR) {
+            if (strcmp(tuple_str(n->tuple, a->cols[c].col), g->row->cols[c]))
+                return 0;
+        } else if (key_slot(a, n, c, &slot)->intv != g->key[i].intv)
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * the legacy key of a group was the text of its columns, each followed by
+ * the separator; groups are still listed in the order of its hash bucket
+ */
+static unsigned int group_bucket(AggSink *a, Rrow *r) {
+    unsigned int h = 0;
+    const char *p;
+    int i;
+
+    for (i = 0; i < a->ngroupcols; i++) {
+        for (p = r->cols[a->groupcols[i]]; *p; p++)
+            h = 31 * h + *p;
+        for (p = separator; *p; p++)
+            h = 31 * h + *p;
+    }
+    return h % GROUP_BUCKETS;
+}
+
+/*
+ * doubles the size of the table of groups
+ */
+static int group_grow(AggSink *a) {
+    unsigned long i, j, size = 2 * a->size;
+    Group **groups;
+
+    if (! (groups = (Group **)calloc(size, sizeof(Group *))))
+        return 0;
+    for (i = 0; i < a->size; i++) {
+        if (! a->groups[i])
+            continue;
+        for (j = a->groups[i]->hash & (size - 1); groups[j]; j = (j + 1) & (size - 1))
+            ;
+        groups[j] = a->groups[i];
+    }
+    free(a->groups);
+    a->groups = groups;
+    a->size = size;
+    return 1;
+}
+
+static int group_push(Sink *sk, Node *n) {
+    AggSink *a = sk->agg;
+    union TupleSlot slot;
+    unsigned int hash;
+    unsigned long j;
+    int i;
+    Group *g;
+
+    hash = group_hash(a, n);
+    for (j = hash & (a->size - 1); (g = a->groups[j]); j = (j + 1) & (a->size - 1))
+        if (g->hash == hash && group_matches(a, g, n))
+            break;
+    if (g) {
+        agg_project(a, sk->plan, n, g->row, 0, NULL);
+        agg_fold(a, g, n);
+        return 1;
+    }
+    if (2 * (a->ngroups + 1) > (long)a->size) {
+        if (! group_grow(a))
+            return 1;
+        for (j = hash & (a->size - 1); a->groups[j]; j = (j + 1) & (a->size - 1))
+            ;
+    }
+    if (! (g = agg_group(a, a->ngroups)))
+        return 1;
+    if (! (g->row = agg_row(a, NULL))) {
+        free(g);
+        return 1;
+    }
+    agg_project(a, sk->plan, n, g->row, 1, NULL);
+    for (i = 0; i < a->ngroupcols; i++)
+        g->key[i] = *key_slot(a, n, a->groupcols[i], &slot);
+    g->hash = hash;
+    g->bucket = group_bucket(a, g->row);
+    a->groups[j] = g;
+    a->ngroups++;
+    agg_fold(a, g, n);
+    return 1;
+}
+
+static void agg_rename(Sink *sk) {
+    AggSink *a = sk->agg;
+    int i;
+
+    for (i = 0; i < a->ncols; i++) {
+        if (a->cols[i].attrib != *SQL_COLATTRIB_NONE)
+            rtab_update_colname(sk->results, i,
+                                (char *)colattrib_name[a->cols[i].attrib]);
+    }
+}
+
+static void agg_finish(Sink *sk) {
+    AggSink *a = sk->agg;
+    long i;
+
+    if (! a->all->n)	/* no rows, so nothing to aggregate */
+        return;
+    agg_rename(sk);
+    if (! a->plain)
+        (void)sink_keep(sk, agg_row(a, sk->results));
+    sink_rows_done(sk);
+    for (i = 0; i < sk->results->nrows; i++)
+        agg_fill(a, a->all, sk->results->rows[i], sk->results);
+}
+
+/*
+ * groups are listed by the bucket that their key hashes to, and within a
+ * bucket, most recently found first
+ */
+static int cmp_group(const void *x, const void *y) {
+    Group *g = *(Group **)x, *h = *(Group **)y;
+
+    if (g->bucket != h->bucket)
+        return (g->bucket < h->bucket) ? -1 : 1;
+    return (g->seq > h->seq) ? -1 : (g->seq < h->seq);
+}
+
+static void group_finish(Sink *sk) {
+    AggSink *a = sk->agg;
+    Group **groups;
+    unsigned long j;
+    long i, n;
+    Rrow *r;
+
+    if (! (n = a->ngroups))
+        return;
+    if (! (groups = (Group **)malloc(n * sizeof(Group *))))
+        return;
+    if (! (sk->results->rows = (Rrow **)malloc(n * sizeof(Rrow *)))) {
+        free(groups);
+        return;
+    }
+    agg_rename(sk);
+    for (i = 0, j = 0; j < a->size; j++)
+        if (a->groups[j])
+            groups[i++] = a->groups[j];
+    qsort(groups, n, sizeof(Group *), cmp_group);
+    /* the rows are copied into the arena, and freed with the groups */
+    for (i = 0; i < n; i++) {
+        if (! (r = rtab_copy_row(sk->results, groups[i]->row)))
+            break;
+        agg_fill(a, groups[i], r, sk->results);
+        sk->results->rows[i] = r;
+        sk->results->nrows++;
+    }
+    free(groups);
+}
+
+static void agg_free(AggSink *a) {
+    unsigned long j;
+    Group *g;
+
+    for (j = 0; j < a->size; j++) {
+        if (! (g = a->groups[j]))
+            continue;
+        if (g->row)
+            free_row(g->row, a->ncols);
+        free(g);
+    }
+    free(a->groups);
+    free(a->all);
+    free(a->groupcols);
+    free(a->cols);
+    free(a);
+}
+
+/*
+ * sets up the columns of an aggregating sink; if aggregate is not set,
+ * no column is aggregated
+ */
+static AggSink *agg_new(sqlselect *select, Plan *plan, Rtab *results,
+                        int aggregate) {
+    AggSink *a;
+    AggCol *c;
+    int i, j;
+
+    if (! (a = (AggSink *)calloc(1, sizeof(AggSink))))
+        return NULL;
+    a->ncols = results->ncols;
+    if (! (a->cols = (AggCol *)calloc(a->ncols + 1, sizeof(AggCol))))
+        goto fail;
+    for (i = 0; i < a->ncols; i++) {
+        c = &(a->cols[i]);
+        c->col = plan->proj[i];
+        c->attrib = (aggregate) ? *select->colattrib[i] : *SQL_COLATTRIB_NONE;
+        if (results->coltypes[i] == PRIMTYPE_INTEGER ||
+                results->coltypes[i] == PRIMTYPE_TINYINT ||
+                results->coltypes[i] == PRIMTYPE_SMALLINT)
+            c->class = AGG_INT;
+        else if (results->coltypes[i] == PRIMTYPE_REAL)
+            c->class = AGG_REAL;
+        else
+            c->class = AGG_UNDEFINED;
+        if (c->attrib == *SQL_COLATTRIB_NONE)
+            a->plain = 1;
+    }
+    if (select->groupby_ncols > 0) {
+        a->ngroupcols = select->groupby_ncols;
+        if (! (a->groupcols = (int *)calloc(a->ngroupcols, sizeof(int))))
+            goto fail;
+        /* the last result column with the name of each group by column */
+        for (i = 0; i < a->ngroupcols; i++)
+            for (j = 0; j < a->ncols; j++)
+                if (strcmp(results->colnames[j], select->groupby_cols[i]) == 0)
+                    a->groupcols[i] = j;
+        for (i = 0; i < a->ngroupcols; i++) {
+            c = &(a->cols[a->groupcols[i]]);
+            c->keyed = 1;
+            c->keyclass = (c->col == -1) ? TUPLE_TSTAMP :
+                          tuple_class(plan->table->coltype[c->col]);
+        }
+        if (! (a->groups = (Group **)calloc(GROUP_TABLE, sizeof(Group *))))
+            goto fail;
+        a->size = GROUP_TABLE;
+    } else if (! (a->all = agg_group(a, 0)))
+        goto fail;
+    return a;
+fail:
+    agg_free(a);
+    return NULL;
+}
+
+Sink *sink_new(sqlselect *select, Plan *plan, Rtab *results) {
+    Sink *sk;
+
+    if (! (sk = (Sink *)malloc(sizeof(Sink))))
+        return NULL;
+    sk->plan = plan;
+    sk->results = results;
+    sk->rows = NULL;
+    sk->count = 0;
+    sk->want = -1;
+    sk->agg = NULL;
+    sk->top = NULL;
+    sk->join = NULL;
+    sk->chunk = NULL;
+    sk->failed = 0;
+    if (select->groupby_ncols > 0) {
+        /* count(*) is not computed per group */
+        sk->agg = agg_new(select, plan, results,
+                          select->containsMinMaxAvgSum && ! select->isCountStar);
+        sk->push = group_push;
+        sk->finish = group_finish;
+    } else if (select->isCountStar) {
+        sk->push = count_push;
+        sk->finish = count_finish;
+        return sk;
+    } else if (select->containsMinMaxAvgSum) {
+        sk->agg = agg_new(select, plan, results, 1);
+        sk->push = agg_push;
+        sk->finish = agg_finish;
+    } else {
+        if (select->limit >= 0 && select->limit <= LONG_MAX - select->offset)
+            sk->want = select->limit + select->offset;
+        if (sk->want >= 0 && select->orderby &&
+                (sk->top = top_new(select, plan, results, sk->want))) {
+            sk->push = top_push;
+            sk->finish = top_finish;
+            return sk;
+        }
+        sk->push = project_push;
+        sk->finish = project_finish;
+        if (select->orderby)	/* any of the rows may be returned */
+            sk->want = -1;
+    }
+    if ((sk->agg || sk->push == project_push) && sink_rows_new(sk))
+        return sk;
+    if (sk->agg)
+        agg_free(sk->agg);
+    free(sk);
+    return NULL;
+}
+
+Sink *sink_new_chunk(Plan *plan, Rtab *results, SinkChunk *ch) {
+    Sink *sk;
+
+    if (! (sk = (Sink *)calloc(1, sizeof(Sink))))
+        return NULL;
+    if (! sink_rows_new(sk)) {
+        free(sk);
+        return NULL;
+    }
+    sk->plan = plan;
+    sk->results = results;
+    sk->want = -1;
+    sk->chunk = ch;
+    sk->push = chunk_push;
+    sk->finish = project_finish;
+    ch->full = 0;
+    return sk;
+}
+
+int sink_finish(Sink *sk) {
+    int ok;
+
+    sk->finish(sk);
+    ok = ! sk->failed;
+    free(sk->rows);
+    if (sk->agg)
+        agg_free(sk->agg);
+    if (sk->top)
+        top_free(sk->top, sk->results->ncols);
+    free(sk);
+    return ok;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * sink.h - consumers of the rows selected by a query
+ *
+ * a scan of a table pushes each row that lies in the window and passes
+ * the filters straight into a sink, which projects it, or folds it into
+ * an aggregate, there and then; nothing is marked or collected between
+ * the scan and the sink.  Rows are built in the arena of the results,
+ * apart from those that a sink may drop again, which it keeps to itself
+ * until it knows which it wants.  Once the scan is over, sink_finish()
+ * leaves the rows produced by the sink in the results and frees the
+ * sink; the results are left to be ordered, and cut down to the limit,
+ * by the caller (see rtab_orderby() and rtab_limit())
+ */
+#ifndef _SINK_H_
+#define _SINK_H_
+
+#include "node.h"
+#include "plan.h"
+#include "rtab.h"
+#include "sqlstmts.h"
+
+typedef struct sink Sink;
+
+/*
+ * state of a sink filling one chunk of the rows of a cursor (see
+ * cursor.h), kept by the caller across chunks
+ */
+typedef struct sinkchunk {
+    long skip;			/* rows still to skip for the offset */
+    long want;			/* rows wanted in the chunk */
+    int room;			/* bytes left for rows once packed */
+    int full;			/* set once no more rows are wanted */
+    tstamp_t last;		/* timestamp of the last row taken */
+} SinkChunk;
+
+struct sink {
+    int (*push)(Sink *sk, Node *n);	/* consume a row, 0 if no more wanted */
+    void (*finish)(Sink *sk);		/* fill in the results */
+    Plan *plan;				/* projection of the rows */
+    Rtab *results;			/* where the rows end up */
+    Rrow **rows;			/* projected rows, in order, if kept */
+    long nrows;				/* number of them */
+    long size;				/* room for rows */
+    long count;				/* number of rows pushed */
+    long want;				/* rows wanted, -1 if all */
+    struct aggsink *agg;		/* state of an aggregating sink */
+    struct topsink *top;		/* state of an order by ... limit sink */
+    struct join *join;			/* state of a join sink, see join.h */
+    SinkChunk *chunk;			/* state of a chunk sink */
+    int failed;				/* set if a row was lost for memory */
+};
+
+/*
+ * returns a sink for the rows of a select, with the columns already
+ * stored in results; the plan must outlive the sink
+ *
+ * count(*), min, max, avg, sum and group by are computed as the rows are
+ * pushed, with typed accumulators, and only the rows of the final result
+ * are ever built; with a limit, only the rows that can still be returned
+ * are kept
+ *
+ * returns NULL if there is insufficient memory
+ */
+Sink *sink_new(sqlselect *select, Plan *plan, Rtab *results);
+
+/*
+ * returns a sink that projects rows into results, with the columns
+ * already stored in it, after skipping ch->skip rows, until ch->want
+ * rows have been taken or the next would not fit in ch->room bytes when
+ * packed, updating ch as it goes; the first row taken always fits
+ *
+ * returns NULL if there is insufficient memory
+ */
+Sink *sink_new_chunk(Plan *plan, Rtab *results, SinkChunk *ch);
+
+/*
+ * makes room in the sink for the rows that it keeps, before any are
+ * pushed; returns 0 if there is insufficient memory
+ */
+int sink_rows_new(Sink *sk);
+
+/*
+ * keeps a row, built in the arena of the results, at the end of those
+ * already kept; returns 0 if there is insufficient memory
+ */
+int sink_keep(Sink *sk, Rrow *r);
+
+/*
+ * hands the rows kept to the results
+ */
+void sink_rows_done(Sink *sk);
+
+/*
+ * pushes a row into the sink; returns 0 if the sink wants no more rows,
+ * in which case the scan may stop early
+ */
+#define sink_push(sk, n) ((sk)->push((sk), (n)))
+
+/*
+ * completes the results and frees the sink
+ *
+ * returns 0 if a row was lost for lack of memory, in which case the
+ * results are incomplete
+ */
+int sink_finish(Sink *sk);
+
+#endif /* _SINK_H_ */
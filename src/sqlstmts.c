@@ -122,6 +122,7 @@ sqlfilter *sqlstmt_new_filter(int ctype, char *name, int dtype, char *value) {
 
     filter = malloc(sizeof(sqlfilter));
     filter->IS_STR = 0;
+    filter->IS_PARAM = 0;
     filter->varname = name;
     switch(ctype) {
     case EQUALS:
@@ -169,6 +170,11 @@ sqlfilter *sqlstmt_new_filter(int ctype, char *name, int dtype, char *value) {
         filter->value.stringv = strdup(value);
         filter->IS_STR = 1;
         debugvf("VALUE IS :%s\n",filter->value.stringv);
+        break;
+    case PARAM:
+        filter->value.intv = 0;
+        filter->IS_PARAM = 1;
+        break;
     }
     return filter;
 }
@@ -178,6 +184,7 @@ sqlpair *sqlstmt_new_pair(int ctype, char *name, int dtype, char *value) {
 
     pair = malloc(sizeof(sqlpair));
     pair->IS_STR = 0;
+    pair->IS_PARAM = 0;
     pair->varname = name;
     switch(ctype) {
     case EQUALS:
@@ -213,10 +220,24 @@ sqlpair *sqlstmt_new_pair(int ctype, char *name, int dtype, char *value) {
         pair->value.stringv = strdup(value);
         pair->IS_STR = 0;
         debugvf("VALUE IS :%s\n",pair->value.stringv);
+        break;
+    case PARAM:
+        pair->value.intv = 0;
+        pair->IS_PARAM = 1;
+        break;
     }
     return pair;
 }
 
+sqljoin *sqlstmt_new_join(char *left, char *right) {
+    sqljoin *join;
+
+    join = malloc(sizeof(sqljoin));
+    join->left = left;
+    join->right = right;
+    return join;
+}
+
 int sqlstmt_calc_len(sqlinsert *insert) {
     int total;
     int i;
@@ -38,6 +38,7 @@
 #define _SQLSTMTS_H_
 
 #include "typetable.h"
+#include "adts/linkedlist.h"
 
 #define SQL_TYPE_SELECT 1
 #define SQL_TYPE_CREATE 2
@@ -48,6 +49,8 @@
 #define SQL_TYPE_UNREGISTER 7
 #define SQL_TYPE_DELETE 8
 #define SQL_TABLE_META 9
+#define SQL_TYPE_INDEX 10
+#define SQL_TYPE_EXECUTE 11
 
 #define SQL_WINTYPE_NONE 0
 #define SQL_WINTYPE_TIME 1
@@ -61,6 +64,14 @@
 #define SQL_WINTYPE_TIME_NOW 4
 #define SQL_WINTYPE_TIME_MILLIS 5
 
+#define SQL_RETAIN_NONE 0
+#define SQL_RETAIN_ROWS 1
+#define SQL_RETAIN_MILLIS 2
+#define SQL_RETAIN_BYTES 3
+
+#define SQL_INDEX_HASH 0
+#define SQL_INDEX_ORDERED 1
+
 #define SQL_FILTER_EQUAL 1
 #define SQL_FILTER_GREATER 2
 #define SQL_FILTER_LESS 3
@@ -117,8 +128,14 @@ typedef struct sqlfilter {
     int sign; /* =, >, <, <=, >= */
     union filterval value;
     unsigned char IS_STR;
+    unsigned char IS_PARAM; /* value is a ? placeholder, bound when executed */
 } sqlfilter;
 
+typedef struct sqljoin {
+    char *left;		/* column of one table, as named in the statement */
+    char *right;	/* column of the other, equal to left */
+} sqljoin;
+
 typedef struct sqlselect {
     int ncols;
     char **cols;
@@ -134,6 +151,10 @@ typedef struct sqlselect {
     int groupby_ncols;
     char **groupby_cols;
     int containsMinMaxAvgSum;
+    long limit;		/* rows to return, -1 if no limit */
+    long offset;	/* rows to skip before returning any */
+    int njoins;
+    sqljoin **joins;	/* Array of join conditions between the tables */
 } sqlselect;
 
 typedef struct sqlpair {
@@ -141,6 +162,7 @@ typedef struct sqlpair {
     int sign; /* =, +=, -= */
     union filterval value;
     unsigned char IS_STR;
+    unsigned char IS_PARAM;
 } sqlpair;
 
 typedef struct sqlupdate {
@@ -159,13 +181,22 @@ typedef struct sqlcreate {
     int **coltype;
     short tabletype;
     short primary_column;
+    short retain;		/* SQL_RETAIN_ type of retention policy */
+    long long retain_limit;	/* rows, milliseconds or bytes to retain */
 } sqlcreate;
 
+typedef struct sqlindex {
+    char *name;
+    char *tablename;
+    char *colname;
+    int kind;			/* SQL_INDEX_ type of index, -1 if unknown */
+} sqlindex;
+
 typedef struct sqlinsert {
     char *tablename;
     int ncols;
     char **colval;
-    int **coltype;
+    int **coltype;	/* NULL for a ? placeholder */
     short transform;
 } sqlinsert;
 
@@ -187,6 +218,13 @@ typedef struct sqlunregister {
     char *id;
 } sqlunregister;
 
+typedef struct sqlexecute {
+    char *name;		/* prepared statement to execute */
+    int nargs;
+    char **argval;	/* values for its placeholders, as in an insert */
+    int **argtype;
+} sqlexecute;
+
 typedef struct sqlmeta {
     char *table;
 } sqlmeta;
@@ -197,15 +235,64 @@ typedef struct sqlstmt {
     union {
         sqlselect select;
         sqlcreate create;
+        sqlindex index;
         sqlinsert insert;
         sqlupdate update;
         sqldelete delete;
         sqlregister regist;
         sqlunregister unregist;
         sqlmeta meta;
+        sqlexecute execute;
     } sql;
 } sqlstmt;
 
+/*
+ * state of one parse of a statement: the statement being built, and what
+ * is collected for it on the way; each call of sql_parse() has its own,
+ * so statements can be parsed on several threads at once
+ */
+typedef struct sqlparse {
+    sqlstmt *stmt;		/* statement being built */
+    /* Select */
+    LinkedList *clist;
+    LinkedList *cattriblist;
+    LinkedList *tlist;
+    LinkedList *flist;
+    LinkedList *jlist;		/* join list */
+    LinkedList *wlist;
+    LinkedList *plist;		/* pair list */
+    sqlwindow *tmpwin;
+    int tmpunit;
+    sqlfilter *tmpfilter;
+    sqlpair *tmppair;
+    int tmpvaltype;
+    char *tmpvalstr;
+    int filtertype;
+    char *orderby;
+    long limitrows;
+    long offsetrows;
+    int countstar;
+    LinkedList *grouplist;
+    sqlinterval tmpinterval;
+    /* Create */
+    char *tablename;
+    LinkedList *colnames;
+    LinkedList *coltypes;
+    short tabletype;
+    short primary_column;
+    short column;
+    short retain;
+    long long retain_limit;
+    /* Create index -- tablename from above */
+    char *indexname;
+    char *indexcol;
+    int indexkind;
+    /* Insert -- tablename and coltypes from above */
+    LinkedList *colvals;
+    short transform;
+    long dummyLong;		/* for calls to ll_toArray */
+} SqlParse;
+
 /* Helper functions */
 
 sqlwindow *sqlstmt_new_stubwindow();
@@ -223,6 +310,7 @@ sqlfilter *sqlstmt_new_filter_greatereq(char *name, int value);
 sqlfilter *sqlstmt_new_filter_lesseq(char *name, int value);
 
 sqlpair *sqlstmt_new_pair(int ctype, char *name, int dtype, char *value);
+sqljoin *sqlstmt_new_join(char *left, char *right);
 
 int sqlstmt_calc_len(sqlinsert *insert);
 int sqlstmt_valid_groupby(sqlselect *select);
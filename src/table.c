@@ -39,19 +39,36 @@
 
 #include "util.h"
 #include "typetable.h"
+#include "tuple.h"
 #include "sqlstmts.h"
 #include "pubsub.h"
+#include "colindex.h"
 #include "srpc/srpc.h"
 
 #include <string.h>
 #include <pthread.h>
 #include <stdlib.h>
 
-Table *table_new(int ncols, char **colname, int **coltype) {
-    Table *tn;
+/*
+ * initial capacity of the primary key index of a persistent table
+ */
+#define TABLE_PKINDEX_SIZE 1024L
+
+/*
+ * number of rows between timestamp checkpoints, and initial number of
+ * checkpoints in the ring
+ */
+#define TABLE_TSINDEX_GAP 64
+#define TABLE_TSINDEX_SIZE 64L
+
+/*
+ * initialize a table in place, with no rows
+ */
+void table_init(Table *tn, int ncols, char **colname, int **coltype) {
     int i;
 
-    tn = malloc(sizeof(Table));
+    tn->tabletype = 0;
+    tn->primary_column = -1;
     tn->ncols = ncols;
     tn->colname = (char **)malloc(ncols * sizeof(char *));
     tn->coltype = (int **)malloc(ncols * sizeof(int *));
@@ -62,11 +79,51 @@ Table *table_new(int ncols, char **colname, int **coltype) {
     tn->oldest = NULL;
     tn->newest = NULL;
     tn->count = 0;
-    pthread_mutex_init(&tn->tb_mutex, NULL);
+    tn->shard = 0;
+    tn->retain = SQL_RETAIN_NONE;
+    tn->retain_limit = 0;
+    tn->nbytes = 0;
+    tn->pkindex = NULL;
+    memset(&(tn->tsindex), 0, sizeof(TSIndex));
+    tn->indexes = NULL;
+    tn->topic = NULL;
+    tn->restored = 0;
+    table_lock_init(tn);
+}
+
+Table *table_new(int ncols, char **colname, int **coltype) {
+    Table *tn;
+
+    tn = malloc(sizeof(Table));
+    table_init(tn, ncols, colname, coltype);
 
     return tn;
 }
 
+/*
+ * re-initialize a stream table whose rows were retained in the memory
+ * buffer file across a restart; the rows and the shard are kept, all
+ * other state is rebuilt
+ */
+void table_restore(Table *tn, int ncols, char **colname, int **coltype) {
+    struct node *oldest = tn->oldest;
+    struct node *newest = tn->newest;
+    long count = tn->count;
+    long nbytes = tn->nbytes;
+    int shard = tn->shard;
+
+    struct node *n;
+
+    table_init(tn, ncols, colname, coltype);
+    tn->oldest = oldest;
+    tn->newest = newest;
+    tn->count = count;
+    tn->nbytes = nbytes;
+    tn->shard = shard;
+    for (n = oldest; n; n = n->next)	/* rebuild the timestamp index */
+        table_ts_append(tn, n);
+}
+
 static int table_contains_col(Table *tn, char *colname) {
     int i;
 
@@ -100,14 +157,37 @@ int table_colnames_match(Table *tn, sqlselect *select) {
     return 1;
 }
 
+/*
+ * a table is locked exclusively by anything that changes its rows or its
+ * indexes, and shared by queries, which keep their crawl state to
+ * themselves; writers are preferred where supported, so that a stream of
+ * queries cannot hold off inserts
+ */
+void table_lock_init(Table *tn) {
+    pthread_rwlockattr_t attr;
+
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&attr,
+                                  PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif /* __GLIBC__ */
+    pthread_rwlock_init(&tn->tb_lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+}
+
 void table_lock(Table *tn) {
     debugf("Table: Acquiring lock...\n");
-    pthread_mutex_lock(&tn->tb_mutex);
+    pthread_rwlock_wrlock(&tn->tb_lock);
+}
+
+void table_rdlock(Table *tn) {
+    debugf("Table: Acquiring shared lock...\n");
+    pthread_rwlock_rdlock(&tn->tb_lock);
 }
 
 void table_unlock(Table *tn) {
     debugf("Table: Releasing lock...\n");
-    pthread_mutex_unlock(&tn->tb_mutex);
+    pthread_rwlock_unlock(&tn->tb_lock);
 }
 
 void table_store_select_cols(Table *tn, sqlselect *select, Rtab *results) {
@@ -184,11 +264,281 @@ int table_lookup_colindex(Table *tn, char *colname) {
 void table_tabletype(Table *tn, short tabletype, short primary_column) {
     tn->tabletype = tabletype;
     tn->primary_column = primary_column;
+    if (tabletype && ! tn->pkindex)
+        tn->pkindex = hm_create(TABLE_PKINDEX_SIZE, 0.75);
 }
 
 int table_persistent(Table *tn) {
     return (tn->tabletype);
 }
+/*
+ * check that a row of ncols values with the given types can be inserted
+ * into the table
+ */
+int table_compatible(Table *tn, int ncols, int **coltypes) {
+    int i;
+
+    if (tn->ncols != ncols) {
+        errorf("Insert: Not the same number of columns\n");
+        return 0;
+    }
+    for (i = 0; i < tn->ncols; i++) {
+        if (tn->coltype[i] != coltypes[i]) {
+            errorf("Insert: Incompatible column type column num: %d\n", i);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * set the retention policy of a stream table; see mb_insert_tuple()
+ */
+void table_retention(Table *tn, short retain, long long retain_limit) {
+    tn->retain = retain;
+    tn->retain_limit = retain_limit;
+}
+
+int table_retained(Table *tn) {
+    return (tn->retain != SQL_RETAIN_NONE);
+}
+
 int table_key(Table *tn) {
     return (tn->primary_column);
 }
+
+/*
+ * the primary key index of a persistent table maps the text of the key
+ * column to the node holding it; fixed-width keys are put into canonical
+ * form, so that, e.g., "7" and "007" are the same integer key
+ *
+ * all of these must be called with the table locked
+ */
+static char *pk_node_text(Table *tn, Node *n, char *buf) {
+    int key = tn->primary_column;
+    return tuple_text(n->tuple, key, tn->coltype[key], buf);
+}
+
+static char *pk_value_text(Table *tn, char *value, char *buf) {
+    int *type = tn->coltype[tn->primary_column];
+    union TupleSlot v;
+
+    if (tuple_class(type) == TUPLE_STR)
+        return value;
+    tuple_parse(value, type, &v);
+    return tuple_text((unsigned char *)&v, 0, type, buf);
+}
+
+void table_pk_add(Table *tn, Node *n) {
+    char buf[TUPLE_TEXT_LEN];
+    void *prev;
+
+    if (tn->pkindex)
+        (void) hm_put(tn->pkindex, pk_node_text(tn, n, buf), n, &prev);
+}
+
+void table_pk_remove(Table *tn, Node *n) {
+    char buf[TUPLE_TEXT_LEN], *k;
+    void *found;
+
+    if (! tn->pkindex)
+        return;
+    k = pk_node_text(tn, n, buf);
+    /* only drop the entry if it refers to this node */
+    if (hm_get(tn->pkindex, k, &found) && found == n)
+        (void) hm_remove(tn->pkindex, k, &found);
+}
+
+Node *table_pk_lookup(Table *tn, char *value) {
+    char buf[TUPLE_TEXT_LEN];
+    void *found;
+
+    if (tn->pkindex && hm_get(tn->pkindex, pk_value_text(tn, value, buf), &found))
+        return (Node *)found;
+    return NULL;
+}
+
+/*
+ * returns the row of a persistent table with the key of colvals, the
+ * values of a row to be inserted, or NULL if there is none
+ *
+ * the row may be gone once the lock is dropped, so this only answers
+ * whether there is one; heap_insert_tuple() looks the key up itself
+ */
+Node *table_constrained(Table *tn, char **colvals) {
+    Node *found = NULL;
+
+    table_rdlock(tn);
+    if (table_persistent(tn)) {
+        /* If the key is the timestamp, ignore under the assumption
+         * that all timestamps are unique. In any case, the new re-
+         * cord has not been assigned a timestamp yet.
+         */
+        debugvf("Value at key index is %s\n", colvals[tn->primary_column]);
+        found = table_pk_lookup(tn, colvals[tn->primary_column]);
+    }
+    table_unlock(tn);
+    return found;
+}
+
+/*
+ * the timestamp index of a stream table; see table.h
+ *
+ * all of these must be called with the table locked
+ */
+
+/*
+ * note that n has been appended to the table, checkpointing it if it is
+ * time to do so
+ */
+void table_ts_append(Table *tn, Node *n) {
+    TSIndex *x = &(tn->tsindex);
+
+    if (n == tn->oldest)		/* table was empty, start afresh */
+        x->since = x->head = x->count = 0;
+    if (x->since++ % TABLE_TSINDEX_GAP)
+        return;
+    if (x->count == x->size) {	/* full, so double it and unwrap */
+        long i, size = (x->size) ? 2 * x->size : TABLE_TSINDEX_SIZE;
+        TSCheckpoint *r = (TSCheckpoint *)malloc(size * sizeof(TSCheckpoint));
+        if (! r) {			/* index is just less useful */
+            x->since = 0;
+            return;
+        }
+        for (i = 0; i < x->count; i++)
+            r[i] = x->ring[(x->head + i) % x->size];
+        free(x->ring);
+        x->ring = r;
+        x->size = size;
+        x->head = 0;
+    }
+    x->ring[(x->head + x->count) % x->size].tstamp = n->tstamp;
+    x->ring[(x->head + x->count) % x->size].node = n;
+    x->count++;
+}
+
+/*
+ * note that n, the oldest row in the table, has been removed
+ */
+void table_ts_evict(Table *tn, Node *n) {
+    TSIndex *x = &(tn->tsindex);
+
+    if (x->count && x->ring[x->head].node == n) {
+        x->head = (x->head + 1) % x->size;
+        x->count--;
+    }
+}
+
+/*
+ * note that n, which need not be the oldest row in the table, has been
+ * removed
+ */
+void table_ts_remove(Table *tn, Node *n) {
+    TSIndex *x = &(tn->tsindex);
+    long lo = 0, hi = x->count, mid;
+
+    while (lo < hi) {			/* first checkpoint not before n */
+        mid = (lo + hi) / 2;
+        if (x->ring[(x->head + mid) % x->size].tstamp < n->tstamp)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == x->count || x->ring[(x->head + lo) % x->size].node != n)
+        return;
+    for (x->count--; lo < x->count; lo++)
+        x->ring[(x->head + lo) % x->size] = x->ring[(x->head + lo + 1) % x->size];
+}
+
+/*
+ * returns the newest checkpointed node whose timestamp is less than then
+ * (or equal to it, if ifequal), or NULL if there is none
+ */
+Node *table_ts_before(Table *tn, tstamp_t then, int ifequal) {
+    TSIndex *x = &(tn->tsindex);
+    long lo = 0, hi = x->count, mid;
+    tstamp_t ts;
+
+    /* find the first checkpoint that is not before then */
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        ts = x->ring[(x->head + mid) % x->size].tstamp;
+        if (ts < then || (ifequal && ts == then))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (! lo)
+        return NULL;
+    return x->ring[(x->head + lo - 1) % x->size].node;
+}
+
+/*
+ * the secondary indexes of a table; see colindex.h
+ *
+ * all of these must be called with the table locked
+ */
+
+/*
+ * create an index over column col, entering the rows already in the table
+ *
+ * returns 1 if successful, 0 if an index of that name exists or there is
+ * insufficient memory
+ */
+int table_add_index(Table *tn, char *name, int col, int kind) {
+    ColIndex *x;
+    Node *n;
+
+    for (x = tn->indexes; x; x = cidx_next(x))
+        if (strcmp(cidx_name(x), name) == 0) {
+            errorf("Index %s exists. Doing nothing.\n", name);
+            return 0;
+        }
+    if (! (x = cidx_new(name, col, tn->coltype[col], kind)))
+        return 0;
+    for (n = tn->oldest; n; n = n->next)
+        if (! cidx_add(x, n)) {
+            cidx_free(x);
+            return 0;
+        }
+    cidx_set_next(x, tn->indexes);
+    tn->indexes = x;
+    return 1;
+}
+
+/*
+ * note that n has been linked into the table
+ */
+void table_index_add(Table *tn, Node *n) {
+    ColIndex *x;
+
+    for (x = tn->indexes; x; x = cidx_next(x))
+        (void) cidx_add(x, n);
+}
+
+/*
+ * note that n is about to be unlinked from the table, or its tuple
+ * replaced
+ */
+void table_index_remove(Table *tn, Node *n) {
+    ColIndex *x;
+
+    for (x = tn->indexes; x; x = cidx_next(x))
+        cidx_remove(x, n);
+}
+
+/*
+ * returns an index that can answer a filter "col op value", preferring a
+ * hash index for equality, or NULL if there is none
+ */
+ColIndex *table_find_index(Table *tn, int col, int op) {
+    ColIndex *x, *ans = NULL;
+
+    for (x = tn->indexes; x; x = cidx_next(x)) {
+        if (cidx_column(x) != col || ! cidx_supports(x, op))
+            continue;
+        if (! ans || cidx_kind(x) == SQL_INDEX_HASH)
+            ans = x;
+    }
+    return ans;
+}
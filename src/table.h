@@ -38,11 +38,34 @@
 
 #include "node.h"
 #include "adts/linkedlist.h"
+#include "adts/hashmap.h"
+#include "timestamp.h"
 #include "sqlstmts.h"
 #include "rtab.h"
 #include "srpc/srpc.h"
 #include <pthread.h>
 
+/*
+ * sparse index over the timestamps of a stream table; a ring of
+ * checkpoints, one every TABLE_TSINDEX_GAP rows, oldest first
+ *
+ * rows of a stream table are only ever appended at the newest end and
+ * removed from the oldest end, and their timestamps are strictly
+ * increasing, so the checkpoints are sorted and can be binary searched
+ */
+typedef struct tscheckpoint {
+    tstamp_t tstamp;		/* timestamp of the node */
+    struct node *node;		/* checkpointed node */
+} TSCheckpoint;
+
+typedef struct tsindex {
+    TSCheckpoint *ring;		/* the checkpoints */
+    long size;			/* capacity of the ring */
+    long head;			/* index of the oldest checkpoint */
+    long count;			/* number of checkpoints */
+    long since;			/* rows appended since the last checkpoint */
+} TSIndex;
+
 typedef struct table {
     short tabletype;		/* type of table (persistent or not) */
     short primary_column;	/* primary column # for persistent table */
@@ -52,18 +75,47 @@ typedef struct table {
     struct node *oldest;	/* oldest node in the table */
     struct node *newest;	/* newest node in the table */
     long count;			/* number of nodes in the table */
-    pthread_mutex_t tb_mutex;	/* mutex for protecting the table */
+    int shard;			/* memory buffer shard holding the tuples */
+    short retain;		/* SQL_RETAIN_ type of retention policy */
+    long long retain_limit;	/* rows, milliseconds or bytes to retain */
+    long nbytes;		/* bytes of tuple data held by the table */
+    HashMap *pkindex;		/* primary key -> node, persistent tables */
+    TSIndex tsindex;		/* timestamp checkpoints, stream tables */
+    struct colindex *indexes;	/* secondary indexes, see colindex.h */
+    struct topic *topic;	/* topic of the table, NULL if none */
+    short restored;		/* kept in the memory buffer file across
+				   a restart */
+    pthread_rwlock_t tb_lock;	/* readers/writer lock for the table */
 } Table;
 
 Table *table_new(int ncols, char **colname, int **coltype);
+void table_init(Table *tn, int ncols, char **colname, int **coltype);
+void table_restore(Table *tn, int ncols, char **colname, int **coltype);
 int table_colnames_match(Table *tn, sqlselect *select);
+void table_lock_init(Table *tn);
 void table_lock(Table *tn);
+void table_rdlock(Table *tn);
 void table_unlock(Table *tn);
 void table_store_select_cols(Table *tn, sqlselect *select, Rtab *results);
 void table_extract_relevant_types(Table *tn, Rtab *results);
 int table_lookup_colindex(Table *tn, char *colname);
 void table_tabletype(Table *tn, short tabletype, short primary_column);
 int table_persistent(Table *tn);
+int table_compatible(Table *tn, int ncols, int **coltypes);
+void table_retention(Table *tn, short retain, long long retain_limit);
+int table_retained(Table *tn);
 int table_key(Table *tn);
+void table_pk_add(Table *tn, struct node *n);
+void table_pk_remove(Table *tn, struct node *n);
+struct node *table_pk_lookup(Table *tn, char *value);
+struct node *table_constrained(Table *tn, char **colvals);
+void table_ts_append(Table *tn, struct node *n);
+void table_ts_evict(Table *tn, struct node *n);
+void table_ts_remove(Table *tn, struct node *n);
+struct node *table_ts_before(Table *tn, tstamp_t then, int ifequal);
+int table_add_index(Table *tn, char *name, int col, int kind);
+void table_index_add(Table *tn, struct node *n);
+void table_index_remove(Table *tn, struct node *n);
+struct colindex *table_find_index(Table *tn, int col, int op);
 
 #endif /* _TABLE_H_ */
@@ -55,7 +55,7 @@ tstamp_t timestamp_now(void) {
 
 char *timestamp_to_string(tstamp_t ts) {
     char b[64], *s;
-    sprintf(b, "@%016llx@", ts & ~DROPPED);	/* ignore dropped bit if set */
+    sprintf(b, "@%016llx@", ts);
     s = strdup(b);
     return s;
 }
@@ -46,12 +46,21 @@
 
 #define DEFAULT_STREAM_TABLE_SIZE 20
 
-typedef struct topic {
+/*
+ * the number of subscribers is kept alongside the list of them, so that
+ * a table with none can skip publication without taking the lock; order
+ * is held by an insert from before its rows are timestamped until they
+ * are published, see top_hold()
+ */
+struct topic {
+    char *name;
     int ncells;
     SchemaCell *schema;
     LinkedList *regAUs;
+    volatile int nsubs;		/* number of entries in regAUs */
     pthread_mutex_t lock;
-} Topic;
+    pthread_mutex_t order;
+};
 
 static TSHashMap *topicTable;
 
@@ -116,32 +125,41 @@ static SchemaCell *unpack(char *schema, int *ncells) {
     return ans;
 }
 
-int top_create(char *name, char *schema) {
+/*
+ * returns the new topic, or NULL if it is already defined or cannot be
+ * created
+ */
+Topic *top_create(char *name, char *schema) {
     Topic *st;
     int ncells;
     char bf[1024];
 
     if (tshm_containsKey(topicTable, name))	/* topic already defined */
-        return 0;
+        return NULL;
     st = (Topic *)malloc(sizeof(Topic));
     if (st != NULL) {
         void *dummy;
         strcpy(bf, schema);
         pthread_mutex_init(&(st->lock), NULL);
+        pthread_mutex_init(&(st->order), NULL);
+        st->nsubs = 0;
         st->schema = unpack(bf, &ncells);
         if (st->schema != NULL) {
             st->ncells = ncells;
             st->regAUs = ll_create();
             if (st->regAUs != NULL) {
-                if (tshm_put(topicTable, name, st, &dummy))
-                    return 1;
+                if ((st->name = strdup(name))) {
+                    if (tshm_put(topicTable, name, st, &dummy))
+                        return st;
+                    free(st->name);
+                }
                 ll_destroy(st->regAUs, NULL);
             }
             free((void *)(st->schema));
         }
         free((void *)st);
     }
-    return 0;
+    return NULL;
 }
 
 int top_publish(char *name, char *message) {
@@ -172,12 +190,79 @@ int top_publish(char *name, char *message) {
     return ret;
 }
 
+/*
+ * returns the number of subscribers to a topic, read without the lock;
+ * a subscription that races with a publication may miss its events
+ */
+int top_subscribers(Topic *st) {
+    return (st) ? st->nsubs : 0;
+}
+
+/*
+ * called before rows are inserted into the table of a topic; if it has
+ * subscribers, the rows of the table are serialized until top_release(),
+ * so that concurrent inserts publish their events in timestamp order
+ *
+ * returns 1 if the rows are to be published, 0 if there are no
+ * subscribers, in which case top_release() need not be called
+ */
+int top_hold(Topic *st) {
+    if (! top_subscribers(st))
+        return 0;
+    pthread_mutex_lock(&(st->order));
+    return 1;
+}
+
+void top_release(Topic *st) {
+    pthread_mutex_unlock(&(st->order));
+}
+
+/*
+ * publish a row inserted into the table of a topic, with timestamp ts
+ * and a value for each of the other columns of its schema; the event is
+ * built only if there are subscribers
+ */
+int top_publish_row(Topic *st, tstamp_t ts, char *vals[]) {
+    return top_publish_rows(st, 1, &ts, &vals);
+}
+
+/*
+ * publish n rows to a topic as one batch; the topic is locked once, and
+ * each subscriber is handed the events in order
+ */
+int top_publish_rows(Topic *st, int n, tstamp_t ts[], char **vals[]) {
+    if (! top_subscribers(st))
+        return 0;
+    pthread_mutex_lock(&(st->lock));
+    if (ll_size(st->regAUs) > 0L) {
+        void **ids;
+        long i, nAUs;
+        int j;
+        ids = ll_toArray(st->regAUs, &nAUs);
+        if (ids) {
+            for (j = 0; j < n; j++) {
+                Event *event;
+                event = ev_create_row(st->name, st->ncells, st->schema,
+                                      ts[j], vals[j], nAUs);
+                if (! event)
+                    continue;
+                for (i = 0; i < nAUs; i++)
+                    au_publish((unsigned long)ids[i], event);
+            }
+            free((void *)ids);
+        }
+    }
+    pthread_mutex_unlock(&(st->lock));
+    return 1;
+}
+
 int top_subscribe(char *name, unsigned long id) {
     Topic *st;
 
     if (tshm_get(topicTable, name, (void **)&st)) {
         pthread_mutex_lock(&(st->lock));
-        (void)ll_add(st->regAUs, (void *)id);
+        if (ll_add(st->regAUs, (void *)id))
+            (void) __sync_fetch_and_add(&(st->nsubs), 1);
         pthread_mutex_unlock(&(st->lock));
         return 1;
     }
@@ -197,6 +282,7 @@ void top_unsubscribe(char *name, unsigned long id) {
             (void)ll_get(st->regAUs, n, (void **)&entId);
             if (entId == id) {
                 (void)ll_remove(st->regAUs, n, (void **)&entId);
+                (void) __sync_fetch_and_sub(&(st->nsubs), 1);
                 break;
             }
         }
@@ -39,10 +39,17 @@ typedef struct schemaCell {
     int type;
 } SchemaCell;
 
+typedef struct topic Topic;
+
 void top_init(void);
 int  top_exist(char *name);
-int  top_create(char *name, char *schema);
+Topic *top_create(char *name, char *schema);
 int  top_publish(char *name, char *message);
+int  top_subscribers(Topic *st);
+int  top_hold(Topic *st);
+void top_release(Topic *st);
+int  top_publish_row(Topic *st, tstamp_t ts, char *vals[]);
+int  top_publish_rows(Topic *st, int n, tstamp_t ts[], char **vals[]);
 int  top_subscribe(char *name, unsigned long id);
 void top_unsubscribe(char *name, unsigned long id);
 int  top_schema(char *name, int *ncells, SchemaCell **schema);
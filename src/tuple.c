@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2013, Court of the University of Glasgow
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the University of Glasgow nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * tuple.c - encoding and decoding of tuples stored in the memory buffer
+ */
+
+#include "tuple.h"
+#include "typetable.h"
+#include "timestamp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int tuple_class(int *type) {
+    if (type == PRIMTYPE_REAL)
+        return TUPLE_REAL;
+    if (type == PRIMTYPE_TIMESTAMP)
+        return TUPLE_TSTAMP;
+    if (type == PRIMTYPE_VARCHAR || type == PRIMTYPE_CHARACTER
+            || type == PRIMTYPE_BLOB)
+        return TUPLE_STR;
+    return TUPLE_INT;		/* boolean, integer, tinyint, smallint */
+}
+
+int tuple_size(int ncols, char *vals[], int **types) {
+    int i;
+    int len = ncols * sizeof(union TupleSlot);
+
+    for (i = 0; i < ncols; i++)
+        if (tuple_class(types[i]) == TUPLE_STR)
+            len += strlen(vals[i]) + 1;
+    return len;
+}
+
+void tuple_parse(char *val, int *type, union TupleSlot *slot) {
+    switch (tuple_class(type)) {
+    case TUPLE_INT:
+        slot->intv = strtoll(val, NULL, 10);
+        break;
+    case TUPLE_REAL:
+        slot->realv = strtod(val, NULL);
+        break;
+    case TUPLE_TSTAMP:
+        slot->tstampv = string_to_timestamp(val);
+        break;
+    default:
+        break;
+    }
+}
+
+void tuple_encode(unsigned char *t, int ncols, char *vals[], int **types) {
+    union Tuple *p = (union Tuple *)t;
+    unsigned int off = ncols * sizeof(union TupleSlot);
+    unsigned int len;
+    int i;
+
+    for (i = 0; i < ncols; i++) {
+        if (tuple_class(types[i]) == TUPLE_STR) {
+            len = strlen(vals[i]);
+            p->slots[i].str.off = off;
+            p->slots[i].str.len = len;
+            memcpy(t + off, vals[i], len + 1);
+            off += len + 1;
+        } else
+            tuple_parse(vals[i], types[i], &(p->slots[i]));
+    }
+}
+
+char *tuple_slot_text(union TupleSlot *slot, int *type, char *buf) {
+    switch (tuple_class(type)) {
+    case TUPLE_INT:
+        sprintf(buf, "%lld", slot->intv);
+        break;
+    case TUPLE_REAL:
+        /* shortest representation that converts back to the same value */
+        sprintf(buf, "%.15g", slot->realv);
+        if (strtod(buf, NULL) != slot->realv)
+            sprintf(buf, "%.17g", slot->realv);
+        break;
+    case TUPLE_TSTAMP:
+        sprintf(buf, "@%016llx@", slot->tstampv);
+        break;
+    default:
+        *buf = '\0';
+        break;
+    }
+    return buf;
+}
+
+char *tuple_text(unsigned char *t, int i, int *type, char *buf) {
+    if (tuple_class(type) == TUPLE_STR)
+        return tuple_str(t, i);
+    return tuple_slot_text(&tuple_slot(t, i), type, buf);
+}
+
+char *tuple_strdup(unsigned char *t, int i, int *type) {
+    char buf[TUPLE_TEXT_LEN];
+
+    return strdup(tuple_text(t, i, type, buf));
+}
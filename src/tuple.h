@@ -35,11 +35,96 @@
 #ifndef _TUPLE_H_
 #define _TUPLE_H_
 
+#include "timestamp.h"
+
 #define MAX_TUPLE_SIZE 4096
 
+/*
+ * tuples are stored in a binary layout driven by the table schema: one
+ * 8-byte slot per column, followed by the text of any variable-length
+ * columns
+ *
+ * boolean, integer, tinyint and smallint columns are stored in their slot
+ * as a long long, real columns as a double, and timestamp columns as a
+ * tstamp_t; character, varchar and blob columns store the offset (from the
+ * start of the tuple) and length of their NUL-terminated text
+ *
+ * since offsets are relative to the tuple, a tuple may be copied anywhere
+ */
+union TupleSlot {
+    long long intv;
+    double realv;
+    tstamp_t tstampv;
+    struct {
+        unsigned int off;
+        unsigned int len;
+    } str;
+};
+
 union Tuple {
     unsigned char bytes[MAX_TUPLE_SIZE];
-    char *ptrs[MAX_TUPLE_SIZE/sizeof(char *)];
+    union TupleSlot slots[MAX_TUPLE_SIZE/sizeof(union TupleSlot)];
 };
 
+/*
+ * storage classes of column types
+ */
+#define TUPLE_INT 0
+#define TUPLE_REAL 1
+#define TUPLE_TSTAMP 2
+#define TUPLE_STR 3
+
+/*
+ * accessors for column i of the tuple starting at t
+ */
+#define tuple_slot(t, i) (((union Tuple *)(t))->slots[i])
+#define tuple_int(t, i) (tuple_slot(t, i).intv)
+#define tuple_real(t, i) (tuple_slot(t, i).realv)
+#define tuple_tstamp(t, i) (tuple_slot(t, i).tstampv)
+#define tuple_str(t, i) ((char *)(t) + tuple_slot(t, i).str.off)
+#define tuple_strlen(t, i) (tuple_slot(t, i).str.len)
+
+/* size of buffer needed by tuple_text() for a fixed-width column */
+#define TUPLE_TEXT_LEN 32
+
+/*
+ * returns the storage class of a column type
+ */
+int tuple_class(int *type);
+
+/*
+ * returns the number of bytes needed to encode the ncols values
+ */
+int tuple_size(int ncols, char *vals[], int **types);
+
+/*
+ * encodes the ncols values, converting each according to its column type,
+ * into the tuple starting at t, which must be at least tuple_size() bytes
+ */
+void tuple_encode(unsigned char *t, int ncols, char *vals[], int **types);
+
+/*
+ * converts a string to the value that would be stored in a slot for a
+ * column of the given type; for variable-length columns, nothing is stored
+ */
+void tuple_parse(char *val, int *type, union TupleSlot *slot);
+
+/*
+ * formats the value stored in a slot for a fixed-width column of the
+ * given type into buf, which must be at least TUPLE_TEXT_LEN bytes long
+ */
+char *tuple_slot_text(union TupleSlot *slot, int *type, char *buf);
+
+/*
+ * returns column i as text; variable-length columns return a pointer into
+ * the tuple, fixed-width ones are formatted into buf, which must be at
+ * least TUPLE_TEXT_LEN bytes long
+ */
+char *tuple_text(unsigned char *t, int i, int *type, char *buf);
+
+/*
+ * returns column i as a newly malloc'ed string
+ */
+char *tuple_strdup(unsigned char *t, int i, int *type);
+
 #endif /* _TUPLE_H_ */